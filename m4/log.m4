@@ -85,7 +85,7 @@ AC_DEFUN([MSU_LOG_TYPE_CHECK],
 	AC_MSG_CHECKING([for --with-log-type=$1])
 
 	AS_CASE($1,
-		[0|1], [],
+		[0|1|2], [],
 
 		[AC_MSG_ERROR(["$1 is not a valid value"], 1)]
 	)
@@ -22,7 +22,9 @@
 
 #include "async.h"
 #include "error.h"
+#include "limit.h"
 #include "log.h"
+#include "probes.h"
 
 msu_async_cb_data_t *msu_async_cb_data_new(msu_task_t *task,
 					   msu_upnp_task_complete_t cb,
@@ -47,6 +49,16 @@ void msu_async_cb_data_delete(msu_async_cb_data_t *cb_data)
 			g_free(cb_data->ut.bas.root_path);
 			if (cb_data->ut.bas.vbs)
 				g_ptr_array_unref(cb_data->ut.bas.vbs);
+			if (cb_data->ut.bas.child_ids)
+				g_ptr_array_unref(cb_data->ut.bas.child_ids);
+			if (cb_data->ut.bas.pages)
+				g_ptr_array_unref(cb_data->ut.bas.pages);
+			if (cb_data->ut.bas.pending_counts)
+				g_ptr_array_unref(
+					cb_data->ut.bas.pending_counts);
+			g_free(cb_data->ut.bas.cache_key);
+			g_free(cb_data->ut.bas.upnp_filter);
+			g_free(cb_data->ut.bas.sort_by);
 			break;
 		case MSU_TASK_GET_PROP:
 			g_free(cb_data->ut.get_prop.root_path);
@@ -57,6 +69,20 @@ void msu_async_cb_data_delete(msu_async_cb_data_t *cb_data)
 			if (cb_data->ut.get_all.vb)
 				g_variant_builder_unref(cb_data->ut.get_all.vb);
 			break;
+		case MSU_TASK_COUNT:
+			g_free(cb_data->ut.count.cache_key);
+			break;
+		case MSU_TASK_LIST_TREE:
+			g_free(cb_data->ut.tree.root_path);
+			g_free(cb_data->ut.tree.upnp_filter);
+			g_free(cb_data->ut.tree.client);
+			if (cb_data->ut.tree.containers)
+				g_ptr_array_unref(cb_data->ut.tree.containers);
+			if (cb_data->ut.tree.requests)
+				g_ptr_array_unref(cb_data->ut.tree.requests);
+			if (cb_data->ut.tree.chunk)
+				g_variant_builder_unref(cb_data->ut.tree.chunk);
+			break;
 		default:
 			break;
 		}
@@ -73,6 +99,9 @@ gboolean msu_async_complete_task(gpointer user_data)
 	MSU_LOG_DEBUG("Enter. Error %p", (void *) cb_data->error);
 	MSU_LOG_DEBUG_NL();
 
+	MSU_PROBE3(async_complete, cb_data->type, cb_data->id,
+		   cb_data->error ? cb_data->error->code : 0);
+
 	cb_data->cb(cb_data->task, cb_data->result, cb_data->error,
 		    cb_data->user_data);
 	msu_async_cb_data_delete(cb_data);
@@ -84,7 +113,10 @@ void msu_async_task_cancelled(GCancellable *cancellable, gpointer user_data)
 {
 	msu_async_cb_data_t *cb_data = user_data;
 
-	gupnp_service_proxy_cancel_action(cb_data->proxy, cb_data->action);
+	MSU_PROBE2(async_cancelled, cb_data->type, cb_data->id);
+
+	if (cb_data->action)
+		msu_limit_cancel_action(cb_data->proxy, cb_data->action);
 
 	if (!cb_data->error)
 		cb_data->error = g_error_new(MSU_ERROR, MSU_ERROR_CANCELLED,
@@ -25,6 +25,8 @@
 
 #include <libgupnp/gupnp-control-point.h>
 
+#include "cache.h"
+#include "prefetch.h"
 #include "task.h"
 #include "upnp.h"
 
@@ -42,6 +44,20 @@ struct msu_async_bas_t_ {
 	guint retrieved;
 	guint max_count;
 	msu_async_cb_t get_children_cb;
+	msu_prefetch_t *prefetch;
+	gchar *cache_key;
+	guint generation;
+	gchar *upnp_filter;
+	gchar *sort_by;
+	GPtrArray *child_ids;
+	GPtrArray *pages;
+	guint pages_in_flight;
+	guint next_start;
+	guint end;
+	guint total_matches;
+	gboolean first_page_done;
+	GPtrArray *pending_counts;
+	struct msu_device_t_ *device;
 };
 
 typedef struct msu_async_get_prop_t_ msu_async_get_prop_t;
@@ -57,10 +73,35 @@ struct msu_async_get_all_t_ {
 	GVariantBuilder *vb;
 	gchar *root_path;
 	guint32 filter_mask;
+	const gchar *upnp_filter;
 	const gchar *protocol_info;
 	gboolean need_child_count;
 };
 
+typedef struct msu_async_tree_t_ msu_async_tree_t;
+struct msu_async_tree_t_ {
+	guint32 filter_mask;
+	gchar *root_path;
+	gchar *upnp_filter;
+	const gchar *protocol_info;
+	gchar *client;
+	struct msu_device_t_ *device;
+	GPtrArray *containers;
+	guint next_container;
+	GPtrArray *requests;
+	GVariantBuilder *chunk;
+	guint chunk_len;
+	guint found;
+	gboolean finished;
+};
+
+typedef struct msu_async_count_t_ msu_async_count_t;
+struct msu_async_count_t_ {
+	gchar *cache_key;
+	const gchar *cache_id;
+	guint generation;
+};
+
 struct msu_async_cb_data_t_ {
 	msu_task_type_t type;
 	msu_task_t *task;
@@ -73,10 +114,14 @@ struct msu_async_cb_data_t_ {
 	GCancellable *cancellable;
 	gulong cancel_id;
 	gchar *id;
+	GHashTable *versions;
+	msu_cache_t *cache;
 	union {
 		msu_async_bas_t bas;
 		msu_async_get_prop_t get_prop;
 		msu_async_get_all_t get_all;
+		msu_async_count_t count;
+		msu_async_tree_t tree;
 	} ut;
 };
 
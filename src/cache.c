@@ -0,0 +1,265 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#include <string.h>
+
+#include "cache.h"
+#include "log.h"
+
+#define MSU_CACHE_KEY_SEPARATOR '\x1f'
+
+struct msu_cache_t_ {
+	GHashTable *entries;
+	GQueue lru;
+	guint max_entries;
+	gint64 ttl;
+	gboolean degraded;
+	gint64 degraded_ttl;
+	guint generation;
+	guint hits;
+	guint misses;
+	guint prefetch_hits;
+	guint evictions;
+};
+
+static void prv_cache_entry_delete(gpointer data)
+{
+	msu_cache_entry_t *entry = data;
+
+	if (entry) {
+		g_free(entry->key);
+		g_free(entry->id);
+		g_free(entry->didl);
+		g_free(entry);
+	}
+}
+
+static void prv_cache_remove(msu_cache_t *cache, msu_cache_entry_t *entry)
+{
+	g_queue_delete_link(&cache->lru, entry->link);
+	(void) g_hash_table_remove(cache->entries, entry->key);
+}
+
+static void prv_cache_trim(msu_cache_t *cache, guint max_entries)
+{
+	msu_cache_entry_t *entry;
+
+	while (g_queue_get_length(&cache->lru) > max_entries) {
+		entry = g_queue_peek_tail(&cache->lru);
+		prv_cache_remove(cache, entry);
+		cache->evictions++;
+	}
+}
+
+static msu_cache_entry_t *prv_cache_find(msu_cache_t *cache, const gchar *key)
+{
+	msu_cache_entry_t *entry;
+	gint64 now;
+
+	entry = g_hash_table_lookup(cache->entries, key);
+	if (!entry)
+		goto on_exit;
+
+	now = g_get_monotonic_time();
+
+	if (entry->expiry <= now ||
+	    (cache->degraded && entry->inserted + cache->degraded_ttl <= now)) {
+		MSU_LOG_DEBUG("Cache entry expired");
+
+		prv_cache_remove(cache, entry);
+		entry = NULL;
+	}
+
+on_exit:
+
+	return entry;
+}
+
+void msu_cache_new(msu_cache_t **cache)
+{
+	msu_cache_t *c = g_new0(msu_cache_t, 1);
+
+	c->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+					   prv_cache_entry_delete);
+	g_queue_init(&c->lru);
+
+	*cache = c;
+}
+
+void msu_cache_delete(msu_cache_t *cache)
+{
+	if (cache) {
+		g_queue_clear(&cache->lru);
+		g_hash_table_unref(cache->entries);
+		g_free(cache);
+	}
+}
+
+gchar *msu_cache_make_key(const gchar *id, const gchar *upnp_filter,
+			  const gchar *sort_by, guint start, guint count)
+{
+	return g_strdup_printf("%s%c%s%c%s%c%u%c%u",
+			       id, MSU_CACHE_KEY_SEPARATOR,
+			       upnp_filter, MSU_CACHE_KEY_SEPARATOR,
+			       sort_by, MSU_CACHE_KEY_SEPARATOR,
+			       start, MSU_CACHE_KEY_SEPARATOR, count);
+}
+
+const msu_cache_entry_t *msu_cache_lookup(msu_cache_t *cache,
+					  const gchar *key)
+{
+	msu_cache_entry_t *entry = NULL;
+
+	if (!cache->max_entries)
+		goto on_exit;
+
+	entry = prv_cache_find(cache, key);
+
+	if (!entry) {
+		cache->misses++;
+		goto on_exit;
+	}
+
+	cache->hits++;
+
+	if (entry->prefetched && !entry->used)
+		cache->prefetch_hits++;
+
+	entry->used = TRUE;
+
+	g_queue_unlink(&cache->lru, entry->link);
+	g_queue_push_head_link(&cache->lru, entry->link);
+
+on_exit:
+
+	return entry;
+}
+
+gboolean msu_cache_contains(msu_cache_t *cache, const gchar *key)
+{
+	return prv_cache_find(cache, key) != NULL;
+}
+
+void msu_cache_insert(msu_cache_t *cache, const gchar *key, const gchar *id,
+		      const gchar *didl, guint number_returned,
+		      guint total_matches, gboolean prefetched,
+		      guint generation)
+{
+	msu_cache_entry_t *entry;
+
+	/* The cache was flushed or invalidated while the browse that
+	   produced this result was in flight.  The result may be stale. */
+
+	if (!cache->max_entries || generation != cache->generation)
+		goto on_exit;
+
+	entry = g_hash_table_lookup(cache->entries, key);
+	if (entry)
+		prv_cache_remove(cache, entry);
+
+	entry = g_new0(msu_cache_entry_t, 1);
+	entry->key = g_strdup(key);
+	entry->id = g_strdup(id);
+	entry->didl = g_strdup(didl);
+	entry->number_returned = number_returned;
+	entry->total_matches = total_matches;
+	entry->inserted = g_get_monotonic_time();
+	entry->expiry = entry->inserted + cache->ttl;
+	entry->prefetched = prefetched;
+
+	g_queue_push_head(&cache->lru, entry);
+	entry->link = g_queue_peek_head_link(&cache->lru);
+	g_hash_table_insert(cache->entries, entry->key, entry);
+
+	prv_cache_trim(cache, cache->max_entries);
+
+on_exit:
+
+	return;
+}
+
+void msu_cache_invalidate_id(msu_cache_t *cache, const gchar *id)
+{
+	GList *link;
+	GList *next;
+	msu_cache_entry_t *entry;
+
+	cache->generation++;
+
+	link = cache->lru.head;
+	while (link) {
+		next = link->next;
+		entry = link->data;
+
+		if (!strcmp(entry->id, id))
+			prv_cache_remove(cache, entry);
+
+		link = next;
+	}
+}
+
+void msu_cache_flush(msu_cache_t *cache)
+{
+	cache->generation++;
+	prv_cache_trim(cache, 0);
+}
+
+void msu_cache_set_limits(msu_cache_t *cache, guint max_entries, guint ttl)
+{
+	cache->ttl = (gint64) ttl * G_USEC_PER_SEC;
+	cache->max_entries = ttl ? max_entries : 0;
+
+	prv_cache_trim(cache, cache->max_entries);
+}
+
+void msu_cache_set_degraded(msu_cache_t *cache, gboolean degraded,
+			    guint ttl)
+{
+	/* While changes may go unreported entries are only trusted for
+	   ttl seconds after they were fetched, whatever cache-ttl says. */
+
+	cache->degraded = degraded;
+	cache->degraded_ttl = (gint64) ttl * G_USEC_PER_SEC;
+}
+
+guint msu_cache_get_generation(msu_cache_t *cache)
+{
+	return cache->generation;
+}
+
+guint msu_cache_get_prefetch_hits(msu_cache_t *cache)
+{
+	return cache->prefetch_hits;
+}
+
+void msu_cache_add_statistics(msu_cache_t *cache, GVariantBuilder *vb)
+{
+	g_variant_builder_add(vb, "{sv}", "CacheEntries",
+			      g_variant_new_uint32(
+				      g_queue_get_length(&cache->lru)));
+	g_variant_builder_add(vb, "{sv}", "CacheHits",
+			      g_variant_new_uint32(cache->hits));
+	g_variant_builder_add(vb, "{sv}", "CacheMisses",
+			      g_variant_new_uint32(cache->misses));
+	g_variant_builder_add(vb, "{sv}", "CacheEvictions",
+			      g_variant_new_uint32(cache->evictions));
+}
@@ -0,0 +1,67 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#ifndef MSU_CACHE_H__
+#define MSU_CACHE_H__
+
+#include <glib.h>
+
+typedef struct msu_cache_t_ msu_cache_t;
+
+typedef struct msu_cache_entry_t_ msu_cache_entry_t;
+struct msu_cache_entry_t_ {
+	gchar *key;
+	gchar *id;
+	gchar *didl;
+	guint number_returned;
+	guint total_matches;
+	gint64 inserted;
+	gint64 expiry;
+	gboolean prefetched;
+	gboolean used;
+	GList *link;
+};
+
+void msu_cache_new(msu_cache_t **cache);
+void msu_cache_delete(msu_cache_t *cache);
+
+gchar *msu_cache_make_key(const gchar *id, const gchar *upnp_filter,
+			  const gchar *sort_by, guint start, guint count);
+
+const msu_cache_entry_t *msu_cache_lookup(msu_cache_t *cache,
+					  const gchar *key);
+gboolean msu_cache_contains(msu_cache_t *cache, const gchar *key);
+void msu_cache_insert(msu_cache_t *cache, const gchar *key, const gchar *id,
+		      const gchar *didl, guint number_returned,
+		      guint total_matches, gboolean prefetched,
+		      guint generation);
+void msu_cache_invalidate_id(msu_cache_t *cache, const gchar *id);
+void msu_cache_flush(msu_cache_t *cache);
+
+void msu_cache_set_limits(msu_cache_t *cache, guint max_entries, guint ttl);
+void msu_cache_set_degraded(msu_cache_t *cache, gboolean degraded,
+			    guint ttl);
+guint msu_cache_get_generation(msu_cache_t *cache);
+guint msu_cache_get_prefetch_hits(msu_cache_t *cache);
+void msu_cache_add_statistics(msu_cache_t *cache, GVariantBuilder *vb);
+
+#endif
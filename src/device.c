@@ -21,13 +21,17 @@
  */
 
 #include <string.h>
+#include <gobject/gvaluecollector.h>
 #include <libgupnp/gupnp-error.h>
 
 #include "device.h"
 #include "error.h"
 #include "interface.h"
+#include "limit.h"
 #include "log.h"
 #include "path.h"
+#include "probes.h"
+#include "trace.h"
 
 #define MSU_SYSTEM_UPDATE_VAR "SystemUpdateID"
 #define MSU_CONTAINER_UPDATE_VAR "ContainerUpdateIDs"
@@ -39,6 +43,51 @@ typedef struct msu_device_count_data_t_ msu_device_count_data_t;
 struct msu_device_count_data_t_ {
 	msu_device_count_cb_t cb;
 	msu_async_cb_data_t *cb_data;
+	gchar *id;
+	guint generation;
+};
+
+#define MSU_DEVICE_BROWSE_MIN_PAGE 16
+#define MSU_DEVICE_BROWSE_MAX_PAGE 1024
+#define MSU_DEVICE_BROWSE_TARGET_TIME 500000
+#define MSU_DEVICE_BROWSE_TARGET_BYTES (256 * 1024)
+#define MSU_DEVICE_COUNT_BATCH 16
+
+/* A short page may just as well come from a server having a bad moment,
+   so a cap on the size of responses is only believed once the same
+   count has come back this many times. */
+
+#define MSU_DEVICE_PAGE_CAP_REPEATS 3
+
+/* The number of objects matching a search depends on every container
+   below the one searched.  Cached search counts are therefore filed
+   under a pseudo object ID that is invalidated whenever any container
+   changes. */
+
+#define MSU_DEVICE_SEARCH_CACHE_ID ""
+
+#define MSU_DEVICE_TREE_PAGE 256
+#define MSU_DEVICE_TREE_CHUNK 256
+
+#define MSU_DEVICE_RESUBSCRIBE_MIN_DELAY 2000
+#define MSU_DEVICE_RESUBSCRIBE_MAX_DELAY 300000
+
+typedef struct msu_device_tree_node_t_ msu_device_tree_node_t;
+struct msu_device_tree_node_t_ {
+	gchar *id;
+	guint depth;
+};
+
+typedef struct msu_device_tree_request_t_ msu_device_tree_request_t;
+struct msu_device_tree_request_t_ {
+	msu_async_cb_data_t *cb_data;
+	gchar *id;
+	gchar *parent_path;
+	guint depth;
+	guint start;
+	guint count;
+	GUPnPServiceProxy *proxy;
+	GUPnPServiceProxyAction *action;
 };
 
 typedef struct msu_device_object_builder_t_ msu_device_object_builder_t;
@@ -48,6 +97,41 @@ struct msu_device_object_builder_t_ {
 	gboolean needs_child_count;
 };
 
+typedef struct msu_device_page_t_ msu_device_page_t;
+struct msu_device_page_t_ {
+	msu_async_cb_data_t *cb_data;
+	msu_device_t *device;
+	guint start;
+	guint count;
+	gint64 sent;
+	GUPnPServiceProxy *proxy;
+	GUPnPServiceProxyAction *action;
+	gchar *didl;
+	guint number_returned;
+};
+
+typedef struct msu_device_count_job_t_ msu_device_count_job_t;
+struct msu_device_count_job_t_ {
+	msu_device_t *device;
+	gchar *client;
+	gchar *path;
+	gchar *root_path;
+	GPtrArray *ids;
+	guint next;
+	GPtrArray *requests;
+	GVariantBuilder *counts;
+	guint batched;
+};
+
+typedef struct msu_device_count_request_t_ msu_device_count_request_t;
+struct msu_device_count_request_t_ {
+	msu_device_count_job_t *job;
+	gchar *id;
+	guint generation;
+	GUPnPServiceProxy *proxy;
+	GUPnPServiceProxyAction *action;
+};
+
 static void prv_get_child_count(msu_async_cb_data_t *cb_data,
 				msu_device_count_cb_t cb, const gchar *id);
 static void prv_retrieve_child_count_for_list(msu_async_cb_data_t *cb_data);
@@ -59,6 +143,9 @@ static void prv_system_update_cb(GUPnPServiceProxy *proxy,
 				const char *variable,
 				GValue *value,
 				gpointer user_data);
+static void prv_subscription_lost_cb(GUPnPServiceProxy *proxy,
+				     const GError *reason,
+				     gpointer user_data);
 
 static void prv_msu_device_object_builder_delete(void *dob)
 {
@@ -73,8 +160,40 @@ static void prv_msu_device_object_builder_delete(void *dob)
 	}
 }
 
+static void prv_msu_device_count_request_delete(gpointer request)
+{
+	msu_device_count_request_t *req = request;
+
+	if (req) {
+		if (req->action)
+			msu_limit_cancel_action(req->proxy, req->action);
+
+		if (req->proxy)
+			g_object_unref(req->proxy);
+
+		g_free(req->id);
+		g_free(req);
+	}
+}
+
+static void prv_msu_device_count_job_delete(gpointer job)
+{
+	msu_device_count_job_t *j = job;
+
+	if (j) {
+		g_ptr_array_unref(j->requests);
+		g_ptr_array_unref(j->ids);
+		g_variant_builder_unref(j->counts);
+		g_free(j->client);
+		g_free(j->path);
+		g_free(j->root_path);
+		g_free(j);
+	}
+}
+
 static void prv_msu_device_count_data_new(msu_async_cb_data_t *cb_data,
 					  msu_device_count_cb_t cb,
+					  const gchar *id,
 					  msu_device_count_data_t **count_data)
 {
 	msu_device_count_data_t *cd;
@@ -82,28 +201,58 @@ static void prv_msu_device_count_data_new(msu_async_cb_data_t *cb_data,
 	cd = g_new(msu_device_count_data_t, 1);
 	cd->cb = cb;
 	cd->cb_data = cb_data;
+	cd->id = g_strdup(id);
+	cd->generation = cb_data->cache ?
+		msu_cache_get_generation(cb_data->cache) : 0;
 
 	*count_data = cd;
 }
 
+static void prv_msu_device_count_data_delete(msu_device_count_data_t *cd)
+{
+	if (cd) {
+		g_free(cd->id);
+		g_free(cd);
+	}
+}
+
+static void prv_context_unsubscribe(msu_device_context_t *context)
+{
+	if (context->timeout_id) {
+		(void) g_source_remove(context->timeout_id);
+		context->timeout_id = 0;
+	}
+
+	if (!context->notifying)
+		return;
+
+	(void) g_signal_handlers_disconnect_by_func(
+		context->service_proxy,
+		G_CALLBACK(prv_subscription_lost_cb), context);
+	gupnp_service_proxy_remove_notify(context->service_proxy,
+					  MSU_SYSTEM_UPDATE_VAR,
+					  prv_system_update_cb,
+					  context->device);
+	gupnp_service_proxy_remove_notify(context->service_proxy,
+					  MSU_CONTAINER_UPDATE_VAR,
+					  prv_container_update_cb,
+					  context->device);
+	gupnp_service_proxy_set_subscribed(context->service_proxy, FALSE);
+	context->subscription = MSU_DEVICE_SUBSCRIPTION_IDLE;
+	context->retries = 0;
+	context->notifying = FALSE;
+}
+
 static void prv_msu_context_delete(gpointer context)
 {
 	msu_device_context_t *ctx = context;
 
 	if (ctx) {
-		if (ctx->timeout_id)
-			(void) g_source_remove(ctx->timeout_id);
-
-		if (ctx->subscribed) {
-			gupnp_service_proxy_remove_notify(ctx->service_proxy,
-						MSU_SYSTEM_UPDATE_VAR,
-						prv_system_update_cb,
-						ctx->device);
-			gupnp_service_proxy_remove_notify(ctx->service_proxy,
-						MSU_CONTAINER_UPDATE_VAR,
-						prv_container_update_cb,
-						ctx->device);
-		}
+		/* Background requests may keep the service proxy alive after
+		   the context has gone, so nothing must be left on it that
+		   refers to the context. */
+
+		prv_context_unsubscribe(ctx);
 
 		if (ctx->device_proxy)
 			g_object_unref(ctx->device_proxy);
@@ -132,7 +281,10 @@ static void prv_msu_context_new(const gchar *ip_address,
 	ctx->service_proxy = (GUPnPServiceProxy *)
 		gupnp_device_info_get_service((GUPnPDeviceInfo *) proxy,
 					      service_type);
-	ctx->subscribed = FALSE;
+	msu_limit_attach(device->limit, ctx->service_proxy);
+	ctx->subscription = MSU_DEVICE_SUBSCRIPTION_IDLE;
+	ctx->retries = 0;
+	ctx->notifying = FALSE;
 	ctx->timeout_id = 0;
 
 	*context = ctx;
@@ -146,11 +298,35 @@ void msu_device_delete(void *device)
 		if (dev->timeout_id)
 			(void) g_source_remove(dev->timeout_id);
 
+		if (dev->events_timeout_id)
+			(void) g_source_remove(dev->events_timeout_id);
+
+		if (dev->lost_timeout_id)
+			(void) g_source_remove(dev->lost_timeout_id);
+
 		if (dev->id)
 			(void) g_dbus_connection_unregister_subtree(
 				dev->connection, dev->id);
 
+		if (dev->caps_action)
+			msu_limit_cancel_action(dev->caps_proxy,
+						dev->caps_action);
+
+		if (dev->caps_proxy)
+			g_object_unref(dev->caps_proxy);
+
+		msu_quirks_record_clear(&dev->caps);
+
+		g_ptr_array_unref(dev->count_jobs);
+		msu_watch_delete(dev->watch);
+		msu_index_delete(dev->index);
+		if (dev->container_versions)
+			g_hash_table_unref(dev->container_versions);
+		msu_prefetch_delete(dev->prefetch);
+		msu_cache_delete(dev->cache);
+
 		g_ptr_array_unref(dev->contexts);
+		msu_limit_unref(dev->limit);
 		g_free(dev->path);
 		g_free(dev);
 	}
@@ -183,6 +359,126 @@ static void prv_build_container_update_array(const gchar *root_path,
 	g_strfreev(str_array);
 }
 
+static gboolean prv_update_container_version(msu_device_t *device,
+					     const gchar *id,
+					     const gchar *version_str)
+{
+	gpointer value;
+	guint version;
+	gchar *end;
+	gboolean retval = TRUE;
+
+	/* A container whose version we cannot parse is assumed to have
+	   changed. */
+
+	if (!version_str)
+		goto on_exit;
+
+	version = (guint) g_ascii_strtoull(version_str, &end, 10);
+	if (end == version_str)
+		goto on_exit;
+
+	if (g_hash_table_lookup_extended(device->container_versions, id, NULL,
+					 &value) &&
+	    GPOINTER_TO_UINT(value) == version) {
+		retval = FALSE;
+		goto on_exit;
+	}
+
+	g_hash_table_insert(device->container_versions, g_strdup(id),
+			    GUINT_TO_POINTER(version));
+
+on_exit:
+
+	return retval;
+}
+
+static gboolean prv_invalidate_containers(msu_device_t *device,
+					  const gchar *value)
+{
+	gchar **str_array;
+	int pos;
+	gboolean pairs = FALSE;
+
+	str_array = g_strsplit(value, ",", 0);
+
+	for (pos = 0; str_array[pos]; pos += 2) {
+		if (str_array[pos + 1] && *str_array[pos])
+			pairs = TRUE;
+
+		if (prv_update_container_version(device, str_array[pos],
+						 str_array[pos + 1])) {
+			MSU_LOG_DEBUG("Container %s changed", str_array[pos]);
+
+			msu_cache_invalidate_id(device->cache, str_array[pos]);
+			msu_cache_invalidate_id(device->cache,
+						MSU_DEVICE_SEARCH_CACHE_ID);
+			msu_index_invalidate_id(device->index, str_array[pos]);
+			msu_watch_invalidate_id(device->watch, str_array[pos]);
+		}
+
+		if (!str_array[pos + 1])
+			break;
+	}
+
+	g_strfreev(str_array);
+
+	return pairs;
+}
+
+static void prv_add_container_update_id(GHashTable *versions,
+					GVariantBuilder *vb,
+					GUPnPDIDLLiteObject *object)
+{
+	gpointer value;
+
+	if (versions &&
+	    g_hash_table_lookup_extended(versions,
+					 gupnp_didl_lite_object_get_id(object),
+					 NULL, &value))
+		msu_props_add_container_update_id(vb, GPOINTER_TO_UINT(value));
+}
+
+static void prv_subscription_confirmed(msu_device_t *device,
+				       GUPnPServiceProxy *proxy)
+{
+	msu_device_context_t *context = NULL;
+	guint i;
+
+	for (i = 0; i < device->contexts->len; ++i) {
+		context = g_ptr_array_index(device->contexts, i);
+		if (context->service_proxy == proxy)
+			break;
+	}
+
+	/* Servers send the current value of every evented variable as
+	   soon as a subscription is accepted, so any event tells us the
+	   subscription works. */
+
+	if (i == device->contexts->len ||
+	    context->subscription == MSU_DEVICE_SUBSCRIPTION_ACTIVE)
+		goto on_exit;
+
+	if (context->retries) {
+		MSU_LOG_DEBUG("Subscription on %s renewed after %u attempts",
+			      device->path, context->retries);
+
+		/* Anything that changed while we were not subscribed went
+		   unreported. */
+
+		msu_cache_flush(device->cache);
+		msu_watch_invalidate_all(device->watch);
+	}
+
+	context->subscription = MSU_DEVICE_SUBSCRIPTION_ACTIVE;
+	context->retries = 0;
+	msu_cache_set_degraded(device->cache, FALSE, 0);
+
+on_exit:
+
+	return;
+}
+
 static void prv_container_update_cb(GUPnPServiceProxy *proxy,
 				    const char *variable,
 				    GValue *value,
@@ -192,6 +488,17 @@ static void prv_container_update_cb(GUPnPServiceProxy *proxy,
 	GVariantBuilder array;
 
 	MSU_LOG_DEBUG("Container Update %s", g_value_get_string(value));
+	MSU_PROBE2(gena_container_update, device->path,
+		   g_value_get_string(value));
+
+	prv_subscription_confirmed(device, proxy);
+
+	/* The initial event after subscribing usually carries an empty
+	   value, which says nothing about whether the server reports
+	   changes per container. */
+
+	if (prv_invalidate_containers(device, g_value_get_string(value)))
+		device->container_events = TRUE;
 
 	g_variant_builder_init(&array, G_VARIANT_TYPE("ao"));
 	prv_build_container_update_array(device->path,
@@ -215,6 +522,18 @@ static void prv_system_update_cb(GUPnPServiceProxy *proxy,
 	msu_device_t *device = user_data;
 
 	MSU_LOG_DEBUG("System Update %u", g_value_get_uint(value));
+	MSU_PROBE2(gena_system_update, device->path, g_value_get_uint(value));
+
+	prv_subscription_confirmed(device, proxy);
+
+	/* Most servers bump SystemUpdateID on every change.  Once a server
+	   has shown that it reports changes per container we rely on
+	   ContainerUpdateIDs to invalidate only what actually moved. */
+
+	if (!device->container_events) {
+		msu_cache_flush(device->cache);
+		msu_watch_invalidate_all(device->watch);
+	}
 
 	(void) g_dbus_connection_emit_signal(device->connection,
 			NULL,
@@ -225,11 +544,38 @@ static void prv_system_update_cb(GUPnPServiceProxy *proxy,
 			NULL);
 }
 
-static gboolean prv_re_enable_subscription(gpointer user_data)
+static guint prv_resubscribe_delay(guint retries, guint limit)
+{
+	guint delay = MSU_DEVICE_RESUBSCRIBE_MIN_DELAY;
+	guint i;
+
+	if (retries > limit)
+		delay = MSU_DEVICE_RESUBSCRIBE_MAX_DELAY;
+	else
+		for (i = 1; i < retries &&
+			     delay < MSU_DEVICE_RESUBSCRIBE_MAX_DELAY; ++i)
+			delay *= 2;
+
+	if (delay > MSU_DEVICE_RESUBSCRIBE_MAX_DELAY)
+		delay = MSU_DEVICE_RESUBSCRIBE_MAX_DELAY;
+
+	/* Half of the delay is random so that a server that dropped all
+	   its subscribers at once is not hit by all of them together when
+	   it comes back. */
+
+	return delay / 2 + g_random_int_range(0, delay / 2 + 1);
+}
+
+static gboolean prv_resubscribe_cb(gpointer user_data)
 {
 	msu_device_context_t *context = user_data;
 
+	MSU_LOG_DEBUG("Renew subscription on %s, attempt %u",
+		      context->device->path, context->retries);
+
 	context->timeout_id = 0;
+	context->subscription = MSU_DEVICE_SUBSCRIPTION_PENDING;
+	gupnp_service_proxy_set_subscribed(context->service_proxy, TRUE);
 
 	return FALSE;
 }
@@ -239,18 +585,35 @@ static void prv_subscription_lost_cb(GUPnPServiceProxy *proxy,
 				     gpointer user_data)
 {
 	msu_device_context_t *context = user_data;
+	msu_device_t *device = context->device;
+	guint delay;
 
-	if (!context->timeout_id) {
-		gupnp_service_proxy_set_subscribed(context->service_proxy,
-									TRUE);
-		context->timeout_id = g_timeout_add_seconds(10,
-						prv_re_enable_subscription,
-						context);
-	} else {
-		g_source_remove(context->timeout_id);
-		context->timeout_id = 0;
-		context->subscribed = FALSE;
-	}
+	MSU_PROBE2(gena_subscription_lost, device->path,
+		   reason ? reason->message : NULL);
+
+	if (context->timeout_id)
+		(void) g_source_remove(context->timeout_id);
+
+	/* Changes are not reported until the subscription is back, so
+	   cached pages are only trusted for a short while. */
+
+	msu_cache_set_degraded(device->cache, TRUE,
+			       device->event_lost_cache_ttl);
+
+	context->retries++;
+	context->subscription = context->retries > device->event_retry_limit ?
+		MSU_DEVICE_SUBSCRIPTION_FAILED :
+		MSU_DEVICE_SUBSCRIPTION_BACKOFF;
+
+	delay = prv_resubscribe_delay(context->retries,
+				      device->event_retry_limit);
+
+	MSU_LOG_WARNING("Subscription on %s lost (%s), retry in %u ms",
+			device->path, reason ? reason->message : "unknown",
+			delay);
+
+	context->timeout_id = g_timeout_add(delay, prv_resubscribe_cb,
+					    context);
 }
 
 void msu_device_subscribe_to_contents_change(msu_device_t *device)
@@ -273,7 +636,10 @@ void msu_device_subscribe_to_contents_change(msu_device_t *device)
 				prv_container_update_cb,
 				device);
 
-	context->subscribed = TRUE;
+	context->subscription = MSU_DEVICE_SUBSCRIPTION_PENDING;
+	context->retries = 0;
+	context->notifying = TRUE;
+	device->events_wanted = TRUE;
 	gupnp_service_proxy_set_subscribed(context->service_proxy, TRUE);
 
 	g_signal_connect(context->service_proxy,
@@ -282,319 +648,1561 @@ void msu_device_subscribe_to_contents_change(msu_device_t *device)
 				context);
 }
 
-gboolean msu_device_new(GDBusConnection *connection,
-			GUPnPDeviceProxy *proxy,
-			const gchar *ip_address,
-			const GDBusSubtreeVTable *vtable,
-			void *user_data,
-			guint counter,
-			msu_device_t **device)
+static void prv_unsubscribe_from_contents_change(msu_device_t *device)
 {
-	msu_device_t *dev = g_new0(msu_device_t, 1);
-	guint flags;
-	guint id;
-	GString *new_path = NULL;
+	msu_device_context_t *context;
+	guint i;
 
-	MSU_LOG_DEBUG("Enter");
+	MSU_LOG_DEBUG("Unsubscribe from events on %s", device->path);
 
-	dev->connection = connection;
-	dev->contexts = g_ptr_array_new_with_free_func(prv_msu_context_delete);
-	msu_device_append_new_context(dev, ip_address, proxy);
+	for (i = 0; i < device->contexts->len; ++i) {
+		context = g_ptr_array_index(device->contexts, i);
+		prv_context_unsubscribe(context);
+	}
 
-	msu_device_subscribe_to_contents_change(dev);
+	if (device->timeout_id) {
+		(void) g_source_remove(device->timeout_id);
+		device->timeout_id = 0;
+	}
 
-	new_path = g_string_new("");
-	g_string_printf(new_path, "%s/%u", MSU_SERVER_PATH, counter);
+	device->events_wanted = FALSE;
 
-	MSU_LOG_DEBUG("Server Path %s", new_path->str);
+	/* Nothing tells us about changes from now on, so nothing that was
+	   learnt from the server can be trusted either. */
 
-	flags = G_DBUS_SUBTREE_FLAGS_DISPATCH_TO_UNENUMERATED_NODES;
-	id =  g_dbus_connection_register_subtree(connection, new_path->str,
-						 vtable, flags, user_data, NULL,
-						 NULL);
-	if (!id)
-		goto on_error;
+	msu_cache_flush(device->cache);
+	msu_cache_set_degraded(device->cache, FALSE, 0);
+	g_hash_table_remove_all(device->container_versions);
+	device->container_events = FALSE;
+}
 
-	dev->path = g_string_free(new_path, FALSE);
-	dev->id = id;
+static gboolean prv_events_idle_cb(gpointer user_data)
+{
+	msu_device_t *device = user_data;
+	gint64 idle;
+	guint wait = device->event_idle_timeout;
+
+	device->events_timeout_id = 0;
+	idle = (g_get_monotonic_time() - device->events_last_used) /
+		G_USEC_PER_SEC;
+
+	if (idle < device->event_idle_timeout)
+		wait = device->event_idle_timeout - idle;
+	else if (!msu_watch_is_active(device->watch) &&
+		 !msu_index_is_enabled(device->index))
+		wait = 0;
+
+	if (wait)
+		device->events_timeout_id = g_timeout_add_seconds(
+			wait, prv_events_idle_cb, device);
+	else
+		prv_unsubscribe_from_contents_change(device);
 
-	*device = dev;
+	return FALSE;
+}
 
-	MSU_LOG_DEBUG("Exit with SUCCESS");
+static void prv_demand_events(msu_device_t *device)
+{
+	device->events_last_used = g_get_monotonic_time();
 
-	return TRUE;
+	if (!device->events_wanted)
+		msu_device_subscribe_to_contents_change(device);
 
-on_error:
-	if (new_path)
-		g_string_free(new_path, TRUE);
+	if (device->event_idle_timeout && !device->events_timeout_id)
+		device->events_timeout_id = g_timeout_add_seconds(
+			device->event_idle_timeout, prv_events_idle_cb,
+			device);
+}
 
-	msu_device_delete(dev);
+static const gchar *prv_get_event_subscription(msu_device_t *device)
+{
+	msu_device_context_t *context;
+	const gchar *retval;
 
-	MSU_LOG_DEBUG("Exit with FAIL");
+	context = msu_device_get_context(device);
 
-	return FALSE;
+	if (!device->events_wanted) {
+		retval = "Idle";
+		goto on_exit;
+	}
+
+	switch (context->subscription) {
+	case MSU_DEVICE_SUBSCRIPTION_PENDING:
+		retval = context->retries ? "Renewing" : "Subscribed";
+		break;
+	case MSU_DEVICE_SUBSCRIPTION_ACTIVE:
+		retval = "Subscribed";
+		break;
+	case MSU_DEVICE_SUBSCRIPTION_FAILED:
+		retval = "Lost";
+		break;
+	default:
+		retval = "Renewing";
+		break;
+	}
+
+on_exit:
+
+	return retval;
 }
 
-void msu_device_append_new_context(msu_device_t *device,
-				   const gchar *ip_address,
-				   GUPnPDeviceProxy *proxy)
+/* Every UPnP action goes through these two so that the concurrency
+   limiter of the server sees its latency and outcome. */
+
+static GUPnPServiceProxyAction *prv_begin_action(
+					GUPnPServiceProxy *proxy,
+					const gchar *action_name,
+					GUPnPServiceProxyActionCallback callback,
+					gpointer user_data, ...)
 {
-	msu_device_context_t *context;
+	GUPnPServiceProxyAction *action;
+	va_list args;
 
-	prv_msu_context_new(ip_address, proxy, device, &context);
-	g_ptr_array_add(device->contexts, context);
+	va_start(args, user_data);
+	action = gupnp_service_proxy_begin_action_valist(proxy, action_name,
+							 callback, user_data,
+							 args);
+	va_end(args);
+
+	msu_limit_action_begun(proxy, action);
+
+	return action;
 }
 
-msu_device_t *msu_device_from_path(const gchar *path, GHashTable *device_list)
+static GUPnPServiceProxy *prv_get_hedge_proxy(msu_device_t *device,
+					      GUPnPServiceProxy *proxy)
 {
-	GHashTableIter iter;
-	gpointer value;
-	msu_device_t *device;
-	msu_device_t *retval = NULL;
+	msu_device_context_t *context;
+	guint i;
 
-	g_hash_table_iter_init(&iter, device_list);
+	for (i = 0; i < device->contexts->len; ++i) {
+		context = g_ptr_array_index(device->contexts, i);
+		if (context->service_proxy != proxy)
+			return context->service_proxy;
+	}
 
-	while (g_hash_table_iter_next(&iter, NULL, &value)) {
-		device = value;
+	return NULL;
+}
 
-		if (!strcmp(device->path, path)) {
-			retval = device;
+/* Used for actions that clients wait on and that can safely be sent
+   twice.  If the server has several contexts, a copy of the action may
+   be sent on another one when the first is slow to answer.  The
+   callback must therefore use the proxy and action it is given. */
+
+static GUPnPServiceProxyAction *prv_begin_hedged_action(
+					msu_device_t *device,
+					GUPnPServiceProxy *proxy,
+					const gchar *action_name,
+					GUPnPServiceProxyActionCallback callback,
+					gpointer user_data, ...)
+{
+	GUPnPServiceProxyAction *action;
+	GList *names = NULL;
+	GList *values = NULL;
+	const gchar *name;
+	GValue *value;
+	GType type;
+	gchar *error = NULL;
+	va_list args;
+
+	va_start(args, user_data);
+	while ((name = va_arg(args, const gchar *))) {
+		type = va_arg(args, GType);
+		value = g_new0(GValue, 1);
+		G_VALUE_COLLECT_INIT(value, type, args, 0, &error);
+		if (error) {
+			MSU_LOG_WARNING("Unable to collect %s: %s", name,
+					error);
+			g_free(error);
+			g_free(value);
 			break;
 		}
+
+		names = g_list_prepend(names, (gpointer) name);
+		values = g_list_prepend(values, value);
 	}
+	va_end(args);
+
+	names = g_list_reverse(names);
+	values = g_list_reverse(values);
+
+	action = gupnp_service_proxy_begin_action_list(proxy, action_name,
+						       names, values,
+						       callback, user_data);
+	msu_limit_action_begun(proxy, action);
+	msu_limit_hedge(proxy, action, prv_get_hedge_proxy(device, proxy),
+			action_name, names, values, callback, user_data);
+
+	return action;
+}
+
+static gboolean prv_end_action(GUPnPServiceProxy *proxy,
+			       GUPnPServiceProxyAction *action,
+			       GError **error, ...)
+{
+	gboolean retval;
+	va_list args;
+
+	va_start(args, error);
+	retval = gupnp_service_proxy_end_action_valist(proxy, action, error,
+						       args);
+	va_end(args);
+
+	msu_limit_action_done(proxy, action, retval ? NULL : *error);
 
 	return retval;
 }
 
-msu_device_context_t *msu_device_get_context(msu_device_t *device)
+/* What a server can do is learned as it is used and kept in the quirks
+   database, so that the next time the server, or another of the same
+   model, is met the right strategy is used from the first request. */
+
+static void prv_save_caps(msu_device_t *device)
 {
 	msu_device_context_t *context;
-	unsigned int i;
-	const char ip4_local_prefix[] = "127.0.0.";
 
-	for (i = 0; i < device->contexts->len; ++i) {
-		context = g_ptr_array_index(device->contexts, i);
+	context = g_ptr_array_index(device->contexts, 0);
+	msu_quirks_update(device->quirks,
+			  (GUPnPDeviceInfo *) context->device_proxy,
+			  &device->caps);
+}
+
+static void prv_learn_child_count(msu_device_t *device, gboolean supported)
+{
+	msu_quirks_support_t child_count;
+
+	/* Some servers only give the childCount of some containers.  One
+	   that has been seen to give it at all is asked for it. */
+
+	child_count = supported ? MSU_QUIRKS_SUPPORTED : MSU_QUIRKS_UNSUPPORTED;
+
+	if (device->caps.child_count == child_count ||
+	    device->caps.child_count == MSU_QUIRKS_SUPPORTED)
+		return;
+
+	MSU_LOG_DEBUG("Server %s childCount", supported ? "provides" :
+		      "omits");
+
+	device->caps.child_count = child_count;
+	prv_save_caps(device);
+}
+
+static void prv_learn_page_cap(msu_device_t *device, guint cap)
+{
+	if (cap != device->page_cap_candidate) {
+		device->page_cap_candidate = cap;
+		device->page_cap_repeats = 0;
+	}
+
+	if (++device->page_cap_repeats < MSU_DEVICE_PAGE_CAP_REPEATS)
+		return;
+
+	device->page_cap_repeats = 0;
+
+	device->browse_page_cap = cap;
+	if (device->browse_page_size > cap)
+		device->browse_page_size = cap;
+
+	if (device->caps.page_cap != cap) {
+		device->caps.page_cap = cap;
+		prv_save_caps(device);
+	}
+}
+
+static const gchar *g_caps_actions[] = {
+	"GetSortCapabilities",
+	"GetSearchCapabilities"
+};
+
+static const gchar *g_caps_args[] = {
+	"SortCaps",
+	"SearchCaps"
+};
+
+static void prv_get_caps_cb(GUPnPServiceProxy *proxy,
+			    GUPnPServiceProxyAction *action,
+			    gpointer user_data)
+{
+	msu_device_t *device = user_data;
+	GError *upnp_error = NULL;
+	gchar *caps = NULL;
+	gchar **target;
+
+	device->caps_action = NULL;
+
+	/* The queries are independent of each other, so a server that
+	   cannot sort may still be able to search. */
+
+	if (!prv_end_action(proxy, action, &upnp_error,
+			    g_caps_args[device->caps_query], G_TYPE_STRING,
+			    &caps, NULL)) {
+		MSU_LOG_WARNING("%s failed: %s",
+				g_caps_actions[device->caps_query],
+				upnp_error->message);
+		g_error_free(upnp_error);
+	} else {
+		target = device->caps_query ? &device->caps.search_caps :
+			&device->caps.sort_caps;
+
+		if (g_strcmp0(*target, caps ? caps : "")) {
+			MSU_LOG_DEBUG("%s: %s",
+				      g_caps_args[device->caps_query], caps);
+
+			g_free(*target);
+			*target = g_strdup(caps ? caps : "");
+			prv_save_caps(device);
+		}
+	}
+
+	if (++device->caps_query < G_N_ELEMENTS(g_caps_actions))
+		device->caps_action = prv_begin_action(
+			proxy, g_caps_actions[device->caps_query],
+			prv_get_caps_cb, device, NULL);
+
+	if (!device->caps_action) {
+		device->caps_query = G_N_ELEMENTS(g_caps_actions);
+		g_object_unref(device->caps_proxy);
+		device->caps_proxy = NULL;
+	}
+
+	g_free(caps);
+}
+
+static void prv_demand_caps(msu_device_t *device)
+{
+	msu_device_context_t *context;
+
+	/* The capabilities are asked for once per run, even if they were
+	   recorded earlier, in case the server's firmware has changed. */
+
+	if (device->caps_query || device->caps_action)
+		return;
+
+	context = msu_device_get_context(device);
+	device->caps_proxy = g_object_ref(context->service_proxy);
+	device->caps_action = prv_begin_action(device->caps_proxy,
+					       g_caps_actions[0],
+					       prv_get_caps_cb, device, NULL);
+}
+
+static void prv_prefetch_cb(GUPnPServiceProxy *proxy,
+			    GUPnPServiceProxyAction *action,
+			    gpointer user_data)
+{
+	msu_prefetch_job_t *job = user_data;
+	GError *upnp_error = NULL;
+	gchar *result = NULL;
+	gint number_returned = 0;
+	gint total_matches = 0;
+
+	MSU_LOG_DEBUG("Enter");
+
+	MSU_PROBE2(soap_end, job->id, user_data);
+
+	if (!prv_end_action(proxy, action, &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &total_matches,
+			    NULL)) {
+		MSU_LOG_WARNING("Prefetch failed: %s", upnp_error->message);
+
+		g_error_free(upnp_error);
+	}
+
+	msu_prefetch_job_complete(job, result, number_returned, total_matches);
+
+	g_free(result);
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+static GUPnPServiceProxyAction *prv_begin_background_browse(
+					msu_device_t *device,
+					const gchar *id,
+					const gchar *upnp_filter,
+					const gchar *sort_by,
+					guint start, guint count,
+					GUPnPServiceProxyActionCallback callback,
+					gpointer user_data,
+					GUPnPServiceProxy **proxy)
+{
+	msu_device_context_t *context;
+
+	context = msu_device_get_context(device);
+
+	*proxy = g_object_ref(context->service_proxy);
+
+	MSU_PROBE3(soap_begin, "Browse", id, user_data);
+
+	return prv_begin_action(*proxy,
+				"Browse",
+				callback,
+				user_data,
+				"ObjectID", G_TYPE_STRING,
+				id,
+
+				"BrowseFlag", G_TYPE_STRING,
+				"BrowseDirectChildren",
+
+				"Filter", G_TYPE_STRING,
+				upnp_filter,
+
+				"StartingIndex", G_TYPE_INT,
+				start,
+				"RequestedCount", G_TYPE_INT,
+				count,
+				"SortCriteria", G_TYPE_STRING,
+				sort_by,
+				NULL);
+}
+
+static void prv_prefetch_dispatch(msu_prefetch_job_t *job, void *user_data)
+{
+	job->action = prv_begin_background_browse(user_data, job->id,
+						  job->upnp_filter,
+						  job->sort_by, job->start,
+						  job->count, prv_prefetch_cb,
+						  job, &job->proxy);
+}
+
+static void prv_index_cb(GUPnPServiceProxy *proxy,
+			 GUPnPServiceProxyAction *action,
+			 gpointer user_data)
+{
+	msu_index_request_t *request = user_data;
+	GError *upnp_error = NULL;
+	gchar *result = NULL;
+	gint number_returned = 0;
+	gint total_matches = 0;
+
+	MSU_LOG_DEBUG("Enter");
+
+	MSU_PROBE2(soap_end, request->id, user_data);
+
+	if (!prv_end_action(proxy, action, &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &total_matches,
+			    NULL)) {
+		MSU_LOG_WARNING("Index request failed: %s",
+				upnp_error->message);
+
+		g_error_free(upnp_error);
+	}
+
+	msu_index_request_complete(request, result, number_returned,
+				   total_matches);
+
+	g_free(result);
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+static void prv_index_dispatch(msu_index_request_t *request, void *user_data)
+{
+	request->action = prv_begin_background_browse(user_data, request->id,
+						      MSU_INDEX_UPNP_FILTER,
+						      "", request->start,
+						      request->count,
+						      prv_index_cb, request,
+						      &request->proxy);
+}
+
+static void prv_watch_cb(GUPnPServiceProxy *proxy,
+			 GUPnPServiceProxyAction *action,
+			 gpointer user_data)
+{
+	msu_watch_request_t *request = user_data;
+	GError *upnp_error = NULL;
+	gchar *result = NULL;
+	gint number_returned = 0;
+	gint total_matches = 0;
+
+	MSU_LOG_DEBUG("Enter");
+
+	MSU_PROBE2(soap_end, request->id, user_data);
+
+	if (!prv_end_action(proxy, action, &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &total_matches,
+			    NULL)) {
+		MSU_LOG_WARNING("Watch request failed: %s",
+				upnp_error->message);
+
+		g_error_free(upnp_error);
+	}
+
+	msu_watch_request_complete(request, result, number_returned,
+				   total_matches);
+
+	g_free(result);
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+static void prv_watch_dispatch(msu_watch_request_t *request, void *user_data)
+{
+	request->action = prv_begin_background_browse(user_data, request->id,
+						      "*", "", request->start,
+						      request->count,
+						      prv_watch_cb, request,
+						      &request->proxy);
+}
+
+static void prv_demand(msu_device_t *device)
+{
+	prv_demand_events(device);
+	prv_demand_caps(device);
+	msu_prefetch_demand(device->prefetch);
+	msu_index_demand(device->index);
+}
+
+void msu_device_configure(msu_device_t *device,
+			  msu_settings_context_t *settings)
+{
+	msu_device_context_t *context;
+	const char *udn;
+	guint rate;
+	guint burst;
+
+	/* Called again whenever the configuration file is reloaded.  What
+	   has been learned about the server, such as its page size and
+	   action limit, is kept. */
+
+	context = g_ptr_array_index(device->contexts, 0);
+	udn = gupnp_device_info_get_udn((GUPnPDeviceInfo *)
+					context->device_proxy);
+
+	msu_settings_get_server_rate(settings, udn, &rate, &burst);
+	msu_limit_set_rate(device->limit, rate, burst);
+	msu_limit_set_bounds(device->limit,
+			     msu_settings_get_server_actions_min(settings),
+			     msu_settings_get_server_actions_max(settings));
+	msu_limit_set_hedge_percent(device->limit,
+				    msu_settings_get_hedge_percent(settings));
+
+	msu_cache_set_limits(device->cache,
+			     msu_settings_get_cache_size(settings),
+			     msu_settings_get_cache_ttl(settings));
+	msu_prefetch_configure(device->prefetch,
+			       msu_settings_is_prefetch(settings),
+			       msu_settings_get_prefetch_children(settings),
+			       msu_settings_get_prefetch_max_actions(settings));
+	msu_index_configure(device->index, msu_settings_is_index(settings),
+			    msu_settings_get_index_interval(settings),
+			    msu_settings_get_index_page_size(settings));
+
+	device->browse_max_actions =
+		msu_settings_get_browse_max_actions(settings);
+	device->event_idle_timeout =
+		msu_settings_get_event_idle_timeout(settings);
+	device->event_retry_limit =
+		msu_settings_get_event_retry_limit(settings);
+	device->event_lost_cache_ttl =
+		msu_settings_get_event_lost_cache_ttl(settings);
+}
+
+guint msu_device_get_rate_wait(msu_device_t *device)
+{
+	return msu_limit_get_wait(device->limit);
+}
+
+gboolean msu_device_new(GDBusConnection *connection,
+			GUPnPDeviceProxy *proxy,
+			const gchar *ip_address,
+			const GDBusSubtreeVTable *vtable,
+			void *user_data,
+			msu_settings_context_t *settings,
+			msu_quirks_t *quirks,
+			guint counter,
+			msu_device_t **device)
+{
+	msu_device_t *dev = g_new0(msu_device_t, 1);
+	guint flags;
+	guint id;
+	GString *new_path = NULL;
+
+	MSU_LOG_DEBUG("Enter");
+
+	dev->connection = connection;
+	msu_limit_new(msu_settings_get_server_actions_min(settings),
+		      msu_settings_get_server_actions_max(settings),
+		      &dev->limit);
+	dev->contexts = g_ptr_array_new_with_free_func(prv_msu_context_delete);
+	msu_device_append_new_context(dev, ip_address, proxy);
+
+	dev->container_versions = g_hash_table_new_full(g_str_hash,
+							g_str_equal,
+							g_free, NULL);
+
+	msu_cache_new(&dev->cache);
+	msu_prefetch_new(dev->cache, dev->limit, prv_prefetch_dispatch, dev,
+			 &dev->prefetch);
+
+	dev->count_jobs = g_ptr_array_new_with_free_func(
+		prv_msu_device_count_job_delete);
+
+	dev->browse_page_size = msu_settings_get_browse_page_size(settings);
+
+	dev->quirks = quirks;
+	msu_quirks_lookup(quirks, (GUPnPDeviceInfo *) proxy, &dev->caps);
+	if (dev->caps.page_cap) {
+		dev->browse_page_cap = dev->caps.page_cap;
+		dev->browse_page_size = MIN(dev->browse_page_size,
+					    dev->browse_page_cap);
+	}
+
+	msu_index_new(dev->limit, prv_index_dispatch, dev, &dev->index);
+	msu_watch_new(connection, dev->limit, dev->browse_page_size,
+		      prv_watch_dispatch, dev, &dev->watch);
+
+	/* Change events are only subscribed to once a client uses the
+	   server.  See prv_demand_events. */
+
+	msu_device_configure(dev, settings);
+
+	new_path = g_string_new("");
+	g_string_printf(new_path, "%s/%u", MSU_SERVER_PATH, counter);
+
+	MSU_LOG_DEBUG("Server Path %s", new_path->str);
+
+	flags = G_DBUS_SUBTREE_FLAGS_DISPATCH_TO_UNENUMERATED_NODES;
+	id =  g_dbus_connection_register_subtree(connection, new_path->str,
+						 vtable, flags, user_data, NULL,
+						 NULL);
+	if (!id)
+		goto on_error;
+
+	dev->path = g_string_free(new_path, FALSE);
+	dev->id = id;
+
+	*device = dev;
+
+	MSU_LOG_DEBUG("Exit with SUCCESS");
+
+	return TRUE;
+
+on_error:
+	if (new_path)
+		g_string_free(new_path, TRUE);
+
+	msu_device_delete(dev);
+
+	MSU_LOG_DEBUG("Exit with FAIL");
+
+	return FALSE;
+}
+
+void msu_device_append_new_context(msu_device_t *device,
+				   const gchar *ip_address,
+				   GUPnPDeviceProxy *proxy)
+{
+	msu_device_context_t *context;
+
+	prv_msu_context_new(ip_address, proxy, device, &context);
+	g_ptr_array_add(device->contexts, context);
+}
+
+msu_device_t *msu_device_from_path(const gchar *path, GHashTable *device_list)
+{
+	GHashTableIter iter;
+	gpointer value;
+	msu_device_t *device;
+	msu_device_t *retval = NULL;
+
+	g_hash_table_iter_init(&iter, device_list);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		device = value;
+
+		if (!strcmp(device->path, path)) {
+			retval = device;
+			break;
+		}
+	}
+
+	return retval;
+}
+
+msu_device_context_t *msu_device_get_context(msu_device_t *device)
+{
+	msu_device_context_t *context;
+	unsigned int i;
+	const char ip4_local_prefix[] = "127.0.0.";
+
+	for (i = 0; i < device->contexts->len; ++i) {
+		context = g_ptr_array_index(device->contexts, i);
+
+		if (!strncmp(context->ip_address, ip4_local_prefix,
+			     sizeof(ip4_local_prefix) - 1) ||
+		    !strcmp(context->ip_address, "::1") ||
+		    !strcmp(context->ip_address, "0:0:0:0:0:0:0:1"))
+			break;
+	}
+
+	if (i == device->contexts->len)
+		context = g_ptr_array_index(device->contexts, 0);
+
+	return context;
+}
+
+static GVariant *prv_get_statistics(msu_device_t *device)
+{
+	GVariantBuilder vb;
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("a{sv}"));
+	msu_cache_add_statistics(device->cache, &vb);
+	msu_prefetch_add_statistics(device->prefetch, &vb);
+	msu_limit_add_statistics(device->limit, &vb);
+	msu_props_add_intern_statistics(&vb);
+
+	return g_variant_builder_end(&vb);
+}
+
+static void prv_add_device_props(msu_device_t *device,
+				 msu_device_context_t *context,
+				 GVariantBuilder *vb)
+{
+	msu_props_add_device((GUPnPDeviceInfo *) context->device_proxy, vb);
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_PROP_STATISTICS,
+			      prv_get_statistics(device));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_PROP_INDEX_STATUS,
+			      msu_index_get_status(device->index));
+	g_variant_builder_add(vb, "{sv}",
+			      MSU_INTERFACE_PROP_EVENT_SUBSCRIPTION,
+			      g_variant_new_string(
+				      prv_get_event_subscription(device)));
+}
+
+static GVariant *prv_get_device_prop(msu_device_t *device,
+				     msu_device_context_t *context,
+				     const gchar *prop)
+{
+	GVariant *retval;
+
+	if (!strcmp(prop, MSU_INTERFACE_PROP_STATISTICS))
+		retval = g_variant_ref_sink(prv_get_statistics(device));
+	else if (!strcmp(prop, MSU_INTERFACE_PROP_INDEX_STATUS))
+		retval = g_variant_ref_sink(
+			msu_index_get_status(device->index));
+	else if (!strcmp(prop, MSU_INTERFACE_PROP_EVENT_SUBSCRIPTION))
+		retval = g_variant_ref_sink(g_variant_new_string(
+				prv_get_event_subscription(device)));
+	else
+		retval = msu_props_get_device_prop(
+			(GUPnPDeviceInfo *) context->device_proxy, prop);
+
+	return retval;
+}
+
+/* A child count is the TotalMatches of a Browse for the first child of
+   a container.  The result of that Browse is kept in the page cache so
+   that the counts of containers without a childCount attribute need
+   only be fetched once. */
+
+static gchar *prv_child_count_key(const gchar *id)
+{
+	return msu_cache_make_key(id, "", "", 0, 1);
+}
+
+static void prv_cache_child_count(msu_cache_t *cache, const gchar *id,
+				  const gchar *didl, gint number_returned,
+				  gint count, guint generation)
+{
+	gchar *key;
+
+	if (!didl || count < 0)
+		return;
+
+	key = prv_child_count_key(id);
+	msu_cache_insert(cache, key, id, didl, (guint) number_returned,
+			 (guint) count, FALSE, generation);
+	g_free(key);
+}
+
+static gboolean prv_get_cached_child_count(msu_cache_t *cache,
+					   const gchar *id, guint *count)
+{
+	const msu_cache_entry_t *entry;
+	gchar *key;
+
+	if (!cache)
+		return FALSE;
+
+	key = prv_child_count_key(id);
+	entry = msu_cache_lookup(cache, key);
+	g_free(key);
+
+	if (entry)
+		*count = entry->total_matches;
+
+	return entry != NULL;
+}
+
+static gboolean prv_add_cached_child_count(msu_cache_t *cache,
+					   GVariantBuilder *vb,
+					   GUPnPDIDLLiteObject *object)
+{
+	guint count;
+	gboolean retval;
+
+	retval = prv_get_cached_child_count(
+		cache, gupnp_didl_lite_object_get_id(object), &count);
+	if (retval)
+		msu_props_add_child_count(vb, count);
+
+	return retval;
+}
+
+static void prv_found_child(GUPnPDIDLLiteParser *parser,
+			    GUPnPDIDLLiteObject *object,
+			    gpointer user_data)
+{
+	msu_async_cb_data_t *cb_data = user_data;
+	msu_task_t *task = cb_data->task;
+	msu_task_get_children_t *task_data = &task->ut.get_children;
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_device_object_builder_t *builder;
+	gboolean have_child_count;
+
+	MSU_LOG_DEBUG("Enter");
+
+	builder = g_new0(msu_device_object_builder_t, 1);
+
+	if (cb_task_data->child_ids && GUPNP_IS_DIDL_LITE_CONTAINER(object))
+		g_ptr_array_add(cb_task_data->child_ids,
+				g_strdup(gupnp_didl_lite_object_get_id(object)));
+
+	if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
+		if (!task_data->containers)
+			goto on_error;
+	} else {
+		if (!task_data->items)
+			goto on_error;
+	}
+
+	builder->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+
+	if (!msu_props_add_object(builder->vb, object, cb_task_data->root_path,
+				  task->path, cb_task_data->filter_mask))
+		goto on_error;
+
+	if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
+		msu_props_add_container(builder->vb,
+					(GUPnPDIDLLiteContainer *) object,
+					cb_task_data->filter_mask,
+					&have_child_count);
+
+		if (cb_task_data->filter_mask &
+		    MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID)
+			prv_add_container_update_id(cb_data->versions,
+						    builder->vb, object);
+
+		if (cb_task_data->filter_mask & MSU_UPNP_MASK_PROP_CHILD_COUNT)
+			prv_learn_child_count(cb_task_data->device,
+					      have_child_count);
+
+		if (!have_child_count && (cb_task_data->filter_mask &
+					  MSU_UPNP_MASK_PROP_CHILD_COUNT) &&
+		    !prv_add_cached_child_count(cb_data->cache, builder->vb,
+						object)) {
+			if (cb_task_data->pending_counts) {
+				g_ptr_array_add(
+					cb_task_data->pending_counts,
+					g_strdup(gupnp_didl_lite_object_get_id(
+							 object)));
+			} else {
+				builder->needs_child_count = TRUE;
+				builder->id = g_strdup(
+					gupnp_didl_lite_object_get_id(object));
+				cb_task_data->need_child_count = TRUE;
+			}
+		}
+	} else {
+		msu_props_add_item(builder->vb, object,
+				   cb_task_data->filter_mask,
+				   cb_task_data->protocol_info);
+	}
+
+	g_ptr_array_add(cb_task_data->vbs, builder);
+
+	MSU_LOG_DEBUG("Exit with SUCCESS");
+
+	return;
+
+on_error:
+
+	prv_msu_device_object_builder_delete(builder);
+
+	MSU_LOG_DEBUG("Exit with FAIL");
+}
+
+static GVariant *prv_children_result_to_variant(msu_async_cb_data_t *cb_data)
+{
+	guint i;
+	msu_device_object_builder_t *builder;
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	GVariantBuilder vb;
+	GVariant *retval;
+
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "build");
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("aa{sv}"));
+
+	for (i = 0; i < cb_task_data->vbs->len; ++i) {
+		builder = g_ptr_array_index(cb_task_data->vbs, i);
+		g_variant_builder_add(&vb, "@a{sv}",
+				      g_variant_builder_end(builder->vb));
+	}
+
+	retval = g_variant_builder_end(&vb);
+
+	MSU_TRACE_END(cb_data->task->trace_id, "build");
+
+	return retval;
+}
+
+static void prv_get_search_ex_result(msu_async_cb_data_t *cb_data)
+{
+	GVariant *out_params[2];
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+
+	out_params[0] = prv_children_result_to_variant(cb_data);
+	out_params[1] = g_variant_new_uint32(cb_task_data->max_count);
+
+	cb_data->result = g_variant_ref_sink(
+		g_variant_new_tuple(out_params, 2));
+}
+
+static void prv_get_children_result(msu_async_cb_data_t *cb_data)
+{
+	GVariant *retval = prv_children_result_to_variant(cb_data);
+	cb_data->result =  g_variant_ref_sink(retval);
+}
+
+static gboolean prv_child_count_for_list_cb(msu_async_cb_data_t *cb_data,
+					    gint count)
+{
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_device_object_builder_t *builder;
+
+	builder = g_ptr_array_index(cb_task_data->vbs, cb_task_data->retrieved);
+	msu_props_add_child_count(builder->vb, count);
+	cb_task_data->retrieved++;
+	prv_retrieve_child_count_for_list(cb_data);
+
+	return cb_task_data->retrieved >= cb_task_data->vbs->len;
+}
+
+static void prv_retrieve_child_count_for_list(msu_async_cb_data_t *cb_data)
+{
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_device_object_builder_t *builder;
+	guint i;
+
+	for (i = cb_task_data->retrieved; i < cb_task_data->vbs->len; ++i) {
+		builder = g_ptr_array_index(cb_task_data->vbs, i);
+
+		if (builder->needs_child_count)
+			break;
+	}
+
+	cb_task_data->retrieved = i;
+
+	if (i < cb_task_data->vbs->len) {
+		prv_get_child_count(cb_data, prv_child_count_for_list_cb,
+				    builder->id);
+	} else {
+		MSU_TRACE_END(cb_data->task->trace_id, "child-counts");
+		cb_task_data->get_children_cb(cb_data);
+	}
+}
+
+static void prv_emit_child_counts(msu_device_count_job_t *job)
+{
+	if (!job->batched)
+		return;
+
+	(void) g_dbus_connection_emit_signal(job->device->connection,
+			job->client,
+			job->path,
+			MSU_INTERFACE_MEDIA_CONTAINER,
+			MSU_INTERFACE_CHILD_COUNTS_AVAILABLE,
+			g_variant_new("(@a{ou})",
+				      g_variant_builder_end(job->counts)),
+			NULL);
+
+	g_variant_builder_unref(job->counts);
+	job->counts = g_variant_builder_new(G_VARIANT_TYPE("a{ou}"));
+	job->batched = 0;
+}
+
+static void prv_count_job_cb(GUPnPServiceProxy *proxy,
+			     GUPnPServiceProxyAction *action,
+			     gpointer user_data);
+
+static void prv_schedule_count_job(msu_device_count_job_t *job)
+{
+	msu_device_t *device = job->device;
+	msu_device_count_request_t *request;
+	guint max_actions = MAX(device->browse_max_actions, 1);
+
+	/* Beyond the first request, a job only fans out as far as the
+	   server's concurrency limit allows. */
+
+	while (job->requests->len < max_actions &&
+	       (!job->requests->len || msu_limit_available(device->limit)) &&
+	       job->next < job->ids->len) {
+		request = g_new0(msu_device_count_request_t, 1);
+		request->job = job;
+		request->id = g_strdup(g_ptr_array_index(job->ids,
+							 job->next++));
+		request->generation = msu_cache_get_generation(device->cache);
+		request->action = prv_begin_background_browse(
+			device, request->id, "", "", 0, 1, prv_count_job_cb,
+			request, &request->proxy);
+
+		g_ptr_array_add(job->requests, request);
+	}
+
+	if (!job->requests->len) {
+		prv_emit_child_counts(job);
+		(void) g_ptr_array_remove_fast(device->count_jobs, job);
+	}
+}
+
+static void prv_count_job_cb(GUPnPServiceProxy *proxy,
+			     GUPnPServiceProxyAction *action,
+			     gpointer user_data)
+{
+	msu_device_count_request_t *request = user_data;
+	msu_device_count_job_t *job = request->job;
+	GError *upnp_error = NULL;
+	gchar *result = NULL;
+	gint number_returned = 0;
+	gint count = -1;
+	gchar *path;
+
+	MSU_LOG_DEBUG("Enter");
+
+	MSU_PROBE2(soap_end, request->id, user_data);
+
+	request->action = NULL;
+
+	if (!prv_end_action(proxy, action, &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &count,
+			    NULL)) {
+		MSU_LOG_WARNING("Unable to count children of %s: %s",
+				request->id, upnp_error->message);
+
+		g_error_free(upnp_error);
+	} else if (count >= 0) {
+		prv_cache_child_count(job->device->cache, request->id, result,
+				      number_returned, count,
+				      request->generation);
+
+		path = msu_path_from_id(job->root_path, request->id);
+		g_variant_builder_add(job->counts, "{ou}", path,
+				      (guint) count);
+		g_free(path);
+
+		if (++job->batched >= MSU_DEVICE_COUNT_BATCH)
+			prv_emit_child_counts(job);
+	}
+
+	g_free(result);
+
+	(void) g_ptr_array_remove_fast(job->requests, request);
+	prv_schedule_count_job(job);
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+static void prv_start_count_job(msu_async_cb_data_t *cb_data)
+{
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_device_t *device = cb_task_data->device;
+	msu_device_count_job_t *job;
+
+	MSU_LOG_DEBUG("Resolving %u child counts in the background",
+		      cb_task_data->pending_counts->len);
+
+	job = g_new0(msu_device_count_job_t, 1);
+	job->device = device;
+	job->client = g_strdup(g_dbus_method_invocation_get_sender(
+				       cb_data->task->invocation));
+	job->path = g_strdup(cb_data->task->path);
+	job->root_path = g_strdup(cb_task_data->root_path);
+	job->ids = g_ptr_array_ref(cb_task_data->pending_counts);
+	job->requests = g_ptr_array_new_with_free_func(
+		prv_msu_device_count_request_delete);
+	job->counts = g_variant_builder_new(G_VARIANT_TYPE("a{ou}"));
+
+	g_ptr_array_add(device->count_jobs, job);
+	prv_schedule_count_job(job);
+}
+
+static gboolean prv_parse_children(msu_async_cb_data_t *cb_data,
+				   const gchar *result)
+{
+	GUPnPDIDLLiteParser *parser;
+	GError *upnp_error = NULL;
+	gboolean retval = TRUE;
+	gboolean parsed;
+
+	MSU_LOG_DEBUG_DUMP("GetChildren result", result);
+
+	parser = gupnp_didl_lite_parser_new();
+
+	g_signal_connect(parser, "object-available" ,
+			 G_CALLBACK(prv_found_child), cb_data);
+
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "parse");
+	MSU_PROBE2(didl_parse, cb_data->id, result ? strlen(result) : 0);
+	parsed = gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error);
+	MSU_TRACE_END(cb_data->task->trace_id, "parse");
+
+	if (!parsed && upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
+		MSU_LOG_WARNING("Unable to parse results of browse: %s",
+			      upnp_error->message);
+
+		cb_data->error = g_error_new(MSU_ERROR,
+					     MSU_ERROR_OPERATION_FAILED,
+					     "Unable to parse results of "
+					     "browse: %s", upnp_error->message);
+		retval = FALSE;
+	}
+
+	if (upnp_error)
+		g_error_free(upnp_error);
+
+	g_object_unref(parser);
+
+	return retval;
+}
+
+static void prv_complete_children(msu_async_cb_data_t *cb_data,
+				  guint number_returned,
+				  guint total_matches)
+{
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_task_get_children_t *task_data = &cb_data->task->ut.get_children;
+
+	if (cb_data->error)
+		goto on_error;
+
+	msu_prefetch_browse_done(cb_task_data->prefetch, cb_data->id,
+				 cb_task_data->upnp_filter,
+				 cb_task_data->sort_by, task_data->start,
+				 task_data->count, number_returned,
+				 total_matches, cb_task_data->child_ids);
+
+	if (cb_task_data->need_child_count) {
+		MSU_LOG_DEBUG("Need to retrieve ChildCounts");
+
+		cb_task_data->get_children_cb = prv_get_children_result;
+		MSU_TRACE_BEGIN(cb_data->task->trace_id, "child-counts");
+		prv_retrieve_child_count_for_list(cb_data);
+		goto no_complete;
+	} else {
+		prv_get_children_result(cb_data);
+	}
+
+	/* Counts that were not in the DIDL are sent to the client in
+	   ChildCountsAvailable signals once the reply has gone out. */
+
+	if (cb_task_data->pending_counts && cb_task_data->pending_counts->len)
+		prv_start_count_job(cb_data);
+
+on_error:
+
+	(void) g_idle_add(msu_async_complete_task, cb_data);
+	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
+
+no_complete:
+
+	return;
+}
 
-		if (!strncmp(context->ip_address, ip4_local_prefix,
-			     sizeof(ip4_local_prefix) - 1) ||
-		    !strcmp(context->ip_address, "::1") ||
-		    !strcmp(context->ip_address, "0:0:0:0:0:0:0:1"))
-			break;
-	}
+static void prv_process_children_result(msu_async_cb_data_t *cb_data,
+					const gchar *result,
+					guint number_returned,
+					guint total_matches,
+					gboolean cache_result)
+{
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
 
-	if (i == device->contexts->len)
-		context = g_ptr_array_index(device->contexts, 0);
+	if (prv_parse_children(cb_data, result) && cache_result)
+		msu_cache_insert(cb_data->cache, cb_task_data->cache_key,
+				 cb_data->id, result, number_returned,
+				 total_matches, FALSE,
+				 cb_task_data->generation);
 
-	return context;
+	prv_complete_children(cb_data, number_returned, total_matches);
 }
 
-static void prv_found_child(GUPnPDIDLLiteParser *parser,
-			    GUPnPDIDLLiteObject *object,
-			    gpointer user_data)
+static void prv_get_children_cb(GUPnPServiceProxy *proxy,
+				GUPnPServiceProxyAction *action,
+				gpointer user_data)
 {
+	gchar *result = NULL;
+	gint number_returned = 0;
+	gint total_matches = 0;
+	GError *upnp_error = NULL;
 	msu_async_cb_data_t *cb_data = user_data;
-	msu_task_t *task = cb_data->task;
-	msu_task_get_children_t *task_data = &task->ut.get_children;
-	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	msu_device_object_builder_t *builder;
-	gboolean have_child_count;
 
 	MSU_LOG_DEBUG("Enter");
 
-	builder = g_new0(msu_device_object_builder_t, 1);
-
-	if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
-		if (!task_data->containers)
-			goto on_error;
-	} else {
-		if (!task_data->items)
-			goto on_error;
-	}
+	MSU_TRACE_END(cb_data->task->trace_id, "soap");
+	MSU_PROBE2(soap_end, cb_data->id, user_data);
+
+	if (!prv_end_action(proxy, action,
+			    &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &total_matches,
+			    NULL)) {
+		MSU_LOG_WARNING("Browse operation failed: %s",
+			      upnp_error->message);
 
-	builder->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+		cb_data->error = g_error_new(MSU_ERROR,
+					     MSU_ERROR_OPERATION_FAILED,
+					     "Browse operation failed: %s",
+					     upnp_error->message);
 
-	if (!msu_props_add_object(builder->vb, object, cb_task_data->root_path,
-				  task->path, cb_task_data->filter_mask))
+		(void) g_idle_add(msu_async_complete_task, cb_data);
+		g_cancellable_disconnect(cb_data->cancellable,
+					 cb_data->cancel_id);
 		goto on_error;
+	}
 
-	if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
-		msu_props_add_container(builder->vb,
-					(GUPnPDIDLLiteContainer *) object,
-					cb_task_data->filter_mask,
-					&have_child_count);
+	prv_process_children_result(cb_data, result, number_returned,
+				    total_matches, TRUE);
 
-		if (!have_child_count && (cb_task_data->filter_mask &
-					  MSU_UPNP_MASK_PROP_CHILD_COUNT)) {
-			builder->needs_child_count = TRUE;
-			builder->id = g_strdup(
-				gupnp_didl_lite_object_get_id(object));
-			cb_task_data->need_child_count = TRUE;
-		}
-	} else {
-		msu_props_add_item(builder->vb, object,
-				   cb_task_data->filter_mask,
-				   cb_task_data->protocol_info);
-	}
+on_error:
 
-	g_ptr_array_add(cb_task_data->vbs, builder);
+	if (upnp_error)
+		g_error_free(upnp_error);
 
-	MSU_LOG_DEBUG("Exit with SUCCESS");
+	g_free(result);
 
-	return;
+	MSU_LOG_DEBUG("Exit");
+}
 
-on_error:
+static void prv_msu_device_page_delete(gpointer page)
+{
+	msu_device_page_t *p = page;
 
-	prv_msu_device_object_builder_delete(builder);
+	if (p) {
+		if (p->proxy)
+			g_object_unref(p->proxy);
 
-	MSU_LOG_DEBUG("Exit with FAIL");
+		g_free(p->didl);
+		g_free(p);
+	}
 }
 
-static GVariant *prv_children_result_to_variant(msu_async_cb_data_t *cb_data)
+static gint prv_page_compare(gconstpointer a, gconstpointer b)
 {
-	guint i;
-	msu_device_object_builder_t *builder;
-	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	GVariantBuilder vb;
+	const msu_device_page_t *page_a = *(msu_device_page_t * const *) a;
+	const msu_device_page_t *page_b = *(msu_device_page_t * const *) b;
 
-	g_variant_builder_init(&vb, G_VARIANT_TYPE("aa{sv}"));
+	if (page_a->start < page_b->start)
+		return -1;
 
-	for (i = 0; i < cb_task_data->vbs->len; ++i) {
-		builder = g_ptr_array_index(cb_task_data->vbs, i);
-		g_variant_builder_add(&vb, "@a{sv}",
-				      g_variant_builder_end(builder->vb));
-	}
+	return page_a->start > page_b->start;
+}
 
-	return  g_variant_builder_end(&vb);
+static gboolean prv_use_pages(msu_device_t *device, guint count)
+{
+	return device->browse_page_size && device->browse_max_actions &&
+		(!count || count > device->browse_page_size);
 }
 
-static void prv_get_search_ex_result(msu_async_cb_data_t *cb_data)
+static void prv_adapt_page_size(msu_device_t *device,
+				msu_device_page_t *page,
+				gsize bytes, gint64 elapsed)
 {
-	GVariant *out_params[2];
-	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	guint64 by_time = MSU_DEVICE_BROWSE_MAX_PAGE;
+	guint64 by_bytes = MSU_DEVICE_BROWSE_MAX_PAGE;
+	guint64 ideal;
+	guint size;
 
-	out_params[0] = prv_children_result_to_variant(cb_data);
-	out_params[1] = g_variant_new_uint32(cb_task_data->max_count);
+	/* Only full pages say anything about what the server can cope
+	   with.  The size moves a quarter of the way towards the number
+	   of objects that would have been returned in the target time
+	   and within the target size. */
 
-	cb_data->result = g_variant_ref_sink(
-		g_variant_new_tuple(out_params, 2));
+	if (!page->number_returned || page->number_returned < page->count)
+		return;
+
+	if (elapsed > 0)
+		by_time = page->number_returned *
+			(guint64) MSU_DEVICE_BROWSE_TARGET_TIME / elapsed;
+
+	if (bytes > 0)
+		by_bytes = page->number_returned *
+			(guint64) MSU_DEVICE_BROWSE_TARGET_BYTES / bytes;
+
+	ideal = MIN(by_time, by_bytes);
+	ideal = CLAMP(ideal, MSU_DEVICE_BROWSE_MIN_PAGE,
+		      MSU_DEVICE_BROWSE_MAX_PAGE);
+
+	size = (device->browse_page_size * 3 + (guint) ideal) / 4;
+	size = CLAMP(size, MSU_DEVICE_BROWSE_MIN_PAGE,
+		     MSU_DEVICE_BROWSE_MAX_PAGE);
+
+	if (device->browse_page_cap && size > device->browse_page_cap)
+		size = device->browse_page_cap;
+
+	if (size != device->browse_page_size)
+		MSU_LOG_DEBUG("Browse page size %u -> %u (%u objects, %"
+			      G_GSIZE_FORMAT " bytes, %" G_GINT64_FORMAT
+			      " us)", device->browse_page_size, size,
+			      page->number_returned, bytes, elapsed);
+
+	device->browse_page_size = size;
 }
 
-static void prv_get_children_result(msu_async_cb_data_t *cb_data)
+static void prv_get_children_page_cb(GUPnPServiceProxy *proxy,
+				     GUPnPServiceProxyAction *action,
+				     gpointer user_data);
+
+static void prv_issue_page(msu_async_cb_data_t *cb_data,
+			   msu_device_t *device,
+			   guint start, guint count)
 {
-	GVariant *retval = prv_children_result_to_variant(cb_data);
-	cb_data->result =  g_variant_ref_sink(retval);
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_device_page_t *page;
+
+	MSU_LOG_DEBUG("Browse page %u+%u of %s", start, count, cb_data->id);
+
+	page = g_new0(msu_device_page_t, 1);
+	page->cb_data = cb_data;
+	page->device = device;
+	page->start = start;
+	page->count = count;
+	page->sent = g_get_monotonic_time();
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "soap");
+	page->action = prv_begin_background_browse(device, cb_data->id,
+						   cb_task_data->upnp_filter,
+						   cb_task_data->sort_by,
+						   start, count,
+						   prv_get_children_page_cb,
+						   page, &page->proxy);
+
+	g_ptr_array_add(cb_task_data->pages, page);
+	cb_task_data->pages_in_flight++;
 }
 
-static gboolean prv_child_count_for_list_cb(msu_async_cb_data_t *cb_data,
-					    gint count)
+static void prv_schedule_pages(msu_async_cb_data_t *cb_data,
+			       msu_device_t *device)
 {
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	msu_device_object_builder_t *builder;
+	guint count;
 
-	builder = g_ptr_array_index(cb_task_data->vbs, cb_task_data->retrieved);
-	msu_props_add_child_count(builder->vb, count);
-	cb_task_data->retrieved++;
-	prv_retrieve_child_count_for_list(cb_data);
+	while (!cb_data->error &&
+	       cb_task_data->pages_in_flight < device->browse_max_actions &&
+	       (!cb_task_data->pages_in_flight ||
+		msu_limit_available(device->limit)) &&
+	       cb_task_data->next_start < cb_task_data->end) {
 
-	return cb_task_data->retrieved >= cb_task_data->vbs->len;
+		/* The first page tells us how many children there are.
+		   Until it arrives we do not know how many pages to send. */
+
+		if (!cb_task_data->first_page_done &&
+		    cb_task_data->pages->len > 0)
+			break;
+
+		count = MIN(device->browse_page_size,
+			    cb_task_data->end - cb_task_data->next_start);
+		prv_issue_page(cb_data, device, cb_task_data->next_start,
+			       count);
+		cb_task_data->next_start += count;
+	}
 }
 
-static void prv_retrieve_child_count_for_list(msu_async_cb_data_t *cb_data)
+static void prv_complete_pages(msu_async_cb_data_t *cb_data)
 {
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	msu_device_object_builder_t *builder;
+	msu_device_page_t *page;
+	guint number_returned = 0;
 	guint i;
 
-	for (i = cb_task_data->retrieved; i < cb_task_data->vbs->len; ++i) {
-		builder = g_ptr_array_index(cb_task_data->vbs, i);
+	g_ptr_array_sort(cb_task_data->pages, prv_page_compare);
 
-		if (builder->needs_child_count)
-			break;
+	for (i = 0; i < cb_task_data->pages->len && !cb_data->error; ++i) {
+		page = g_ptr_array_index(cb_task_data->pages, i);
+		if (!page->didl || page->start >= cb_task_data->end)
+			continue;
+
+		if (prv_parse_children(cb_data, page->didl))
+			number_returned += page->number_returned;
 	}
 
-	cb_task_data->retrieved = i;
+	MSU_LOG_DEBUG("%u objects in %u pages", number_returned,
+		      cb_task_data->pages->len);
 
-	if (i < cb_task_data->vbs->len)
-		prv_get_child_count(cb_data, prv_child_count_for_list_cb,
-				    builder->id);
-	else
-		cb_task_data->get_children_cb(cb_data);
+	prv_complete_children(cb_data, number_returned,
+			      cb_task_data->total_matches);
 }
 
-static void prv_get_children_cb(GUPnPServiceProxy *proxy,
-				GUPnPServiceProxyAction *action,
-				gpointer user_data)
+static void prv_get_children_page_cb(GUPnPServiceProxy *proxy,
+				     GUPnPServiceProxyAction *action,
+				     gpointer user_data)
 {
+	msu_device_page_t *page = user_data;
+	msu_async_cb_data_t *cb_data = page->cb_data;
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_device_t *device = page->device;
 	gchar *result = NULL;
-	GUPnPDIDLLiteParser *parser = NULL;
+	gint number_returned = 0;
+	gint total_matches = 0;
 	GError *upnp_error = NULL;
-	msu_async_cb_data_t *cb_data = user_data;
-	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	guint next;
 
 	MSU_LOG_DEBUG("Enter");
 
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "Result", G_TYPE_STRING,
-					    &result, NULL)) {
+	page->action = NULL;
+	cb_task_data->pages_in_flight--;
+	MSU_TRACE_END(cb_data->task->trace_id, "soap");
+	MSU_PROBE2(soap_end, cb_data->id, user_data);
+
+	if (!prv_end_action(proxy, action, &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &total_matches,
+			    NULL)) {
 		MSU_LOG_WARNING("Browse operation failed: %s",
 			      upnp_error->message);
 
-		cb_data->error = g_error_new(MSU_ERROR,
-					     MSU_ERROR_OPERATION_FAILED,
-					     "Browse operation failed: %s",
-					     upnp_error->message);
+		if (!cb_data->error)
+			cb_data->error = g_error_new(
+				MSU_ERROR, MSU_ERROR_OPERATION_FAILED,
+				"Browse operation failed: %s",
+				upnp_error->message);
 		goto on_error;
 	}
 
-	MSU_LOG_DEBUG("GetChildren result: %s", result);
+	page->didl = result;
+	page->number_returned = number_returned > 0 ? number_returned : 0;
+	cb_task_data->first_page_done = TRUE;
 
-	parser = gupnp_didl_lite_parser_new();
+	prv_adapt_page_size(device, page, result ? strlen(result) : 0,
+			    g_get_monotonic_time() - page->sent);
 
-	g_signal_connect(parser, "object-available" ,
-			 G_CALLBACK(prv_found_child), cb_data);
+	if (total_matches > 0) {
+		cb_task_data->total_matches = total_matches;
+		if ((guint) total_matches < cb_task_data->end)
+			cb_task_data->end = total_matches;
+	}
 
-	cb_task_data->vbs = g_ptr_array_new_with_free_func(
-		prv_msu_device_object_builder_delete);
+	next = page->start + page->number_returned;
 
-	if (!gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error)
-		&& upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
-		MSU_LOG_WARNING("Unable to parse results of browse: %s",
-			      upnp_error->message);
+	if (!page->number_returned) {
+		if (page->start < cb_task_data->end)
+			cb_task_data->end = page->start;
+	} else if (page->number_returned < page->count &&
+		   next < cb_task_data->end) {
+		if (total_matches > 0) {
 
-		cb_data->error = g_error_new(MSU_ERROR,
-					     MSU_ERROR_OPERATION_FAILED,
-					     "Unable to parse results of "
-					     "browse: %s", upnp_error->message);
-		goto on_error;
-	}
+			/* The server returned less than we asked for
+			   although more objects remain, so it caps the
+			   size of its responses.  Fetch the rest of the
+			   page and stay below the cap from now on. */
 
-	if (cb_task_data->need_child_count) {
-		MSU_LOG_DEBUG("Need to retrieve ChildCounts");
+			MSU_LOG_DEBUG("Server caps responses at %u objects",
+				      page->number_returned);
 
-		cb_task_data->get_children_cb = prv_get_children_result;
-		prv_retrieve_child_count_for_list(cb_data);
-		goto no_complete;
-	} else {
-		prv_get_children_result(cb_data);
+			prv_learn_page_cap(device, page->number_returned);
+
+			prv_issue_page(cb_data, device, next,
+				       page->count - page->number_returned);
+		} else {
+			cb_task_data->end = next;
+		}
 	}
 
-on_error:
+	prv_schedule_pages(cb_data, device);
 
-	(void) g_idle_add(msu_async_complete_task, cb_data);
-	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
+on_error:
 
-no_complete:
+	if (!cb_task_data->pages_in_flight &&
+	    (cb_data->error ||
+	     cb_task_data->next_start >= cb_task_data->end))
+		prv_complete_pages(cb_data);
 
 	if (upnp_error)
 		g_error_free(upnp_error);
 
-	if (parser)
-		g_object_unref(parser);
+	MSU_LOG_DEBUG("Exit");
+}
 
-	g_free(result);
+static void prv_get_children_pages_cancelled(GCancellable *cancellable,
+					     gpointer user_data)
+{
+	msu_async_cb_data_t *cb_data = user_data;
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_device_page_t *page;
+	guint i;
 
-	MSU_LOG_DEBUG("Exit");
+	for (i = 0; i < cb_task_data->pages->len; ++i) {
+		page = g_ptr_array_index(cb_task_data->pages, i);
+		if (page->action) {
+			msu_limit_cancel_action(page->proxy, page->action);
+			page->action = NULL;
+		}
+	}
+
+	msu_async_task_cancelled(cancellable, cb_data);
+}
+
+static void prv_get_children_pages(msu_device_t *device,
+				   msu_task_get_children_t *task_data,
+				   msu_async_cb_data_t *cb_data,
+				   GCancellable *cancellable)
+{
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+
+	cb_task_data->pages = g_ptr_array_new_with_free_func(
+		prv_msu_device_page_delete);
+	cb_task_data->next_start = task_data->start;
+
+	if (task_data->count &&
+	    task_data->count <= G_MAXUINT - task_data->start)
+		cb_task_data->end = task_data->start + task_data->count;
+	else
+		cb_task_data->end = G_MAXUINT;
+
+	cb_data->cancel_id =
+		g_cancellable_connect(cancellable,
+				      G_CALLBACK(
+					      prv_get_children_pages_cancelled),
+				      cb_data, NULL);
+	cb_data->cancellable = cancellable;
+
+	prv_schedule_pages(cb_data, device);
 }
 
 void msu_device_get_children(msu_device_t *device,  msu_task_t *task,
@@ -603,40 +2211,101 @@ void msu_device_get_children(msu_device_t *device,  msu_task_t *task,
 			     GCancellable *cancellable)
 {
 	msu_device_context_t *context;
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_task_get_children_t *task_data = &task->ut.get_children;
+	const msu_cache_entry_t *entry;
 
 	MSU_LOG_DEBUG("Enter");
 
 	context = msu_device_get_context(device);
 
-	cb_data->action =
-		gupnp_service_proxy_begin_action(context->service_proxy,
-						 "Browse",
-						 prv_get_children_cb,
-						 cb_data,
-						 "ObjectID", G_TYPE_STRING,
-						 cb_data->id,
-
-						 "BrowseFlag", G_TYPE_STRING,
-						 "BrowseDirectChildren",
-
-						 "Filter", G_TYPE_STRING,
-						 upnp_filter,
-
-						 "StartingIndex", G_TYPE_INT,
-						 task->ut.get_children.start,
-						 "RequestedCount", G_TYPE_INT,
-						 task->ut.get_children.count,
-						 "SortCriteria", G_TYPE_STRING,
-						 sort_by,
-						 NULL);
+	prv_demand(device);
+	cb_data->versions = device->container_versions;
+	cb_data->cache = device->cache;
+
+	cb_task_data->prefetch = device->prefetch;
+	cb_task_data->generation = msu_cache_get_generation(device->cache);
+	cb_task_data->sort_by = g_strdup(sort_by);
+	cb_task_data->cache_key = msu_cache_make_key(cb_data->id, upnp_filter,
+						     cb_task_data->sort_by,
+						     task_data->start,
+						     task_data->count);
+	cb_task_data->upnp_filter = g_strdup(upnp_filter);
+	cb_task_data->vbs = g_ptr_array_new_with_free_func(
+		prv_msu_device_object_builder_delete);
+
+	if (msu_prefetch_is_enabled(device->prefetch))
+		cb_task_data->child_ids =
+			g_ptr_array_new_with_free_func(g_free);
+
+	if (task_data->progressive)
+		cb_task_data->pending_counts =
+			g_ptr_array_new_with_free_func(g_free);
+
+	cb_task_data->device = device;
+
 	cb_data->proxy = context->service_proxy;
 
+	entry = msu_cache_lookup(device->cache, cb_task_data->cache_key);
+	if (entry) {
+		MSU_LOG_DEBUG("Page found in cache");
+		MSU_TRACE_INSTANT(cb_data->task->trace_id, "cache-hit");
+
+		cb_data->cancel_id =
+			g_cancellable_connect(cancellable,
+					      G_CALLBACK(
+						      msu_async_task_cancelled),
+					      cb_data, NULL);
+		cb_data->cancellable = cancellable;
+
+		prv_process_children_result(cb_data, entry->didl,
+					    entry->number_returned,
+					    entry->total_matches, FALSE);
+		goto on_exit;
+	}
+
+	/* Large and unbounded requests are split into pages, some of
+	   which are fetched concurrently.  The pages are not cached as
+	   they do not match the request the client made. */
+
+	if (prv_use_pages(device, task_data->count)) {
+		prv_get_children_pages(device, task_data, cb_data,
+				       cancellable);
+		goto on_exit;
+	}
+
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "soap");
+	MSU_PROBE3(soap_begin, "Browse", cb_data->id, cb_data);
+	cb_data->action =
+		prv_begin_hedged_action(device, context->service_proxy,
+					"Browse",
+					prv_get_children_cb,
+					cb_data,
+					"ObjectID", G_TYPE_STRING,
+					cb_data->id,
+
+					"BrowseFlag", G_TYPE_STRING,
+					"BrowseDirectChildren",
+
+					"Filter", G_TYPE_STRING,
+					upnp_filter,
+
+					"StartingIndex", G_TYPE_INT,
+					task_data->start,
+					"RequestedCount", G_TYPE_INT,
+					task_data->count,
+					"SortCriteria", G_TYPE_STRING,
+					cb_task_data->sort_by,
+					NULL);
+
 	cb_data->cancel_id =
 		g_cancellable_connect(cancellable,
 				      G_CALLBACK(msu_async_task_cancelled),
 				      cb_data, NULL);
 	cb_data->cancellable = cancellable;
 
+on_exit:
+
 	MSU_LOG_DEBUG("Exit");
 }
 
@@ -670,7 +2339,11 @@ static void prv_get_container(GUPnPDIDLLiteParser *parser,
 					(GUPnPDIDLLiteContainer *) object,
 					0xffffffff,
 					&have_child_count);
-		if (!have_child_count)
+		prv_add_container_update_id(cb_data->versions,
+					    cb_task_data->vb, object);
+		if (!have_child_count &&
+		    !prv_add_cached_child_count(cb_data->cache,
+						cb_task_data->vb, object))
 			cb_task_data->need_child_count = TRUE;
 	} else {
 		cb_data->error = g_error_new(MSU_ERROR,
@@ -725,7 +2398,12 @@ static void prv_get_all(GUPnPDIDLLiteParser *parser,
 				(GUPnPDIDLLiteContainer *)
 				object, 0xffffffff,
 				&have_child_count);
-			if (!have_child_count)
+			prv_add_container_update_id(cb_data->versions,
+						    cb_task_data->vb, object);
+			if (!have_child_count &&
+			    !prv_add_cached_child_count(cb_data->cache,
+							cb_task_data->vb,
+							object))
 				cb_task_data->need_child_count = TRUE;
 		} else {
 			msu_props_add_item(cb_task_data->vb, object,
@@ -758,10 +2436,13 @@ static void prv_get_all_ms2spec_props_cb(GUPnPServiceProxy *proxy,
 
 	MSU_LOG_DEBUG("Enter");
 
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "Result", G_TYPE_STRING,
-					    &result, NULL)) {
+	MSU_TRACE_END(cb_data->task->trace_id, "soap");
+	MSU_PROBE2(soap_end, cb_data->id, user_data);
+
+	if (!prv_end_action(proxy, action,
+			    &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result, NULL)) {
 		MSU_LOG_WARNING("Browse operation failed: %s",
 			      upnp_error->message);
 
@@ -772,7 +2453,9 @@ static void prv_get_all_ms2spec_props_cb(GUPnPServiceProxy *proxy,
 		goto on_error;
 	}
 
-	MSU_LOG_DEBUG("GetMS2SpecProps result: %s", result);
+	MSU_LOG_DEBUG("GetMS2SpecProps filter: %s, %u bytes",
+		      cb_task_data->upnp_filter, (guint) strlen(result));
+	MSU_LOG_DEBUG_DUMP("GetMS2SpecProps result", result);
 
 	parser = gupnp_didl_lite_parser_new();
 
@@ -861,12 +2544,14 @@ static void prv_get_all_ms2spec_props(msu_device_context_t *context,
 		goto on_error;
 	}
 
-	cb_data->action = gupnp_service_proxy_begin_action(
-		context->service_proxy, "Browse",
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "soap");
+	MSU_PROBE3(soap_begin, "Browse", cb_data->id, cb_data);
+	cb_data->action = prv_begin_hedged_action(
+		context->device, context->service_proxy, "Browse",
 		prv_get_all_ms2spec_props_cb, cb_data,
 		"ObjectID", G_TYPE_STRING, cb_data->id,
 		"BrowseFlag", G_TYPE_STRING, "BrowseMetadata",
-		"Filter", G_TYPE_STRING, "*",
+		"Filter", G_TYPE_STRING, cb_task_data->upnp_filter,
 		"StartingIndex", G_TYPE_INT, 0,
 		"RequestedCount", G_TYPE_INT, 0,
 		"SortCriteria", G_TYPE_STRING,
@@ -907,13 +2592,16 @@ void msu_device_get_all_props(msu_device_t *device,  msu_task_t *task,
 	context = msu_device_get_context(device);
 	cb_task_data = &cb_data->ut.get_all;
 
+	prv_demand(device);
+	cb_data->versions = device->container_versions;
+	cb_data->cache = device->cache;
+
 	cb_task_data->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
 
 	if (!strcmp(task_data->interface_name, MSU_INTERFACE_MEDIA_DEVICE)) {
 		if (root_object) {
-			msu_props_add_device(
-				(GUPnPDeviceInfo *) context->device_proxy,
-				cb_task_data->vb);
+			prv_add_device_props(device, context,
+					     cb_task_data->vb);
 
 			cb_data->result =
 				g_variant_ref_sink(g_variant_builder_end(
@@ -932,9 +2620,8 @@ void msu_device_get_all_props(msu_device_t *device,  msu_task_t *task,
 		prv_get_all_ms2spec_props(context, cancellable, cb_data);
 	} else {
 		if (root_object)
-			msu_props_add_device(
-				(GUPnPDeviceInfo *) context->device_proxy,
-				cb_task_data->vb);
+			prv_add_device_props(device, context,
+					     cb_task_data->vb);
 
 		prv_get_all_ms2spec_props(context, cancellable, cb_data);
 	}
@@ -942,6 +2629,34 @@ void msu_device_get_all_props(msu_device_t *device,  msu_task_t *task,
 	MSU_LOG_DEBUG("Exit");
 }
 
+gboolean msu_device_get_local_props(msu_device_t *device, msu_task_t *task,
+				    gboolean root_object, GError **error)
+{
+	msu_task_get_props_t *task_data = &task->ut.get_props;
+	msu_device_context_t *context;
+	GVariantBuilder vb;
+	gboolean retval = FALSE;
+
+	if (strcmp(task_data->interface_name, MSU_INTERFACE_MEDIA_DEVICE))
+		goto on_exit;
+
+	if (root_object) {
+		context = msu_device_get_context(device);
+		g_variant_builder_init(&vb, G_VARIANT_TYPE("a{sv}"));
+		prv_add_device_props(device, context, &vb);
+		task->result = g_variant_ref_sink(g_variant_builder_end(&vb));
+	} else {
+		*error = g_error_new(MSU_ERROR, MSU_ERROR_UNKNOWN_INTERFACE,
+				     "Interface is only valid on root objects.");
+	}
+
+	retval = TRUE;
+
+on_exit:
+
+	return retval;
+}
+
 static void prv_get_object_property(GUPnPDIDLLiteParser *parser,
 				    GUPnPDIDLLiteObject *object,
 				    gpointer user_data)
@@ -990,6 +2705,7 @@ static void prv_get_container_property(GUPnPDIDLLiteParser *parser,
 	msu_async_cb_data_t *cb_data = user_data;
 	msu_task_t *task = cb_data->task;
 	msu_task_get_prop_t *task_data = &task->ut.get_prop;
+	gpointer value;
 
 	if (cb_data->result)
 		goto on_error;
@@ -997,6 +2713,16 @@ static void prv_get_container_property(GUPnPDIDLLiteParser *parser,
 	cb_data->result = msu_props_get_container_prop(task_data->prop_name,
 						       object);
 
+	if (!cb_data->result && cb_data->versions &&
+	    GUPNP_IS_DIDL_LITE_CONTAINER(object) &&
+	    !strcmp(task_data->prop_name,
+		    MSU_INTERFACE_PROP_CONTAINER_UPDATE_ID) &&
+	    g_hash_table_lookup_extended(cb_data->versions,
+					 gupnp_didl_lite_object_get_id(object),
+					 NULL, &value))
+		cb_data->result = g_variant_ref_sink(
+			g_variant_new_uint32(GPOINTER_TO_UINT(value)));
+
 on_error:
 
 	return;
@@ -1045,16 +2771,25 @@ static void prv_count_children_cb(GUPnPServiceProxy *proxy,
 	msu_device_count_data_t *count_data = user_data;
 	msu_async_cb_data_t *cb_data = count_data->cb_data;
 	GError *upnp_error = NULL;
+	gchar *result = NULL;
+	gint number_returned = 0;
 	gint count;
 	gboolean complete = FALSE;
 
 	MSU_LOG_DEBUG("Enter");
 
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "TotalMatches", G_TYPE_INT,
-					    &count,
-					    NULL)) {
+	MSU_TRACE_END(cb_data->task->trace_id, "soap");
+	MSU_PROBE2(soap_end, count_data->id, user_data);
+
+	if (!prv_end_action(cb_data->proxy, cb_data->action,
+			    &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &count,
+			    NULL)) {
 		MSU_LOG_WARNING("Browse operation failed: %s",
 			      upnp_error->message);
 
@@ -1065,11 +2800,17 @@ static void prv_count_children_cb(GUPnPServiceProxy *proxy,
 		goto on_error;
 	}
 
+	if (cb_data->cache)
+		prv_cache_child_count(cb_data->cache, count_data->id, result,
+				      number_returned, count,
+				      count_data->generation);
+
 	complete = count_data->cb(cb_data, count);
 
 on_error:
 
-	g_free(user_data);
+	prv_msu_device_count_data_delete(count_data);
+	g_free(result);
 
 	if (cb_data->error || complete) {
 		(void) g_idle_add(msu_async_complete_task, cb_data);
@@ -1090,29 +2831,32 @@ static void prv_get_child_count(msu_async_cb_data_t *cb_data,
 
 	MSU_LOG_DEBUG("Enter");
 
-	prv_msu_device_count_data_new(cb_data, cb, &count_data);
+	prv_msu_device_count_data_new(cb_data, cb, id, &count_data);
+
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "soap");
+	MSU_PROBE3(soap_begin, "Browse", id, count_data);
 	cb_data->action =
-		gupnp_service_proxy_begin_action(cb_data->proxy,
-						 "Browse",
-						 prv_count_children_cb,
-						 count_data,
-						 "ObjectID", G_TYPE_STRING, id,
+		prv_begin_action(cb_data->proxy,
+				 "Browse",
+				 prv_count_children_cb,
+				 count_data,
+				 "ObjectID", G_TYPE_STRING, id,
 
-						 "BrowseFlag", G_TYPE_STRING,
-						 "BrowseDirectChildren",
+				 "BrowseFlag", G_TYPE_STRING,
+				 "BrowseDirectChildren",
 
-						 "Filter", G_TYPE_STRING, "",
+				 "Filter", G_TYPE_STRING, "",
 
-						 "StartingIndex", G_TYPE_INT,
-						 0,
+				 "StartingIndex", G_TYPE_INT,
+				 0,
 
-						 "RequestedCount", G_TYPE_INT,
-						 1,
+				 "RequestedCount", G_TYPE_INT,
+				 1,
 
-						 "SortCriteria", G_TYPE_STRING,
-						 "",
+				 "SortCriteria", G_TYPE_STRING,
+				 "",
 
-						 NULL);
+				 NULL);
 
 	MSU_LOG_DEBUG("Exit with SUCCESS");
 }
@@ -1127,13 +2871,17 @@ static void prv_get_ms2spec_prop_cb(GUPnPServiceProxy *proxy,
 	msu_async_cb_data_t *cb_data = user_data;
 	msu_async_get_prop_t *cb_task_data = &cb_data->ut.get_prop;
 	msu_task_get_prop_t *task_data = &cb_data->task->ut.get_prop;
+	guint count;
 
 	MSU_LOG_DEBUG("Enter");
 
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "Result", G_TYPE_STRING,
-					    &result, NULL)) {
+	MSU_TRACE_END(cb_data->task->trace_id, "soap");
+	MSU_PROBE2(soap_end, cb_data->id, user_data);
+
+	if (!prv_end_action(proxy, action,
+			    &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result, NULL)) {
 		MSU_LOG_WARNING("Browse operation failed: %s",
 			      upnp_error->message);
 
@@ -1144,7 +2892,7 @@ static void prv_get_ms2spec_prop_cb(GUPnPServiceProxy *proxy,
 		goto on_error;
 	}
 
-	MSU_LOG_DEBUG("GetMS2SpecProp result: %s", result);
+	MSU_LOG_DEBUG_DUMP("GetMS2SpecProp result", result);
 
 	parser = gupnp_didl_lite_parser_new();
 
@@ -1189,14 +2937,23 @@ on_error:
 
 		g_error_free(cb_data->error);
 		cb_data->error = NULL;
-		prv_get_child_count(cb_data, prv_get_child_count_cb,
-				    cb_data->id);
-	} else {
-		(void) g_idle_add(msu_async_complete_task, cb_data);
-		g_cancellable_disconnect(cb_data->cancellable,
-					 cb_data->cancel_id);
+
+		if (!prv_get_cached_child_count(cb_data->cache, cb_data->id,
+						&count)) {
+			prv_get_child_count(cb_data, prv_get_child_count_cb,
+					    cb_data->id);
+			goto no_complete;
+		}
+
+		cb_data->result = g_variant_ref_sink(
+			g_variant_new_uint32(count));
 	}
 
+	(void) g_idle_add(msu_async_complete_task, cb_data);
+	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
+
+no_complete:
+
 	if (upnp_error)
 		g_error_free(upnp_error);
 
@@ -1209,13 +2966,14 @@ on_error:
 }
 
 static void prv_get_ms2spec_prop(msu_device_context_t *context,
-				 msu_prop_map_t *prop_map,
+				 const msu_prop_map_t *prop_map,
 				 msu_task_get_prop_t *task_data,
 				 GCancellable *cancellable,
 				 msu_async_cb_data_t *cb_data)
 {
 	msu_async_get_prop_t *cb_task_data;
 	const gchar *filter;
+	guint count;
 
 	MSU_LOG_DEBUG("Enter");
 
@@ -1251,8 +3009,29 @@ static void prv_get_ms2spec_prop(msu_device_context_t *context,
 		goto on_error;
 	}
 
-	cb_data->action = gupnp_service_proxy_begin_action(
-		context->service_proxy, "Browse",
+	cb_data->proxy = context->service_proxy;
+
+	/* A server known to omit childCount is not asked for it.  The
+	   count is fetched directly instead. */
+
+	if (context->device->caps.child_count == MSU_QUIRKS_UNSUPPORTED &&
+	    !strcmp(task_data->prop_name, MSU_INTERFACE_PROP_CHILD_COUNT)) {
+		if (prv_get_cached_child_count(cb_data->cache, cb_data->id,
+					       &count)) {
+			cb_data->result = g_variant_ref_sink(
+				g_variant_new_uint32(count));
+			goto on_error;
+		}
+
+		prv_get_child_count(cb_data, prv_get_child_count_cb,
+				    cb_data->id);
+		goto on_connect;
+	}
+
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "soap");
+	MSU_PROBE3(soap_begin, "Browse", cb_data->id, cb_data);
+	cb_data->action = prv_begin_hedged_action(
+		context->device, context->service_proxy, "Browse",
 		prv_get_ms2spec_prop_cb,
 		cb_data,
 		"ObjectID", G_TYPE_STRING, cb_data->id,
@@ -1265,7 +3044,7 @@ static void prv_get_ms2spec_prop(msu_device_context_t *context,
 		"",
 		NULL);
 
-	cb_data->proxy = context->service_proxy;
+on_connect:
 
 	cb_data->cancel_id =
 		g_cancellable_connect(cancellable,
@@ -1286,9 +3065,44 @@ on_error:
 	return;
 }
 
+gboolean msu_device_get_local_prop(msu_device_t *device, msu_task_t *task,
+				   gboolean root_object, GError **error)
+{
+	msu_task_get_prop_t *task_data = &task->ut.get_prop;
+	msu_device_context_t *context;
+	gboolean retval = FALSE;
+
+	context = msu_device_get_context(device);
+
+	if (!strcmp(task_data->interface_name, MSU_INTERFACE_MEDIA_DEVICE)) {
+		if (root_object) {
+			task->result = prv_get_device_prop(
+				device, context, task_data->prop_name);
+			if (!task->result)
+				*error = g_error_new(
+					MSU_ERROR,
+					MSU_ERROR_UNKNOWN_PROPERTY,
+					"Unknown property");
+		} else {
+			*error = g_error_new(MSU_ERROR,
+					     MSU_ERROR_UNKNOWN_INTERFACE,
+					     "Interface is unknown.");
+		}
+
+		retval = TRUE;
+	} else if (!strcmp(task_data->interface_name, "") && root_object) {
+		task->result = prv_get_device_prop(device, context,
+						   task_data->prop_name);
+		retval = task->result != NULL;
+	}
+
+	return retval;
+}
+
 void msu_device_get_prop(msu_device_t *device,  msu_task_t *task,
 			 msu_async_cb_data_t *cb_data,
-			 msu_prop_map_t *prop_map, gboolean root_object,
+			 const msu_prop_map_t *prop_map,
+			 gboolean root_object,
 			 GCancellable *cancellable)
 {
 	msu_task_get_prop_t *task_data = &task->ut.get_prop;
@@ -1298,13 +3112,15 @@ void msu_device_get_prop(msu_device_t *device,  msu_task_t *task,
 
 	context = msu_device_get_context(device);
 
+	prv_demand(device);
+	cb_data->versions = device->container_versions;
+	cb_data->cache = device->cache;
+
 	if (!strcmp(task_data->interface_name, MSU_INTERFACE_MEDIA_DEVICE)) {
 		if (root_object) {
 			cb_data->result =
-				msu_props_get_device_prop(
-					(GUPnPDeviceInfo *)
-					context->device_proxy,
-					task_data->prop_name);
+				prv_get_device_prop(device, context,
+						    task_data->prop_name);
 			if (!cb_data->result)
 				cb_data->error = g_error_new(
 					MSU_ERROR,
@@ -1324,10 +3140,8 @@ void msu_device_get_prop(msu_device_t *device,  msu_task_t *task,
 				     cancellable, cb_data);
 	} else {
 		if (root_object)
-			cb_data->result = msu_props_get_device_prop(
-				(GUPnPDeviceInfo *)
-				context->device_proxy,
-				task_data->prop_name);
+			cb_data->result = prv_get_device_prop(
+				device, context, task_data->prop_name);
 
 		if (cb_data->result)
 			(void) g_idle_add(msu_async_complete_task, cb_data);
@@ -1377,8 +3191,15 @@ static void prv_found_target(GUPnPDIDLLiteParser *parser,
 					cb_task_data->filter_mask,
 					&have_child_count);
 
+		if (cb_task_data->filter_mask &
+		    MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID)
+			prv_add_container_update_id(cb_data->versions,
+						    builder->vb, object);
+
 		if (!have_child_count && (cb_task_data->filter_mask &
-					  MSU_UPNP_MASK_PROP_CHILD_COUNT)) {
+					  MSU_UPNP_MASK_PROP_CHILD_COUNT) &&
+		    !prv_add_cached_child_count(cb_data->cache, builder->vb,
+						object)) {
 			builder->needs_child_count = TRUE;
 			builder->id = g_strdup(
 				gupnp_didl_lite_object_get_id(object));
@@ -1414,16 +3235,20 @@ static void prv_search_cb(GUPnPServiceProxy *proxy,
 	GError *upnp_error = NULL;
 	msu_async_cb_data_t *cb_data = user_data;
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	gboolean parsed;
 
 	MSU_LOG_DEBUG("Enter");
 
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "Result", G_TYPE_STRING,
-					    &result,
-					    "TotalMatches", G_TYPE_INT,
-					    &cb_task_data->max_count,
-					    NULL)) {
+	MSU_TRACE_END(cb_data->task->trace_id, "soap");
+	MSU_PROBE2(soap_end, cb_data->id, user_data);
+
+	if (!prv_end_action(proxy, action,
+			    &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "TotalMatches", G_TYPE_INT,
+			    &cb_task_data->max_count,
+			    NULL)) {
 
 		MSU_LOG_WARNING("Search operation failed %s",
 			      upnp_error->message);
@@ -1443,10 +3268,14 @@ static void prv_search_cb(GUPnPServiceProxy *proxy,
 	g_signal_connect(parser, "object-available" ,
 			 G_CALLBACK(prv_found_target), cb_data);
 
-	MSU_LOG_DEBUG("Server Search result: %s", result);
+	MSU_LOG_DEBUG_DUMP("Server Search result", result);
 
-	if (!gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error)
-		&& upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "parse");
+	MSU_PROBE2(didl_parse, cb_data->id, result ? strlen(result) : 0);
+	parsed = gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error);
+	MSU_TRACE_END(cb_data->task->trace_id, "parse");
+
+	if (!parsed && upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
 		MSU_LOG_WARNING("Unable to parse results of search: %s",
 			      upnp_error->message);
 
@@ -1465,6 +3294,7 @@ static void prv_search_cb(GUPnPServiceProxy *proxy,
 				prv_get_search_ex_result;
 		else
 			cb_task_data->get_children_cb = prv_get_children_result;
+		MSU_TRACE_BEGIN(cb_data->task->trace_id, "child-counts");
 		prv_retrieve_child_count_for_list(cb_data);
 		goto no_complete;
 	} else {
@@ -1503,8 +3333,30 @@ void msu_device_search(msu_device_t *device,  msu_task_t *task,
 
 	context = msu_device_get_context(device);
 
-	cb_data->action = gupnp_service_proxy_begin_action(
-		context->service_proxy, "Search",
+	prv_demand(device);
+	cb_data->versions = device->container_versions;
+	cb_data->cache = device->cache;
+
+	/* An empty list of search capabilities means that the server does
+	   not implement Search at all. */
+
+	if (device->caps.search_caps && !*device->caps.search_caps) {
+		MSU_LOG_WARNING("Server does not support Search");
+
+		cb_data->error = g_error_new(MSU_ERROR,
+					     MSU_ERROR_OPERATION_FAILED,
+					     "Search is not supported by the "
+					     "server");
+
+		/* The caller completes the task, as no action was sent. */
+
+		goto on_exit;
+	}
+
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "soap");
+	MSU_PROBE3(soap_begin, "Search", cb_data->id, cb_data);
+	cb_data->action = prv_begin_hedged_action(
+		device, context->service_proxy, "Search",
 		prv_search_cb,
 		cb_data,
 		"ContainerID", G_TYPE_STRING, cb_data->id,
@@ -1523,6 +3375,497 @@ void msu_device_search(msu_device_t *device,  msu_task_t *task,
 				      cb_data, NULL);
 	cb_data->cancellable = cancellable;
 
+on_exit:
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+static void prv_msu_device_tree_node_delete(gpointer node)
+{
+	msu_device_tree_node_t *n = node;
+
+	if (n) {
+		g_free(n->id);
+		g_free(n);
+	}
+}
+
+static void prv_msu_device_tree_request_delete(gpointer request)
+{
+	msu_device_tree_request_t *r = request;
+
+	if (r) {
+		if (r->action)
+			msu_limit_cancel_action(r->proxy, r->action);
+
+		if (r->proxy)
+			g_object_unref(r->proxy);
+
+		g_free(r->id);
+		g_free(r->parent_path);
+		g_free(r);
+	}
+}
+
+static void prv_tree_add_container(msu_async_tree_t *cb_task_data,
+				   const gchar *id, guint depth)
+{
+	msu_device_tree_node_t *node;
+
+	node = g_new0(msu_device_tree_node_t, 1);
+	node->id = g_strdup(id);
+	node->depth = depth;
+	g_ptr_array_add(cb_task_data->containers, node);
+}
+
+static void prv_tree_emit_chunk(msu_async_cb_data_t *cb_data)
+{
+	msu_async_tree_t *cb_task_data = &cb_data->ut.tree;
+	guint pending;
+
+	if (!cb_task_data->chunk_len)
+		return;
+
+	pending = cb_task_data->containers->len -
+		cb_task_data->next_container + cb_task_data->requests->len;
+
+	(void) g_dbus_connection_emit_signal(cb_task_data->device->connection,
+			cb_task_data->client,
+			cb_data->task->path,
+			MSU_INTERFACE_MEDIA_CONTAINER,
+			MSU_INTERFACE_TREE_OBJECTS,
+			g_variant_new("(@aa{sv}uu)",
+				      g_variant_builder_end(
+					      cb_task_data->chunk),
+				      cb_task_data->found, pending),
+			NULL);
+
+	g_variant_builder_unref(cb_task_data->chunk);
+	cb_task_data->chunk = g_variant_builder_new(
+		G_VARIANT_TYPE("aa{sv}"));
+	cb_task_data->chunk_len = 0;
+}
+
+static void prv_tree_found_object(GUPnPDIDLLiteParser *parser,
+				  GUPnPDIDLLiteObject *object,
+				  gpointer user_data)
+{
+	msu_device_tree_request_t *request = user_data;
+	msu_async_cb_data_t *cb_data = request->cb_data;
+	msu_async_tree_t *cb_task_data = &cb_data->ut.tree;
+	msu_task_list_tree_t *task_data = &cb_data->task->ut.list_tree;
+	GVariantBuilder *vb;
+	gboolean have_child_count;
+	gboolean container;
+
+	if (task_data->max && cb_task_data->found >= task_data->max)
+		goto on_exit;
+
+	vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+
+	if (!msu_props_add_object(vb, object, cb_task_data->root_path,
+				  request->parent_path,
+				  cb_task_data->filter_mask)) {
+		g_variant_builder_unref(vb);
+		goto on_exit;
+	}
+
+	container = GUPNP_IS_DIDL_LITE_CONTAINER(object);
+
+	if (container) {
+		msu_props_add_container(vb, (GUPnPDIDLLiteContainer *) object,
+					cb_task_data->filter_mask,
+					&have_child_count);
+
+		if (cb_task_data->filter_mask &
+		    MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID)
+			prv_add_container_update_id(cb_data->versions, vb,
+						    object);
+
+		if (!have_child_count && (cb_task_data->filter_mask &
+					  MSU_UPNP_MASK_PROP_CHILD_COUNT))
+			(void) prv_add_cached_child_count(cb_data->cache, vb,
+							  object);
+
+		if (!task_data->depth || request->depth < task_data->depth)
+			prv_tree_add_container(
+				cb_task_data,
+				gupnp_didl_lite_object_get_id(object),
+				request->depth + 1);
+	} else {
+		msu_props_add_item(vb, object, cb_task_data->filter_mask,
+				   cb_task_data->protocol_info);
+	}
+
+	g_variant_builder_add(cb_task_data->chunk, "@a{sv}",
+			      g_variant_builder_end(vb));
+	g_variant_builder_unref(vb);
+
+	cb_task_data->found++;
+	if (++cb_task_data->chunk_len >= MSU_DEVICE_TREE_CHUNK)
+		prv_tree_emit_chunk(cb_data);
+
+on_exit:
+
+	return;
+}
+
+static void prv_list_tree_cb(GUPnPServiceProxy *proxy,
+			     GUPnPServiceProxyAction *action,
+			     gpointer user_data);
+
+static void prv_issue_tree_request(msu_async_cb_data_t *cb_data,
+				   const gchar *id, guint depth, guint start)
+{
+	msu_async_tree_t *cb_task_data = &cb_data->ut.tree;
+	msu_device_t *device = cb_task_data->device;
+	msu_device_tree_request_t *request;
+
+	request = g_new0(msu_device_tree_request_t, 1);
+	request->cb_data = cb_data;
+	request->id = g_strdup(id);
+	request->parent_path = msu_path_from_id(cb_task_data->root_path, id);
+	request->depth = depth;
+	request->start = start;
+	request->count = device->browse_page_size ? device->browse_page_size :
+		MSU_DEVICE_TREE_PAGE;
+
+	MSU_LOG_DEBUG("Tree browse %u+%u of %s", start, request->count, id);
+
+	request->action = prv_begin_background_browse(
+		device, id, cb_task_data->upnp_filter, "", start,
+		request->count, prv_list_tree_cb, request, &request->proxy);
+
+	g_ptr_array_add(cb_task_data->requests, request);
+}
+
+static void prv_schedule_tree(msu_async_cb_data_t *cb_data)
+{
+	msu_async_tree_t *cb_task_data = &cb_data->ut.tree;
+	msu_task_list_tree_t *task_data = &cb_data->task->ut.list_tree;
+	guint max_actions = MAX(cb_task_data->device->browse_max_actions, 1);
+	msu_device_tree_node_t *node;
+
+	if (cb_task_data->finished)
+		return;
+
+	if (task_data->max && cb_task_data->found >= task_data->max)
+		g_ptr_array_set_size(cb_task_data->requests, 0);
+
+	while (!cb_data->error && cb_task_data->requests->len < max_actions &&
+	       (!cb_task_data->requests->len ||
+		msu_limit_available(cb_task_data->device->limit)) &&
+	       cb_task_data->next_container < cb_task_data->containers->len &&
+	       (!task_data->max || cb_task_data->found < task_data->max)) {
+		node = g_ptr_array_index(cb_task_data->containers,
+					 cb_task_data->next_container++);
+		prv_issue_tree_request(cb_data, node->id, node->depth, 0);
+	}
+
+	if (cb_task_data->requests->len)
+		return;
+
+	MSU_LOG_DEBUG("Tree of %s complete: %u objects in %u containers",
+		      cb_data->id, cb_task_data->found,
+		      cb_task_data->next_container);
+
+	prv_tree_emit_chunk(cb_data);
+
+	cb_task_data->finished = TRUE;
+	if (!cb_data->error)
+		cb_data->result = g_variant_ref_sink(
+			g_variant_new_uint32(cb_task_data->found));
+
+	(void) g_idle_add(msu_async_complete_task, cb_data);
+	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
+}
+
+static void prv_list_tree_cb(GUPnPServiceProxy *proxy,
+			     GUPnPServiceProxyAction *action,
+			     gpointer user_data)
+{
+	msu_device_tree_request_t *request = user_data;
+	msu_async_cb_data_t *cb_data = request->cb_data;
+	msu_async_tree_t *cb_task_data = &cb_data->ut.tree;
+	GUPnPDIDLLiteParser *parser = NULL;
+	GError *upnp_error = NULL;
+	gchar *result = NULL;
+	gint number_returned = 0;
+	gint total_matches = 0;
+	gboolean done;
+
+	MSU_LOG_DEBUG("Enter");
+
+	MSU_PROBE2(soap_end, request->id, user_data);
+
+	request->action = NULL;
+
+	if (!prv_end_action(proxy, action, &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &total_matches,
+			    NULL)) {
+		MSU_LOG_WARNING("Tree browse of %s failed: %s", request->id,
+				upnp_error->message);
+
+		/* Only a failure to list the container the client asked
+		   for is fatal.  Containers below it that cannot be
+		   listed are skipped. */
+
+		if (!strcmp(request->id, cb_data->id) && !request->start)
+			cb_data->error = g_error_new(
+				MSU_ERROR, MSU_ERROR_OPERATION_FAILED,
+				"Browse operation failed: %s",
+				upnp_error->message);
+		goto on_exit;
+	}
+
+	parser = gupnp_didl_lite_parser_new();
+	g_signal_connect(parser, "object-available" ,
+			 G_CALLBACK(prv_tree_found_object), request);
+
+	if (!gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error)
+	    && upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
+		MSU_LOG_WARNING("Unable to parse tree results of %s: %s",
+				request->id, upnp_error->message);
+		goto on_exit;
+	}
+
+	if (number_returned <= 0)
+		done = TRUE;
+	else if (total_matches > 0)
+		done = request->start + number_returned >=
+			(guint) total_matches;
+	else
+		done = (guint) number_returned < request->count;
+
+	/* The rest of a large container is fetched straight away, in the
+	   slot this page has just freed. */
+
+	if (!done)
+		prv_issue_tree_request(cb_data, request->id, request->depth,
+				       request->start + number_returned);
+
+on_exit:
+
+	(void) g_ptr_array_remove_fast(cb_task_data->requests, request);
+	prv_schedule_tree(cb_data);
+
+	if (upnp_error)
+		g_error_free(upnp_error);
+
+	if (parser)
+		g_object_unref(parser);
+
+	g_free(result);
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+static void prv_list_tree_cancelled(GCancellable *cancellable,
+				    gpointer user_data)
+{
+	msu_async_cb_data_t *cb_data = user_data;
+	msu_async_tree_t *cb_task_data = &cb_data->ut.tree;
+
+	if (cb_task_data->finished)
+		return;
+
+	cb_task_data->finished = TRUE;
+	g_ptr_array_set_size(cb_task_data->requests, 0);
+
+	msu_async_task_cancelled(cancellable, cb_data);
+}
+
+void msu_device_list_tree(msu_device_t *device,  msu_task_t *task,
+			  msu_async_cb_data_t *cb_data,
+			  GCancellable *cancellable)
+{
+	msu_async_tree_t *cb_task_data = &cb_data->ut.tree;
+
+	MSU_LOG_DEBUG("Enter");
+
+	prv_demand(device);
+	cb_data->versions = device->container_versions;
+	cb_data->cache = device->cache;
+
+	cb_task_data->device = device;
+	cb_task_data->client = g_strdup(
+		g_dbus_method_invocation_get_sender(task->invocation));
+	cb_task_data->containers = g_ptr_array_new_with_free_func(
+		prv_msu_device_tree_node_delete);
+	cb_task_data->requests = g_ptr_array_new_with_free_func(
+		prv_msu_device_tree_request_delete);
+	cb_task_data->chunk = g_variant_builder_new(G_VARIANT_TYPE("aa{sv}"));
+
+	prv_tree_add_container(cb_task_data, cb_data->id, 1);
+
+	cb_data->cancel_id =
+		g_cancellable_connect(cancellable,
+				      G_CALLBACK(prv_list_tree_cancelled),
+				      cb_data, NULL);
+	cb_data->cancellable = cancellable;
+
+	prv_schedule_tree(cb_data);
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+static gchar *prv_count_key(const gchar *id, const gchar *upnp_query)
+{
+	if (!upnp_query)
+		return prv_child_count_key(id);
+
+	return msu_cache_make_key(id, "", upnp_query, 0, 1);
+}
+
+gboolean msu_device_get_local_count(msu_device_t *device, msu_task_t *task,
+				    const gchar *id, const gchar *upnp_query)
+{
+	const msu_cache_entry_t *entry;
+	gchar *key;
+	guint count;
+	gboolean retval = TRUE;
+
+	prv_demand_events(device);
+
+	key = prv_count_key(id, upnp_query);
+	entry = msu_cache_lookup(device->cache, key);
+	g_free(key);
+
+	if (entry)
+		count = entry->total_matches;
+	else if (upnp_query ||
+		 !msu_index_count_children(device->index, id, &count))
+		retval = FALSE;
+
+	if (retval) {
+		MSU_LOG_DEBUG("Count of %s answered locally: %u", id, count);
+
+		task->result = g_variant_ref_sink(g_variant_new_uint32(count));
+	}
+
+	return retval;
+}
+
+static void prv_count_cb(GUPnPServiceProxy *proxy,
+			 GUPnPServiceProxyAction *action,
+			 gpointer user_data)
+{
+	msu_async_cb_data_t *cb_data = user_data;
+	msu_async_count_t *cb_task_data = &cb_data->ut.count;
+	GError *upnp_error = NULL;
+	gchar *result = NULL;
+	gint number_returned = 0;
+	gint count = 0;
+
+	MSU_LOG_DEBUG("Enter");
+
+	MSU_TRACE_END(cb_data->task->trace_id, "soap");
+	MSU_PROBE2(soap_end, cb_data->id, user_data);
+
+	/* Only TotalMatches is of interest.  The single object returned
+	   is kept for the cache but is never parsed. */
+
+	if (!prv_end_action(proxy, action,
+			    &upnp_error,
+			    "Result", G_TYPE_STRING,
+			    &result,
+			    "NumberReturned", G_TYPE_INT,
+			    &number_returned,
+			    "TotalMatches", G_TYPE_INT,
+			    &count,
+			    NULL)) {
+		MSU_LOG_WARNING("Count operation failed: %s",
+				upnp_error->message);
+
+		cb_data->error = g_error_new(MSU_ERROR,
+					     MSU_ERROR_OPERATION_FAILED,
+					     "Count operation failed: %s",
+					     upnp_error->message);
+		goto on_error;
+	}
+
+	if (count < 0)
+		count = 0;
+
+	if (result)
+		msu_cache_insert(cb_data->cache, cb_task_data->cache_key,
+				 cb_task_data->cache_id, result,
+				 (guint) number_returned, (guint) count,
+				 FALSE, cb_task_data->generation);
+
+	cb_data->result = g_variant_ref_sink(
+		g_variant_new_uint32((guint) count));
+
+on_error:
+
+	(void) g_idle_add(msu_async_complete_task, cb_data);
+	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
+
+	if (upnp_error)
+		g_error_free(upnp_error);
+
+	g_free(result);
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+void msu_device_count(msu_device_t *device,  msu_task_t *task,
+		      msu_async_cb_data_t *cb_data, const gchar *upnp_query,
+		      GCancellable *cancellable)
+{
+	msu_async_count_t *cb_task_data = &cb_data->ut.count;
+	msu_device_context_t *context;
+
+	MSU_LOG_DEBUG("Enter");
+
+	context = msu_device_get_context(device);
+
+	prv_demand(device);
+	cb_data->cache = device->cache;
+	cb_task_data->cache_key = prv_count_key(cb_data->id, upnp_query);
+	cb_task_data->cache_id = upnp_query ? MSU_DEVICE_SEARCH_CACHE_ID :
+		cb_data->id;
+	cb_task_data->generation = msu_cache_get_generation(device->cache);
+
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "soap");
+	MSU_PROBE3(soap_begin, upnp_query ? "Search" : "Browse", cb_data->id,
+		   cb_data);
+	if (upnp_query)
+		cb_data->action = prv_begin_hedged_action(
+			device, context->service_proxy, "Search",
+			prv_count_cb, cb_data,
+			"ContainerID", G_TYPE_STRING, cb_data->id,
+			"SearchCriteria", G_TYPE_STRING, upnp_query,
+			"Filter", G_TYPE_STRING, "",
+			"StartingIndex", G_TYPE_INT, 0,
+			"RequestedCount", G_TYPE_INT, 1,
+			"SortCriteria", G_TYPE_STRING, "",
+			NULL);
+	else
+		cb_data->action = prv_begin_hedged_action(
+			device, context->service_proxy, "Browse",
+			prv_count_cb, cb_data,
+			"ObjectID", G_TYPE_STRING, cb_data->id,
+			"BrowseFlag", G_TYPE_STRING, "BrowseDirectChildren",
+			"Filter", G_TYPE_STRING, "",
+			"StartingIndex", G_TYPE_INT, 0,
+			"RequestedCount", G_TYPE_INT, 1,
+			"SortCriteria", G_TYPE_STRING, "",
+			NULL);
+
+	cb_data->proxy = context->service_proxy;
+
+	cb_data->cancel_id =
+		g_cancellable_connect(cancellable,
+				      G_CALLBACK(msu_async_task_cancelled),
+				      cb_data, NULL);
+	cb_data->cancellable = cancellable;
+
 	MSU_LOG_DEBUG("Exit");
 }
 
@@ -1553,11 +3896,15 @@ void msu_device_get_resource(msu_device_t *device,  msu_task_t *task,
 	context = msu_device_get_context(device);
 	cb_task_data = &cb_data->ut.get_all;
 
+	prv_demand(device);
+
 	cb_task_data->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
 	cb_task_data->prop_func = G_CALLBACK(prv_get_resource);
 
-	cb_data->action = gupnp_service_proxy_begin_action(
-		context->service_proxy, "Browse",
+	MSU_TRACE_BEGIN(cb_data->task->trace_id, "soap");
+	MSU_PROBE3(soap_begin, "Browse", cb_data->id, cb_data);
+	cb_data->action = prv_begin_hedged_action(
+		device, context->service_proxy, "Browse",
 		prv_get_all_ms2spec_props_cb, cb_data,
 		"ObjectID", G_TYPE_STRING, cb_data->id,
 		"BrowseFlag", G_TYPE_STRING, "BrowseMetadata",
@@ -1577,3 +3924,25 @@ void msu_device_get_resource(msu_device_t *device,  msu_task_t *task,
 
 	MSU_LOG_DEBUG("Exit");
 }
+
+void msu_device_watch(msu_device_t *device, const gchar *path,
+		      const gchar *id, const gchar *client)
+{
+	MSU_LOG_DEBUG("Client %s watching %s", client, path);
+
+	prv_demand_events(device);
+	msu_watch_add(device->watch, device->path, path, id, client);
+}
+
+gboolean msu_device_unwatch(msu_device_t *device, const gchar *id,
+			    const gchar *client)
+{
+	MSU_LOG_DEBUG("Client %s no longer watching %s", client, id);
+
+	return msu_watch_remove(device->watch, id, client);
+}
+
+void msu_device_unwatch_client(msu_device_t *device, const gchar *client)
+{
+	msu_watch_remove_client(device->watch, client);
+}
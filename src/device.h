@@ -26,17 +26,35 @@
 #include <libgupnp/gupnp-control-point.h>
 
 #include "async.h"
+#include "cache.h"
+#include "index.h"
+#include "limit.h"
+#include "prefetch.h"
 #include "props.h"
+#include "quirks.h"
+#include "settings.h"
+#include "watch.h"
 
 typedef struct msu_device_t_ msu_device_t;
 
+enum msu_device_subscription_t_ {
+	MSU_DEVICE_SUBSCRIPTION_IDLE,
+	MSU_DEVICE_SUBSCRIPTION_PENDING,
+	MSU_DEVICE_SUBSCRIPTION_ACTIVE,
+	MSU_DEVICE_SUBSCRIPTION_BACKOFF,
+	MSU_DEVICE_SUBSCRIPTION_FAILED
+};
+typedef enum msu_device_subscription_t_ msu_device_subscription_t;
+
 typedef struct msu_device_context_t_ msu_device_context_t;
 struct msu_device_context_t_ {
 	gchar *ip_address;
 	GUPnPDeviceProxy *device_proxy;
 	GUPnPServiceProxy *service_proxy;
 	msu_device_t *device;
-	gboolean subscribed;
+	msu_device_subscription_t subscription;
+	guint retries;
+	gboolean notifying;
 	guint timeout_id;
 };
 
@@ -45,7 +63,32 @@ struct msu_device_t_ {
 	guint id;
 	gchar *path;
 	GPtrArray *contexts;
+	msu_limit_t *limit;
 	guint timeout_id;
+	guint lost_timeout_id;
+	gboolean events_wanted;
+	guint event_idle_timeout;
+	gint64 events_last_used;
+	guint events_timeout_id;
+	guint event_retry_limit;
+	guint event_lost_cache_ttl;
+	msu_cache_t *cache;
+	msu_prefetch_t *prefetch;
+	msu_index_t *index;
+	msu_watch_t *watch;
+	GHashTable *container_versions;
+	gboolean container_events;
+	guint browse_page_size;
+	guint browse_page_cap;
+	guint page_cap_candidate;
+	guint page_cap_repeats;
+	guint browse_max_actions;
+	GPtrArray *count_jobs;
+	msu_quirks_t *quirks;
+	msu_quirks_record_t caps;
+	GUPnPServiceProxy *caps_proxy;
+	GUPnPServiceProxyAction *caps_action;
+	guint caps_query;
 };
 
 void msu_device_append_new_context(msu_device_t *device,
@@ -57,8 +100,13 @@ gboolean msu_device_new(GDBusConnection *connection,
 			const gchar *ip_address,
 			const GDBusSubtreeVTable *vtable,
 			void *user_data,
+			msu_settings_context_t *settings,
+			msu_quirks_t *quirks,
 			guint counter,
 			msu_device_t **device);
+void msu_device_configure(msu_device_t *device,
+			  msu_settings_context_t *settings);
+guint msu_device_get_rate_wait(msu_device_t *device);
 msu_device_t *msu_device_from_path(const gchar *path, GHashTable *device_list);
 msu_device_context_t *msu_device_get_context(msu_device_t *device);
 void msu_device_get_children(msu_device_t *device,  msu_task_t *task,
@@ -71,16 +119,34 @@ void msu_device_get_all_props(msu_device_t *device,  msu_task_t *task,
 			      GCancellable *cancellable);
 void msu_device_get_prop(msu_device_t *device,  msu_task_t *task,
 			 msu_async_cb_data_t *cb_data,
-			 msu_prop_map_t *prop_map, gboolean root_object,
+			 const msu_prop_map_t *prop_map,
+			 gboolean root_object,
 			 GCancellable *cancellable);
+gboolean msu_device_get_local_props(msu_device_t *device, msu_task_t *task,
+				    gboolean root_object, GError **error);
+gboolean msu_device_get_local_prop(msu_device_t *device, msu_task_t *task,
+				   gboolean root_object, GError **error);
 void msu_device_search(msu_device_t *device,  msu_task_t *task,
 		       msu_async_cb_data_t *cb_data, const gchar *upnp_filter,
 		       const gchar *upnp_query, const gchar *sort_by,
 		       GCancellable *cancellable);
+void msu_device_list_tree(msu_device_t *device,  msu_task_t *task,
+			  msu_async_cb_data_t *cb_data,
+			  GCancellable *cancellable);
+gboolean msu_device_get_local_count(msu_device_t *device, msu_task_t *task,
+				    const gchar *id, const gchar *upnp_query);
+void msu_device_count(msu_device_t *device,  msu_task_t *task,
+		      msu_async_cb_data_t *cb_data, const gchar *upnp_query,
+		      GCancellable *cancellable);
 void msu_device_get_resource(msu_device_t *device,  msu_task_t *task,
 			     msu_async_cb_data_t *cb_data,
 			     const gchar *upnp_filter,
 			     GCancellable *cancellable);
 void msu_device_subscribe_to_contents_change(msu_device_t *device);
+void msu_device_watch(msu_device_t *device, const gchar *path,
+		      const gchar *id, const gchar *client);
+gboolean msu_device_unwatch(msu_device_t *device, const gchar *id,
+			    const gchar *client);
+void msu_device_unwatch_client(msu_device_t *device, const gchar *client);
 
 #endif
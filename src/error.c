@@ -37,6 +37,7 @@ static const GDBusErrorEntry g_error_entries[] = {
 	{ MSU_ERROR_DEVICE_NOT_FOUND, MSU_SERVICE".DeviceNotFound" },
 	{ MSU_ERROR_DIED, MSU_SERVICE".Died" },
 	{ MSU_ERROR_CANCELLED, MSU_SERVICE".Cancelled" },
+	{ MSU_ERROR_BUSY, MSU_SERVICE".Busy" },
 };
 
 GQuark msu_error_quark(void)
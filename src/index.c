@@ -0,0 +1,865 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#include <string.h>
+#include <libgupnp/gupnp-error.h>
+#include <libgupnp-av/gupnp-av.h>
+
+#include "index.h"
+#include "log.h"
+
+#define MSU_INDEX_ROOT_ID "0"
+#define MSU_INDEX_NO_ROW G_MAXUINT32
+#define MSU_INDEX_COMPACT_MIN 256
+
+#define MSU_INDEX_FLAG_CONTAINER	(1 << 0)
+#define MSU_INDEX_FLAG_CRAWLED		(1 << 1)
+#define MSU_INDEX_FLAG_STALE		(1 << 2)
+#define MSU_INDEX_FLAG_REMOVED		(1 << 3)
+
+/*
+ * Each object occupies one row of a set of parallel columns.  String
+ * columns hold indices into a pool of interned strings so that values
+ * shared by many objects, such as classes, artists, albums and genres,
+ * are stored only once.
+ *
+ * The children of each container are also linked together through the
+ * sibling columns so that a container's children can be visited without
+ * scanning the whole index.
+ */
+
+enum msu_index_column_t_ {
+	MSU_INDEX_COL_ID,
+	MSU_INDEX_COL_PARENT,
+	MSU_INDEX_COL_FIRST_CHILD,
+	MSU_INDEX_COL_NEXT_SIBLING,
+	MSU_INDEX_COL_PREV_SIBLING,
+	MSU_INDEX_COL_CLASS,
+	MSU_INDEX_COL_TITLE,
+	MSU_INDEX_COL_ARTIST,
+	MSU_INDEX_COL_ALBUM,
+	MSU_INDEX_COL_GENRE,
+	MSU_INDEX_COL_DATE,
+	MSU_INDEX_COL_DURATION,
+	MSU_INDEX_COL_SIZE,
+	MSU_INDEX_COL_FLAGS,
+	MSU_INDEX_COL_MAX
+};
+typedef enum msu_index_column_t_ msu_index_column_t;
+
+static const guint g_index_column_size[MSU_INDEX_COL_MAX] = {
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(guint32),
+	sizeof(gint32),
+	sizeof(gint64),
+	sizeof(guint8)
+};
+
+#define MSU_INDEX_U32(index, col, row) \
+	g_array_index((index)->cols[(col)], guint32, (row))
+#define MSU_INDEX_FLAGS(index, row) \
+	g_array_index((index)->cols[MSU_INDEX_COL_FLAGS], guint8, (row))
+
+struct msu_index_t_ {
+	msu_limit_t *limit;
+	msu_index_dispatch_t dispatch;
+	void *user_data;
+	gboolean enabled;
+	guint interval;
+	guint page_size;
+
+	GStringChunk *chunk;
+	GHashTable *strings;
+	GPtrArray *pool;
+	gsize string_bytes;
+	GArray *cols[MSU_INDEX_COL_MAX];
+	GHashTable *rows;
+	guint removed;
+	guint crawled;
+
+	GQueue pending;
+	GHashTable *pending_set;
+	gchar *current;
+	guint current_row;
+	guint start;
+	gboolean restart;
+	msu_index_request_t *request;
+	guint timeout_id;
+	guint failed;
+};
+
+static guint32 prv_index_intern(msu_index_t *index, const gchar *str)
+{
+	gpointer value;
+	gchar *interned;
+	guint32 retval = 0;
+
+	if (!str || !*str)
+		goto on_exit;
+
+	value = g_hash_table_lookup(index->strings, str);
+
+	if (value) {
+		retval = GPOINTER_TO_UINT(value) - 1;
+	} else {
+		interned = g_string_chunk_insert(index->chunk, str);
+		retval = index->pool->len;
+		g_ptr_array_add(index->pool, interned);
+		g_hash_table_insert(index->strings, interned,
+				    GUINT_TO_POINTER(retval + 1));
+		index->string_bytes += strlen(str) + 1;
+	}
+
+on_exit:
+
+	return retval;
+}
+
+static guint prv_index_lookup_row(msu_index_t *index, const gchar *id)
+{
+	gpointer value;
+	guint retval = MSU_INDEX_NO_ROW;
+
+	value = g_hash_table_lookup(index->strings, id);
+	if (!value)
+		goto on_exit;
+
+	value = g_hash_table_lookup(index->rows,
+				    GUINT_TO_POINTER(GPOINTER_TO_UINT(value)
+						     - 1));
+	if (value)
+		retval = GPOINTER_TO_UINT(value) - 1;
+
+on_exit:
+
+	return retval;
+}
+
+static void prv_index_link_row(msu_index_t *index, guint row, guint parent)
+{
+	guint32 next;
+
+	MSU_INDEX_U32(index, MSU_INDEX_COL_PARENT, row) = parent;
+	MSU_INDEX_U32(index, MSU_INDEX_COL_PREV_SIBLING, row) =
+		MSU_INDEX_NO_ROW;
+
+	if (parent == MSU_INDEX_NO_ROW) {
+		MSU_INDEX_U32(index, MSU_INDEX_COL_NEXT_SIBLING, row) =
+			MSU_INDEX_NO_ROW;
+		goto on_exit;
+	}
+
+	next = MSU_INDEX_U32(index, MSU_INDEX_COL_FIRST_CHILD, parent);
+	MSU_INDEX_U32(index, MSU_INDEX_COL_NEXT_SIBLING, row) = next;
+	if (next != MSU_INDEX_NO_ROW)
+		MSU_INDEX_U32(index, MSU_INDEX_COL_PREV_SIBLING, next) = row;
+	MSU_INDEX_U32(index, MSU_INDEX_COL_FIRST_CHILD, parent) = row;
+
+on_exit:
+
+	return;
+}
+
+static void prv_index_unlink_row(msu_index_t *index, guint row)
+{
+	guint32 parent = MSU_INDEX_U32(index, MSU_INDEX_COL_PARENT, row);
+	guint32 next = MSU_INDEX_U32(index, MSU_INDEX_COL_NEXT_SIBLING, row);
+	guint32 prev = MSU_INDEX_U32(index, MSU_INDEX_COL_PREV_SIBLING, row);
+
+	if (parent == MSU_INDEX_NO_ROW)
+		goto on_exit;
+
+	if (prev != MSU_INDEX_NO_ROW)
+		MSU_INDEX_U32(index, MSU_INDEX_COL_NEXT_SIBLING, prev) = next;
+	else
+		MSU_INDEX_U32(index, MSU_INDEX_COL_FIRST_CHILD, parent) = next;
+
+	if (next != MSU_INDEX_NO_ROW)
+		MSU_INDEX_U32(index, MSU_INDEX_COL_PREV_SIBLING, next) = prev;
+
+	MSU_INDEX_U32(index, MSU_INDEX_COL_NEXT_SIBLING, row) =
+		MSU_INDEX_NO_ROW;
+	MSU_INDEX_U32(index, MSU_INDEX_COL_PREV_SIBLING, row) =
+		MSU_INDEX_NO_ROW;
+
+on_exit:
+
+	return;
+}
+
+static guint prv_index_append_row(msu_index_t *index, const gchar *id,
+				  guint parent)
+{
+	guint row = index->cols[MSU_INDEX_COL_ID]->len;
+	guint32 id_idx;
+	guint i;
+
+	for (i = 0; i < MSU_INDEX_COL_MAX; ++i)
+		g_array_set_size(index->cols[i], row + 1);
+
+	id_idx = prv_index_intern(index, id);
+	MSU_INDEX_U32(index, MSU_INDEX_COL_ID, row) = id_idx;
+	MSU_INDEX_U32(index, MSU_INDEX_COL_FIRST_CHILD, row) =
+		MSU_INDEX_NO_ROW;
+	prv_index_link_row(index, row, parent);
+	g_array_index(index->cols[MSU_INDEX_COL_DURATION], gint32, row) = -1;
+	g_array_index(index->cols[MSU_INDEX_COL_SIZE], gint64, row) = -1;
+
+	g_hash_table_insert(index->rows, GUINT_TO_POINTER(id_idx),
+			    GUINT_TO_POINTER(row + 1));
+
+	return row;
+}
+
+static void prv_index_init_data(msu_index_t *index)
+{
+	guint i;
+	guint row;
+
+	index->chunk = g_string_chunk_new(4096);
+	index->strings = g_hash_table_new(g_str_hash, g_str_equal);
+	index->pool = g_ptr_array_new();
+	index->rows = g_hash_table_new(g_direct_hash, g_direct_equal);
+	index->string_bytes = 0;
+	index->removed = 0;
+	index->crawled = 0;
+	index->failed = 0;
+
+	for (i = 0; i < MSU_INDEX_COL_MAX; ++i)
+		index->cols[i] = g_array_new(FALSE, TRUE,
+					     g_index_column_size[i]);
+
+	/* Pool index 0 is reserved for missing values. */
+
+	g_ptr_array_add(index->pool, "");
+
+	row = prv_index_append_row(index, MSU_INDEX_ROOT_ID, MSU_INDEX_NO_ROW);
+	MSU_INDEX_FLAGS(index, row) = MSU_INDEX_FLAG_CONTAINER;
+}
+
+static void prv_index_free_data(msu_index_t *index)
+{
+	guint i;
+
+	for (i = 0; i < MSU_INDEX_COL_MAX; ++i)
+		g_array_unref(index->cols[i]);
+
+	g_hash_table_unref(index->rows);
+	g_ptr_array_unref(index->pool);
+	g_hash_table_unref(index->strings);
+	g_string_chunk_free(index->chunk);
+}
+
+static void prv_index_request_delete(msu_index_request_t *request)
+{
+	if (request) {
+		if (request->proxy)
+			g_object_unref(request->proxy);
+
+		g_free(request->id);
+		g_free(request);
+	}
+}
+
+static void prv_index_stop(msu_index_t *index)
+{
+	gchar *id;
+
+	if (index->request) {
+		msu_limit_cancel_action(index->request->proxy,
+					index->request->action);
+		prv_index_request_delete(index->request);
+		index->request = NULL;
+	}
+
+	if (index->timeout_id) {
+		(void) g_source_remove(index->timeout_id);
+		index->timeout_id = 0;
+	}
+
+	g_hash_table_remove_all(index->pending_set);
+
+	while ((id = g_queue_pop_head(&index->pending)))
+		g_free(id);
+
+	g_free(index->current);
+	index->current = NULL;
+}
+
+static void prv_index_queue(msu_index_t *index, const gchar *id)
+{
+	gchar *pending_id;
+
+	if ((index->current && !strcmp(index->current, id)) ||
+	    g_hash_table_lookup(index->pending_set, id))
+		goto on_exit;
+
+	pending_id = g_strdup(id);
+	g_queue_push_tail(&index->pending, pending_id);
+	g_hash_table_insert(index->pending_set, pending_id, pending_id);
+
+on_exit:
+
+	return;
+}
+
+static void prv_index_mark_children_stale(msu_index_t *index, guint row)
+{
+	guint32 i;
+
+	for (i = MSU_INDEX_U32(index, MSU_INDEX_COL_FIRST_CHILD, row);
+	     i != MSU_INDEX_NO_ROW;
+	     i = MSU_INDEX_U32(index, MSU_INDEX_COL_NEXT_SIBLING, i))
+		MSU_INDEX_FLAGS(index, i) |= MSU_INDEX_FLAG_STALE;
+}
+
+static void prv_index_remove_row(msu_index_t *index, guint row)
+{
+	guint8 *flags = &MSU_INDEX_FLAGS(index, row);
+
+	if (*flags & MSU_INDEX_FLAG_CRAWLED)
+		index->crawled--;
+
+	*flags = MSU_INDEX_FLAG_REMOVED;
+	index->removed++;
+
+	(void) g_hash_table_remove(index->rows, GUINT_TO_POINTER(
+				MSU_INDEX_U32(index, MSU_INDEX_COL_ID, row)));
+}
+
+static void prv_index_remove_tree(msu_index_t *index, guint row)
+{
+	GArray *stack;
+	guint32 child;
+
+	/* Everything below a removed container goes with it.  The rows
+	   are unlinked from their parents as they are removed so that no
+	   live row is left pointing at a removed one. */
+
+	prv_index_unlink_row(index, row);
+
+	stack = g_array_new(FALSE, FALSE, sizeof(guint32));
+	g_array_append_val(stack, row);
+
+	while (stack->len > 0) {
+		row = g_array_index(stack, guint32, stack->len - 1);
+		g_array_set_size(stack, stack->len - 1);
+
+		if (MSU_INDEX_FLAGS(index, row) & MSU_INDEX_FLAG_REMOVED)
+			continue;
+
+		prv_index_remove_row(index, row);
+
+		while ((child = MSU_INDEX_U32(index, MSU_INDEX_COL_FIRST_CHILD,
+					      row)) != MSU_INDEX_NO_ROW) {
+			prv_index_unlink_row(index, child);
+			g_array_append_val(stack, child);
+		}
+	}
+
+	g_array_unref(stack);
+}
+
+static void prv_index_compact(msu_index_t *index)
+{
+	guint len = index->cols[MSU_INDEX_COL_ID]->len;
+	guint32 *remap;
+	guint32 link;
+	guint live = 0;
+	guint size;
+	guint i;
+	guint c;
+
+	MSU_LOG_DEBUG("Compacting index: %u rows, %u removed", len,
+		      index->removed);
+
+	remap = g_new(guint32, len);
+
+	for (i = 0; i < len; ++i)
+		remap[i] = (MSU_INDEX_FLAGS(index, i) & MSU_INDEX_FLAG_REMOVED)
+			? MSU_INDEX_NO_ROW : live++;
+
+	for (c = 0; c < MSU_INDEX_COL_MAX; ++c) {
+		size = g_index_column_size[c];
+
+		for (i = 0; i < len; ++i)
+			if (remap[i] != MSU_INDEX_NO_ROW && remap[i] != i)
+				memcpy(index->cols[c]->data + remap[i] * size,
+				       index->cols[c]->data + i * size, size);
+
+		g_array_set_size(index->cols[c], live);
+	}
+
+	g_hash_table_remove_all(index->rows);
+
+	for (i = 0; i < live; ++i) {
+		for (c = MSU_INDEX_COL_PARENT; c <= MSU_INDEX_COL_PREV_SIBLING;
+		     ++c) {
+			link = MSU_INDEX_U32(index, c, i);
+			if (link != MSU_INDEX_NO_ROW)
+				MSU_INDEX_U32(index, c, i) = remap[link];
+		}
+
+		g_hash_table_insert(index->rows, GUINT_TO_POINTER(
+					    MSU_INDEX_U32(index,
+							  MSU_INDEX_COL_ID, i)),
+				    GUINT_TO_POINTER(i + 1));
+	}
+
+	index->removed = 0;
+
+	g_free(remap);
+}
+
+static void prv_index_sweep(msu_index_t *index, guint row, gboolean remove)
+{
+	guint32 i;
+	guint32 next;
+
+	/* Children that were not seen again when the container was
+	   re-browsed have been deleted from the server, together with
+	   everything below them. */
+
+	for (i = MSU_INDEX_U32(index, MSU_INDEX_COL_FIRST_CHILD, row);
+	     i != MSU_INDEX_NO_ROW; i = next) {
+		next = MSU_INDEX_U32(index, MSU_INDEX_COL_NEXT_SIBLING, i);
+
+		if (!(MSU_INDEX_FLAGS(index, i) & MSU_INDEX_FLAG_STALE))
+			continue;
+
+		if (remove)
+			prv_index_remove_tree(index, i);
+		else
+			MSU_INDEX_FLAGS(index, i) &= ~MSU_INDEX_FLAG_STALE;
+	}
+}
+
+static void prv_index_finish_container(msu_index_t *index, gboolean success)
+{
+	guint8 *flags = &MSU_INDEX_FLAGS(index, index->current_row);
+
+	prv_index_sweep(index, index->current_row, success);
+
+	if (success && !(*flags & MSU_INDEX_FLAG_CRAWLED)) {
+		*flags |= MSU_INDEX_FLAG_CRAWLED;
+		index->crawled++;
+	}
+
+	g_free(index->current);
+	index->current = NULL;
+
+	if (index->removed > MSU_INDEX_COMPACT_MIN &&
+	    index->removed > index->cols[MSU_INDEX_COL_ID]->len / 4)
+		prv_index_compact(index);
+}
+
+static gboolean prv_index_next_container(msu_index_t *index)
+{
+	gchar *id;
+	guint row = MSU_INDEX_NO_ROW;
+
+	while (row == MSU_INDEX_NO_ROW) {
+		id = g_queue_pop_head(&index->pending);
+		if (!id)
+			break;
+
+		(void) g_hash_table_remove(index->pending_set, id);
+
+		row = prv_index_lookup_row(index, id);
+		if (row == MSU_INDEX_NO_ROW) {
+			g_free(id);
+		} else {
+			index->current = id;
+			index->current_row = row;
+			index->start = 0;
+			index->restart = (MSU_INDEX_FLAGS(index, row) &
+					  MSU_INDEX_FLAG_CRAWLED) != 0;
+		}
+	}
+
+	return row != MSU_INDEX_NO_ROW;
+}
+
+static gboolean prv_index_timeout_cb(gpointer user_data)
+{
+	msu_index_t *index = user_data;
+	msu_index_request_t *request;
+
+	index->timeout_id = 0;
+
+	/* The index is background work.  It waits for the server to have
+	   room for another action rather than competing with clients. */
+
+	if (!msu_limit_available(index->limit)) {
+		index->timeout_id = g_timeout_add(index->interval,
+						  prv_index_timeout_cb, index);
+		goto on_exit;
+	}
+
+	if (!index->current && !prv_index_next_container(index))
+		goto on_exit;
+
+	if (index->restart) {
+		prv_index_mark_children_stale(index, index->current_row);
+		index->start = 0;
+		index->restart = FALSE;
+	}
+
+	request = g_new0(msu_index_request_t, 1);
+	request->index = index;
+	request->id = g_strdup(index->current);
+	request->start = index->start;
+	request->count = index->page_size;
+	index->request = request;
+
+	MSU_LOG_DEBUG("Indexing %s start %u count %u", request->id,
+		      request->start, request->count);
+
+	index->dispatch(request, index->user_data);
+
+on_exit:
+
+	return FALSE;
+}
+
+static void prv_index_schedule(msu_index_t *index)
+{
+	if (index->enabled && !index->request && !index->timeout_id &&
+	    (index->current || index->pending.length > 0))
+		index->timeout_id = g_timeout_add(index->interval,
+						  prv_index_timeout_cb, index);
+}
+
+static void prv_index_found_object(GUPnPDIDLLiteParser *parser,
+				   GUPnPDIDLLiteObject *object,
+				   gpointer user_data)
+{
+	msu_index_t *index = user_data;
+	const gchar *id;
+	GList *resources;
+	GUPnPDIDLLiteResource *res;
+	gint32 duration = -1;
+	gint64 size = -1;
+	gboolean container;
+	guint8 *flags;
+	guint row;
+
+	id = gupnp_didl_lite_object_get_id(object);
+	if (!id || !*id)
+		goto on_exit;
+
+	row = prv_index_lookup_row(index, id);
+	if (row == index->current_row)
+		goto on_exit;
+
+	if (row == MSU_INDEX_NO_ROW) {
+		row = prv_index_append_row(index, id, index->current_row);
+	} else if (MSU_INDEX_U32(index, MSU_INDEX_COL_PARENT, row) !=
+		   index->current_row) {
+		prv_index_unlink_row(index, row);
+		prv_index_link_row(index, row, index->current_row);
+	}
+
+	resources = gupnp_didl_lite_object_get_resources(object);
+	if (resources) {
+		res = resources->data;
+		duration = (gint32) gupnp_didl_lite_resource_get_duration(res);
+		size = gupnp_didl_lite_resource_get_size64(res);
+		g_list_free_full(resources, g_object_unref);
+	}
+
+	MSU_INDEX_U32(index, MSU_INDEX_COL_CLASS, row) =
+		prv_index_intern(index,
+				 gupnp_didl_lite_object_get_upnp_class(object));
+	MSU_INDEX_U32(index, MSU_INDEX_COL_TITLE, row) =
+		prv_index_intern(index,
+				 gupnp_didl_lite_object_get_title(object));
+	MSU_INDEX_U32(index, MSU_INDEX_COL_ARTIST, row) =
+		prv_index_intern(index,
+				 gupnp_didl_lite_object_get_artist(object));
+	MSU_INDEX_U32(index, MSU_INDEX_COL_ALBUM, row) =
+		prv_index_intern(index,
+				 gupnp_didl_lite_object_get_album(object));
+	MSU_INDEX_U32(index, MSU_INDEX_COL_GENRE, row) =
+		prv_index_intern(index,
+				 gupnp_didl_lite_object_get_genre(object));
+	MSU_INDEX_U32(index, MSU_INDEX_COL_DATE, row) =
+		prv_index_intern(index,
+				 gupnp_didl_lite_object_get_date(object));
+	g_array_index(index->cols[MSU_INDEX_COL_DURATION], gint32, row) =
+		duration;
+	g_array_index(index->cols[MSU_INDEX_COL_SIZE], gint64, row) = size;
+
+	container = GUPNP_IS_DIDL_LITE_CONTAINER(object);
+
+	flags = &MSU_INDEX_FLAGS(index, row);
+	*flags &= ~MSU_INDEX_FLAG_STALE;
+	if (container)
+		*flags |= MSU_INDEX_FLAG_CONTAINER;
+
+	if (container && !(*flags & MSU_INDEX_FLAG_CRAWLED))
+		prv_index_queue(index, id);
+
+on_exit:
+
+	return;
+}
+
+void msu_index_new(msu_limit_t *limit, msu_index_dispatch_t dispatch,
+		   void *user_data, msu_index_t **index)
+{
+	msu_index_t *i = g_new0(msu_index_t, 1);
+
+	i->limit = limit;
+	i->dispatch = dispatch;
+	i->user_data = user_data;
+	i->pending_set = g_hash_table_new(g_str_hash, g_str_equal);
+	g_queue_init(&i->pending);
+	prv_index_init_data(i);
+
+	*index = i;
+}
+
+void msu_index_delete(msu_index_t *index)
+{
+	if (index) {
+		prv_index_stop(index);
+		prv_index_free_data(index);
+		g_hash_table_unref(index->pending_set);
+		g_free(index);
+	}
+}
+
+void msu_index_configure(msu_index_t *index, gboolean enabled,
+			 guint interval, guint page_size)
+{
+	enabled = enabled && page_size > 0;
+
+	index->interval = interval;
+	index->page_size = page_size;
+
+	if (enabled && !index->enabled) {
+		index->enabled = TRUE;
+		prv_index_queue(index, MSU_INDEX_ROOT_ID);
+		prv_index_schedule(index);
+	} else if (!enabled && index->enabled) {
+		index->enabled = FALSE;
+		prv_index_stop(index);
+		prv_index_free_data(index);
+		prv_index_init_data(index);
+	}
+}
+
+gboolean msu_index_is_enabled(msu_index_t *index)
+{
+	return index->enabled;
+}
+
+void msu_index_demand(msu_index_t *index)
+{
+	/* A client is waiting on this server.  Push the next crawl request
+	   back by a full interval so that it does not compete. */
+
+	if (index->timeout_id) {
+		(void) g_source_remove(index->timeout_id);
+		index->timeout_id = 0;
+		prv_index_schedule(index);
+	}
+}
+
+void msu_index_invalidate_id(msu_index_t *index, const gchar *id)
+{
+	guint row;
+
+	if (!index->enabled)
+		goto on_exit;
+
+	if (index->current && !strcmp(index->current, id)) {
+		index->restart = TRUE;
+	} else {
+		row = prv_index_lookup_row(index, id);
+		if (row != MSU_INDEX_NO_ROW &&
+		    (MSU_INDEX_FLAGS(index, row) & MSU_INDEX_FLAG_CRAWLED))
+			prv_index_queue(index, id);
+	}
+
+	prv_index_schedule(index);
+
+on_exit:
+
+	return;
+}
+
+gboolean msu_index_count_children(msu_index_t *index, const gchar *id,
+				  guint *count)
+{
+	gboolean retval = FALSE;
+	guint row;
+	guint32 i;
+
+	/* Only containers that have been crawled completely, and that are
+	   not waiting to be crawled again, have an accurate set of
+	   children in the index. */
+
+	if (!index->enabled)
+		goto on_exit;
+
+	row = prv_index_lookup_row(index, id);
+	if (row == MSU_INDEX_NO_ROW ||
+	    !(MSU_INDEX_FLAGS(index, row) & MSU_INDEX_FLAG_CRAWLED) ||
+	    (index->current && !strcmp(index->current, id)) ||
+	    g_hash_table_lookup(index->pending_set, id))
+		goto on_exit;
+
+	*count = 0;
+	for (i = MSU_INDEX_U32(index, MSU_INDEX_COL_FIRST_CHILD, row);
+	     i != MSU_INDEX_NO_ROW;
+	     i = MSU_INDEX_U32(index, MSU_INDEX_COL_NEXT_SIBLING, i))
+		(*count)++;
+
+	retval = TRUE;
+
+on_exit:
+
+	return retval;
+}
+
+void msu_index_request_complete(msu_index_request_t *request,
+				const gchar *didl, guint number_returned,
+				guint total_matches)
+{
+	msu_index_t *index = request->index;
+	GUPnPDIDLLiteParser *parser = NULL;
+	GError *upnp_error = NULL;
+	gboolean done;
+
+	index->request = NULL;
+
+	/* The container changed while we were browsing it.  The results
+	   are discarded and the container is browsed again from the
+	   start. */
+
+	if (index->restart)
+		goto on_exit;
+
+	if (!didl) {
+		index->failed++;
+		prv_index_finish_container(index, FALSE);
+		goto on_exit;
+	}
+
+	parser = gupnp_didl_lite_parser_new();
+	g_signal_connect(parser, "object-available" ,
+			 G_CALLBACK(prv_index_found_object), index);
+
+	if (!gupnp_didl_lite_parser_parse_didl(parser, didl, &upnp_error)
+	    && upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
+		MSU_LOG_WARNING("Unable to parse index results: %s",
+				upnp_error->message);
+
+		index->failed++;
+		prv_index_finish_container(index, FALSE);
+		goto on_exit;
+	}
+
+	/* Some servers report a TotalMatches of 0 when they do not know
+	   the size of the container. */
+
+	if (number_returned == 0)
+		done = TRUE;
+	else if (total_matches)
+		done = request->start + number_returned >= total_matches;
+	else
+		done = number_returned < request->count;
+
+	if (done)
+		prv_index_finish_container(index, TRUE);
+	else
+		index->start = request->start + number_returned;
+
+on_exit:
+
+	if (upnp_error)
+		g_error_free(upnp_error);
+
+	if (parser)
+		g_object_unref(parser);
+
+	prv_index_request_delete(request);
+	prv_index_schedule(index);
+}
+
+GVariant *msu_index_get_status(msu_index_t *index)
+{
+	GVariantBuilder vb;
+	const gchar *state;
+	guint rows = index->cols[MSU_INDEX_COL_ID]->len;
+	guint pending = index->pending.length;
+	guint64 bytes;
+	gdouble progress = 0.0;
+	guint i;
+
+	if (index->current)
+		pending++;
+
+	if (!index->enabled)
+		state = "Disabled";
+	else if (pending)
+		state = "Crawling";
+	else
+		state = "Complete";
+
+	if (index->enabled)
+		progress = (gdouble) index->crawled /
+			(index->crawled + pending ? index->crawled + pending : 1);
+
+	bytes = index->string_bytes;
+	for (i = 0; i < MSU_INDEX_COL_MAX; ++i)
+		bytes += (guint64) rows * g_index_column_size[i];
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&vb, "{sv}", "State",
+			      g_variant_new_string(state));
+	g_variant_builder_add(&vb, "{sv}", "Objects",
+			      g_variant_new_uint32(rows - index->removed));
+	g_variant_builder_add(&vb, "{sv}", "ContainersIndexed",
+			      g_variant_new_uint32(index->crawled));
+	g_variant_builder_add(&vb, "{sv}", "ContainersPending",
+			      g_variant_new_uint32(pending));
+	g_variant_builder_add(&vb, "{sv}", "Progress",
+			      g_variant_new_double(progress));
+	g_variant_builder_add(&vb, "{sv}", "Failures",
+			      g_variant_new_uint32(index->failed));
+	g_variant_builder_add(&vb, "{sv}", "Bytes",
+			      g_variant_new_uint64(bytes));
+
+	return g_variant_builder_end(&vb);
+}
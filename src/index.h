@@ -0,0 +1,66 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#ifndef MSU_INDEX_H__
+#define MSU_INDEX_H__
+
+#include <libgupnp/gupnp-control-point.h>
+
+#include "limit.h"
+
+#define MSU_INDEX_UPNP_FILTER "dc:title,upnp:class,upnp:artist,upnp:album,"\
+	"upnp:genre,dc:date,res,res@size,res@duration"
+
+typedef struct msu_index_t_ msu_index_t;
+
+typedef struct msu_index_request_t_ msu_index_request_t;
+struct msu_index_request_t_ {
+	msu_index_t *index;
+	gchar *id;
+	guint start;
+	guint count;
+	GUPnPServiceProxy *proxy;
+	GUPnPServiceProxyAction *action;
+};
+
+typedef void (*msu_index_dispatch_t)(msu_index_request_t *request,
+				     void *user_data);
+
+void msu_index_new(msu_limit_t *limit, msu_index_dispatch_t dispatch,
+		   void *user_data, msu_index_t **index);
+void msu_index_delete(msu_index_t *index);
+
+void msu_index_configure(msu_index_t *index, gboolean enabled,
+			 guint interval, guint page_size);
+
+gboolean msu_index_is_enabled(msu_index_t *index);
+void msu_index_demand(msu_index_t *index);
+void msu_index_invalidate_id(msu_index_t *index, const gchar *id);
+gboolean msu_index_count_children(msu_index_t *index, const gchar *id,
+				  guint *count);
+void msu_index_request_complete(msu_index_request_t *request,
+				const gchar *didl, guint number_returned,
+				guint total_matches);
+
+GVariant *msu_index_get_status(msu_index_t *index);
+
+#endif
@@ -35,6 +35,7 @@
 
 #define MSU_INTERFACE_PROP_CHILD_COUNT "ChildCount"
 #define MSU_INTERFACE_PROP_SEARCHABLE "Searchable"
+#define MSU_INTERFACE_PROP_CONTAINER_UPDATE_ID "ContainerUpdateID"
 
 #define MSU_INTERFACE_PROP_URLS "URLs"
 #define MSU_INTERFACE_PROP_URL "URL"
@@ -70,25 +71,42 @@
 #define MSU_INTERFACE_PROP_MODEL_URL "ModelURL"
 #define MSU_INTERFACE_PROP_SERIAL_NUMBER "SerialNumber"
 #define MSU_INTERFACE_PROP_PRESENTATION_URL "PresentationURL"
+#define MSU_INTERFACE_PROP_STATISTICS "Statistics"
+#define MSU_INTERFACE_PROP_INDEX_STATUS "IndexStatus"
+#define MSU_INTERFACE_PROP_EVENT_SUBSCRIPTION "EventSubscription"
 
 #define MSU_INTERFACE_GET_VERSION "GetVersion"
 #define MSU_INTERFACE_GET_SERVERS "GetServers"
 #define MSU_INTERFACE_RELEASE "Release"
 #define MSU_INTERFACE_SET_PROTOCOL_INFO "SetProtocolInfo"
+#define MSU_INTERFACE_SET_PRIORITY_CLASS "SetPriorityClass"
+#define MSU_INTERFACE_REGISTER_VIEW "RegisterView"
+#define MSU_INTERFACE_WATCH "Watch"
+#define MSU_INTERFACE_UNWATCH "Unwatch"
+#define MSU_INTERFACE_DUMP_TRACE "DumpTrace"
+#define MSU_INTERFACE_GET_SETTINGS "GetSettings"
 
 #define MSU_INTERFACE_FOUND_SERVER "FoundServer"
 #define MSU_INTERFACE_LOST_SERVER "LostServer"
 
 #define MSU_INTERFACE_LIST_CHILDREN "ListChildren"
 #define MSU_INTERFACE_LIST_CHILDREN_EX "ListChildrenEx"
+#define MSU_INTERFACE_LIST_CHILDREN_PROGRESSIVE "ListChildrenProgressive"
+#define MSU_INTERFACE_LIST_CHILDREN_VIEW "ListChildrenView"
 #define MSU_INTERFACE_LIST_ITEMS "ListItems"
 #define MSU_INTERFACE_LIST_ITEMS_EX "ListItemsEx"
 #define MSU_INTERFACE_LIST_CONTAINERS "ListContainers"
 #define MSU_INTERFACE_LIST_CONTAINERS_EX "ListContainersEx"
 #define MSU_INTERFACE_SEARCH_OBJECTS "SearchObjects"
 #define MSU_INTERFACE_SEARCH_OBJECTS_EX "SearchObjectsEx"
+#define MSU_INTERFACE_SEARCH_OBJECTS_VIEW "SearchObjectsView"
+#define MSU_INTERFACE_COUNT_CHILDREN "CountChildren"
+#define MSU_INTERFACE_COUNT_SEARCH "CountSearch"
+#define MSU_INTERFACE_LIST_TREE "ListTree"
 
 #define MSU_INTERFACE_GET_COMPATIBLE_RESOURCE "GetCompatibleResource"
+#define MSU_INTERFACE_GET_COMPATIBLE_RESOURCE_VIEW \
+	"GetCompatibleResourceView"
 
 #define MSU_INTERFACE_GET "Get"
 #define MSU_INTERFACE_GET_ALL "GetAll"
@@ -99,23 +117,39 @@
 
 #define MSU_INTERFACE_VERSION "Version"
 #define MSU_INTERFACE_SERVERS "Servers"
+#define MSU_INTERFACE_SETTINGS "Settings"
 
 #define MSU_INTERFACE_CRITERIA "Criteria"
 #define MSU_INTERFACE_DICT "Dictionary"
 #define MSU_INTERFACE_PATH "Path"
 #define MSU_INTERFACE_QUERY "Query"
 #define MSU_INTERFACE_PROTOCOL_INFO "ProtocolInfo"
+#define MSU_INTERFACE_PRIORITY_CLASS "PriorityClass"
+#define MSU_INTERFACE_CONTAINER "Container"
+#define MSU_INTERFACE_VIEW "View"
 
 #define MSU_INTERFACE_OFFSET "Offset"
 #define MSU_INTERFACE_MAX "Max"
 #define MSU_INTERFACE_FILTER "Filter"
 #define MSU_INTERFACE_CHILDREN "Children"
+#define MSU_INTERFACE_CHILD_COUNTS "ChildCounts"
 #define MSU_INTERFACE_SORT_BY "SortBy"
 #define MSU_INTERFACE_TOTAL_ITEMS "TotalItems"
+#define MSU_INTERFACE_COUNT "Count"
+#define MSU_INTERFACE_DEPTH "Depth"
+#define MSU_INTERFACE_OBJECTS "Objects"
+#define MSU_INTERFACE_FOUND "Found"
+#define MSU_INTERFACE_PENDING "Pending"
 
 #define MSU_INTERFACE_SYSTEM_UPDATE "SystemUpdate"
 #define MSU_INTERFACE_SYSTEM_UPDATE_ID "SystemUpdateId"
 #define MSU_INTERFACE_CONTAINER_UPDATE "ContainerUpdate"
 #define MSU_INTERFACE_CONTAINER_PATHS "ContainerPaths"
+#define MSU_INTERFACE_CHILD_COUNTS_AVAILABLE "ChildCountsAvailable"
+#define MSU_INTERFACE_CHILDREN_CHANGED "ChildrenChanged"
+#define MSU_INTERFACE_TREE_OBJECTS "TreeObjects"
+#define MSU_INTERFACE_ADDED "Added"
+#define MSU_INTERFACE_REMOVED "Removed"
+#define MSU_INTERFACE_MODIFIED "Modified"
 
 #endif
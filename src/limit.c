@@ -0,0 +1,522 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libgupnp/gupnp-error.h>
+
+#include "limit.h"
+#include "log.h"
+
+#define MSU_LIMIT_KEY "msu-limit"
+
+/* A response that takes more than twice as long as the fastest seen
+   recently, plus some slack for scheduling noise on fast networks, is
+   taken as a sign that the server is queueing our requests. */
+
+#define MSU_LIMIT_LATENCY_FACTOR 2
+#define MSU_LIMIT_LATENCY_SLACK 20000
+
+#define MSU_LIMIT_SAMPLES 64
+#define MSU_LIMIT_HEDGE_MIN_SAMPLES 20
+#define MSU_LIMIT_HEDGE_BURST 2.0
+
+typedef struct msu_limit_hedge_t_ msu_limit_hedge_t;
+struct msu_limit_hedge_t_ {
+	msu_limit_t *limit;
+	gchar *action_name;
+	GList *names;
+	GList *values;
+	GUPnPServiceProxyActionCallback callback;
+	gpointer user_data;
+	GUPnPServiceProxy *proxy[2];
+	GUPnPServiceProxyAction *action[2];
+	guint timeout_id;
+};
+
+struct msu_limit_t_ {
+	gint ref_count;
+	GHashTable *actions;
+	GHashTable *hedges;
+	guint hedge_percent;
+	gdouble hedge_credit;
+	gint64 samples[MSU_LIMIT_SAMPLES];
+	guint n_samples;
+	guint next_sample;
+	guint floor;
+	guint ceiling;
+	gdouble limit;
+	gint64 latency;
+	gint64 min_latency;
+	gint64 last_decrease;
+	guint completed;
+	guint errors;
+	guint decreases;
+	guint hedges_sent;
+	guint hedges_won;
+	gdouble rate;
+	gdouble burst;
+	gdouble tokens;
+	gint64 refilled;
+};
+
+static void prv_limit_hedge_settle(msu_limit_hedge_t *hedge,
+				   GUPnPServiceProxyAction *winner);
+
+void msu_limit_new(guint floor, guint ceiling, msu_limit_t **limit)
+{
+	msu_limit_t *l = g_new0(msu_limit_t, 1);
+
+	l->ref_count = 1;
+	l->actions = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					   NULL, g_free);
+	l->hedges = g_hash_table_new(g_direct_hash, g_direct_equal);
+	l->floor = MAX(floor, 1);
+	l->ceiling = MAX(ceiling, l->floor);
+	l->limit = MIN(MAX(2, l->floor), l->ceiling);
+
+	*limit = l;
+}
+
+msu_limit_t *msu_limit_ref(msu_limit_t *limit)
+{
+	g_atomic_int_inc(&limit->ref_count);
+
+	return limit;
+}
+
+void msu_limit_unref(msu_limit_t *limit)
+{
+	if (limit && g_atomic_int_dec_and_test(&limit->ref_count)) {
+		g_hash_table_unref(limit->hedges);
+		g_hash_table_unref(limit->actions);
+		g_free(limit);
+	}
+}
+
+static void prv_limit_unref(gpointer limit)
+{
+	msu_limit_unref(limit);
+}
+
+void msu_limit_attach(msu_limit_t *limit, GUPnPServiceProxy *proxy)
+{
+	/* Actions are cancelled from modules that know nothing about the
+	   device that issued them, so the limiter travels with the proxy. */
+
+	g_object_set_data_full(G_OBJECT(proxy), MSU_LIMIT_KEY,
+			       msu_limit_ref(limit), prv_limit_unref);
+}
+
+static void prv_limit_refill(msu_limit_t *limit)
+{
+	gint64 now = g_get_monotonic_time();
+
+	limit->tokens = MIN(limit->tokens + (now - limit->refilled) *
+			    limit->rate / G_USEC_PER_SEC, limit->burst);
+	limit->refilled = now;
+}
+
+void msu_limit_action_begun(GUPnPServiceProxy *proxy,
+			    GUPnPServiceProxyAction *action)
+{
+	msu_limit_t *limit;
+	gint64 *start;
+
+	limit = g_object_get_data(G_OBJECT(proxy), MSU_LIMIT_KEY);
+	if (!limit || !action)
+		return;
+
+	start = g_new(gint64, 1);
+	*start = g_get_monotonic_time();
+	g_hash_table_insert(limit->actions, action, start);
+
+	/* Actions issued on behalf of a waiting client are never delayed.
+	   They may take the bucket into debt, up to one burst, which the
+	   background work then has to wait out. */
+
+	if (limit->rate > 0) {
+		prv_limit_refill(limit);
+		limit->tokens = MAX(limit->tokens - 1.0, -limit->burst);
+	}
+}
+
+static gboolean prv_limit_is_congestion(const GError *error)
+{
+	/* Transport failures and generic action failures are what an
+	   overloaded server produces.  Errors such as No such object say
+	   nothing about load. */
+
+	return error->domain == GUPNP_SERVER_ERROR ||
+		(error->domain == GUPNP_CONTROL_ERROR &&
+		 error->code == GUPNP_CONTROL_ERROR_ACTION_FAILED);
+}
+
+static void prv_limit_decrease(msu_limit_t *limit, gint64 now,
+			       gdouble factor)
+{
+	/* Only back off once per round trip.  The other responses that
+	   were in flight reflect the same overload. */
+
+	if (now - limit->last_decrease < limit->latency)
+		return;
+
+	limit->limit = MAX(limit->limit * factor, (gdouble) limit->floor);
+	limit->last_decrease = now;
+	limit->decreases++;
+
+	MSU_LOG_DEBUG("Action limit decreased to %u", (guint) limit->limit);
+}
+
+void msu_limit_action_done(GUPnPServiceProxy *proxy,
+			   GUPnPServiceProxyAction *action,
+			   const GError *error)
+{
+	msu_limit_t *limit;
+	msu_limit_hedge_t *hedge;
+	gint64 *start;
+	gint64 now;
+	gint64 sample;
+	guint in_flight;
+
+	limit = g_object_get_data(G_OBJECT(proxy), MSU_LIMIT_KEY);
+	if (!limit)
+		goto on_exit;
+
+	hedge = g_hash_table_lookup(limit->hedges, action);
+	if (hedge)
+		prv_limit_hedge_settle(hedge, action);
+
+	start = g_hash_table_lookup(limit->actions, action);
+	if (!start)
+		goto on_exit;
+
+	in_flight = g_hash_table_size(limit->actions);
+	now = g_get_monotonic_time();
+	sample = now - *start;
+	(void) g_hash_table_remove(limit->actions, action);
+
+	limit->completed++;
+
+	if (error && prv_limit_is_congestion(error)) {
+		limit->errors++;
+		prv_limit_decrease(limit, now, 0.5);
+		goto on_exit;
+	}
+
+	limit->latency = limit->latency ?
+		(7 * limit->latency + sample) / 8 : sample;
+
+	limit->samples[limit->next_sample] = sample;
+	limit->next_sample = (limit->next_sample + 1) % MSU_LIMIT_SAMPLES;
+	if (limit->n_samples < MSU_LIMIT_SAMPLES)
+		limit->n_samples++;
+
+	/* The baseline creeps up slowly so that a server that has become
+	   permanently slower is not treated as overloaded for ever. */
+
+	if (!limit->min_latency || sample < limit->min_latency)
+		limit->min_latency = sample;
+	else
+		limit->min_latency += limit->min_latency / 256;
+
+	if (sample > limit->min_latency * MSU_LIMIT_LATENCY_FACTOR +
+	    MSU_LIMIT_LATENCY_SLACK)
+		prv_limit_decrease(limit, now, 0.75);
+	else if (in_flight >= (guint) limit->limit)
+		limit->limit = MIN(limit->limit + 1.0 / limit->limit,
+				   (gdouble) limit->ceiling);
+
+on_exit:
+
+	return;
+}
+
+void msu_limit_cancel_action(GUPnPServiceProxy *proxy,
+			     GUPnPServiceProxyAction *action)
+{
+	msu_limit_t *limit;
+	msu_limit_hedge_t *hedge;
+
+	limit = g_object_get_data(G_OBJECT(proxy), MSU_LIMIT_KEY);
+	if (!limit)
+		goto on_cancel;
+
+	/* Both copies of a hedged action go when the client cancels. */
+
+	hedge = g_hash_table_lookup(limit->hedges, action);
+	if (hedge) {
+		prv_limit_hedge_settle(hedge, NULL);
+		goto on_exit;
+	}
+
+	(void) g_hash_table_remove(limit->actions, action);
+
+on_cancel:
+
+	gupnp_service_proxy_cancel_action(proxy, action);
+
+on_exit:
+
+	return;
+}
+
+static gint prv_limit_sample_compare(const void *a, const void *b)
+{
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static gint64 prv_limit_p95(msu_limit_t *limit)
+{
+	gint64 sorted[MSU_LIMIT_SAMPLES];
+
+	memcpy(sorted, limit->samples, limit->n_samples * sizeof(gint64));
+	qsort(sorted, limit->n_samples, sizeof(gint64),
+	      prv_limit_sample_compare);
+
+	return sorted[limit->n_samples * 95 / 100];
+}
+
+static void prv_limit_free_values(GList *values)
+{
+	GList *link;
+
+	for (link = values; link; link = link->next) {
+		g_value_unset(link->data);
+		g_free(link->data);
+	}
+
+	g_list_free(values);
+}
+
+static void prv_limit_hedge_delete(msu_limit_hedge_t *hedge)
+{
+	guint i;
+
+	if (hedge->timeout_id)
+		(void) g_source_remove(hedge->timeout_id);
+
+	for (i = 0; i < 2; ++i)
+		if (hedge->proxy[i])
+			g_object_unref(hedge->proxy[i]);
+
+	g_free(hedge->action_name);
+	g_list_free(hedge->names);
+	prv_limit_free_values(hedge->values);
+	g_free(hedge);
+}
+
+static void prv_limit_hedge_settle(msu_limit_hedge_t *hedge,
+				   GUPnPServiceProxyAction *winner)
+{
+	msu_limit_t *limit = hedge->limit;
+	guint i;
+
+	/* Whichever copy answers first is used and the other one is
+	   cancelled.  With no winner, the client gave up and both go. */
+
+	if (winner && winner == hedge->action[1])
+		limit->hedges_won++;
+
+	for (i = 0; i < 2; ++i) {
+		if (!hedge->action[i])
+			continue;
+
+		(void) g_hash_table_remove(limit->hedges, hedge->action[i]);
+
+		if (hedge->action[i] != winner) {
+			(void) g_hash_table_remove(limit->actions,
+						   hedge->action[i]);
+			gupnp_service_proxy_cancel_action(hedge->proxy[i],
+							  hedge->action[i]);
+		}
+	}
+
+	prv_limit_hedge_delete(hedge);
+}
+
+static gboolean prv_limit_hedge_cb(gpointer user_data)
+{
+	msu_limit_hedge_t *hedge = user_data;
+	msu_limit_t *limit = hedge->limit;
+
+	hedge->timeout_id = 0;
+
+	/* A hedge is extra load.  It is not sent to a server that is
+	   already at its limit, nor beyond the configured share of
+	   traffic. */
+
+	if (limit->hedge_credit < 1.0 || !msu_limit_available(limit))
+		goto on_exit;
+
+	MSU_LOG_DEBUG("Hedging %s", hedge->action_name);
+
+	limit->hedge_credit -= 1.0;
+	limit->hedges_sent++;
+
+	hedge->action[1] = gupnp_service_proxy_begin_action_list(
+		hedge->proxy[1], hedge->action_name, hedge->names,
+		hedge->values, hedge->callback, hedge->user_data);
+	msu_limit_action_begun(hedge->proxy[1], hedge->action[1]);
+	g_hash_table_insert(limit->hedges, hedge->action[1], hedge);
+
+on_exit:
+
+	return FALSE;
+}
+
+void msu_limit_hedge(GUPnPServiceProxy *proxy,
+		     GUPnPServiceProxyAction *action,
+		     GUPnPServiceProxy *alternate,
+		     const gchar *action_name, GList *names, GList *values,
+		     GUPnPServiceProxyActionCallback callback,
+		     gpointer user_data)
+{
+	msu_limit_t *limit;
+	msu_limit_hedge_t *hedge;
+	gint64 delay;
+
+	limit = g_object_get_data(G_OBJECT(proxy), MSU_LIMIT_KEY);
+	if (!limit || !action || !alternate || !limit->hedge_percent)
+		goto on_error;
+
+	limit->hedge_credit = MIN(limit->hedge_credit +
+				  limit->hedge_percent / 100.0,
+				  MSU_LIMIT_HEDGE_BURST);
+
+	if (limit->n_samples < MSU_LIMIT_HEDGE_MIN_SAMPLES)
+		goto on_error;
+
+	/* Only the slowest responses are hedged: those that have not
+	   arrived by the time 95% of recent ones had. */
+
+	delay = prv_limit_p95(limit);
+
+	hedge = g_new0(msu_limit_hedge_t, 1);
+	hedge->limit = limit;
+	hedge->action_name = g_strdup(action_name);
+	hedge->names = names;
+	hedge->values = values;
+	hedge->callback = callback;
+	hedge->user_data = user_data;
+	hedge->proxy[0] = g_object_ref(proxy);
+	hedge->proxy[1] = g_object_ref(alternate);
+	hedge->action[0] = action;
+	hedge->timeout_id = g_timeout_add(MAX(delay / 1000, 1),
+					  prv_limit_hedge_cb, hedge);
+
+	g_hash_table_insert(limit->hedges, action, hedge);
+
+	return;
+
+on_error:
+
+	g_list_free(names);
+	prv_limit_free_values(values);
+}
+
+void msu_limit_set_bounds(msu_limit_t *limit, guint floor, guint ceiling)
+{
+	/* The current limit is kept where possible so that what has been
+	   learned about the server survives a configuration reload. */
+
+	limit->floor = MAX(floor, 1);
+	limit->ceiling = MAX(ceiling, limit->floor);
+	limit->limit = CLAMP(limit->limit, (gdouble) limit->floor,
+			     (gdouble) limit->ceiling);
+}
+
+void msu_limit_set_hedge_percent(msu_limit_t *limit, guint percent)
+{
+	limit->hedge_percent = MIN(percent, 100);
+}
+
+void msu_limit_set_rate(msu_limit_t *limit, guint rate, guint burst)
+{
+	if (rate == (guint) limit->rate && MAX(burst, 1) == (guint) limit->burst)
+		return;
+
+	MSU_LOG_DEBUG("Action rate %u/s, burst %u", rate, burst);
+
+	limit->rate = rate;
+	limit->burst = MAX(burst, 1);
+	limit->tokens = limit->burst;
+	limit->refilled = g_get_monotonic_time();
+}
+
+guint msu_limit_get_wait(msu_limit_t *limit)
+{
+	guint wait = 0;
+
+	if (limit->rate <= 0)
+		goto on_exit;
+
+	prv_limit_refill(limit);
+
+	if (limit->tokens < 1.0)
+		wait = (guint) ((1.0 - limit->tokens) * 1000 / limit->rate) + 1;
+
+on_exit:
+
+	return wait;
+}
+
+gboolean msu_limit_available(msu_limit_t *limit)
+{
+	return !msu_limit_get_wait(limit) &&
+		g_hash_table_size(limit->actions) < (guint) limit->limit;
+}
+
+void msu_limit_add_statistics(msu_limit_t *limit, GVariantBuilder *vb)
+{
+	if (limit->rate > 0)
+		prv_limit_refill(limit);
+
+	g_variant_builder_add(vb, "{sv}", "ActionLimit",
+			      g_variant_new_uint32((guint) limit->limit));
+	g_variant_builder_add(vb, "{sv}", "ActionsInFlight",
+			      g_variant_new_uint32(
+				      g_hash_table_size(limit->actions)));
+	g_variant_builder_add(vb, "{sv}", "ActionLatency",
+			      g_variant_new_uint32(limit->latency / 1000));
+	g_variant_builder_add(vb, "{sv}", "ActionLatencyMin",
+			      g_variant_new_uint32(limit->min_latency / 1000));
+	g_variant_builder_add(vb, "{sv}", "ActionsCompleted",
+			      g_variant_new_uint32(limit->completed));
+	g_variant_builder_add(vb, "{sv}", "ActionErrors",
+			      g_variant_new_uint32(limit->errors));
+	g_variant_builder_add(vb, "{sv}", "ActionLimitDecreases",
+			      g_variant_new_uint32(limit->decreases));
+	g_variant_builder_add(vb, "{sv}", "HedgesSent",
+			      g_variant_new_uint32(limit->hedges_sent));
+	g_variant_builder_add(vb, "{sv}", "HedgesWon",
+			      g_variant_new_uint32(limit->hedges_won));
+	g_variant_builder_add(vb, "{sv}", "ActionRate",
+			      g_variant_new_uint32((guint) limit->rate));
+	g_variant_builder_add(vb, "{sv}", "ActionRateBurst",
+			      g_variant_new_uint32((guint) limit->burst));
+	g_variant_builder_add(vb, "{sv}", "ActionRateTokens",
+			      g_variant_new_int32((gint) limit->tokens));
+}
@@ -0,0 +1,58 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#ifndef MSU_LIMIT_H__
+#define MSU_LIMIT_H__
+
+#include <libgupnp/gupnp-control-point.h>
+
+typedef struct msu_limit_t_ msu_limit_t;
+
+void msu_limit_new(guint floor, guint ceiling, msu_limit_t **limit);
+msu_limit_t *msu_limit_ref(msu_limit_t *limit);
+void msu_limit_unref(msu_limit_t *limit);
+
+void msu_limit_attach(msu_limit_t *limit, GUPnPServiceProxy *proxy);
+
+void msu_limit_action_begun(GUPnPServiceProxy *proxy,
+			    GUPnPServiceProxyAction *action);
+void msu_limit_action_done(GUPnPServiceProxy *proxy,
+			   GUPnPServiceProxyAction *action,
+			   const GError *error);
+void msu_limit_cancel_action(GUPnPServiceProxy *proxy,
+			     GUPnPServiceProxyAction *action);
+void msu_limit_hedge(GUPnPServiceProxy *proxy,
+		     GUPnPServiceProxyAction *action,
+		     GUPnPServiceProxy *alternate,
+		     const gchar *action_name, GList *names, GList *values,
+		     GUPnPServiceProxyActionCallback callback,
+		     gpointer user_data);
+void msu_limit_set_bounds(msu_limit_t *limit, guint floor, guint ceiling);
+void msu_limit_set_hedge_percent(msu_limit_t *limit, guint percent);
+
+void msu_limit_set_rate(msu_limit_t *limit, guint rate, guint burst);
+guint msu_limit_get_wait(msu_limit_t *limit);
+
+gboolean msu_limit_available(msu_limit_t *limit);
+void msu_limit_add_statistics(msu_limit_t *limit, GVariantBuilder *vb);
+
+#endif
@@ -22,10 +22,54 @@
 
 #define _GNU_SOURCE
 #include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
+#include <glib/gstdio.h>
+
 #include "log.h"
 
+#define MSU_LOG_FILE_NAME "media-service-upnp.log"
+
+/* Number of messages the file writer can fall behind by before new
+ * messages are dropped.  Must be a power of two.
+ */
+#define MSU_LOG_FILE_RING_SIZE 1024
+
+typedef struct msu_log_entry_t_ msu_log_entry_t;
+struct msu_log_entry_t_ {
+	gint64 time;
+	gchar *message;
+};
+
+/*
+ * Messages for the file log are formatted by the caller and handed to
+ * a writer thread through a single producer, single consumer ring.
+ * The logging macros are only used from the main loop so neither side
+ * needs a lock.  The producer never blocks: if the ring is full the
+ * message is dropped and counted.
+ *
+ * The writer sleeps on a condition while the ring is empty.  It sets
+ * sleeping before checking the ring one last time, and the producer
+ * checks sleeping after publishing a message, so at least one of them
+ * sees the other.  The mutex is only taken to go to sleep and to wake
+ * the writer up.
+ */
+
+typedef struct msu_log_file_t_ msu_log_file_t;
+struct msu_log_file_t_ {
+	FILE *file;
+	GThread *thread;
+	msu_log_entry_t ring[MSU_LOG_FILE_RING_SIZE];
+	gint head;
+	gint tail;
+	gint dropped;
+	gint quit;
+	gint sleeping;
+	GMutex mutex;
+	GCond wake;
+};
+
 typedef struct msu_log_t_ msu_log_t;
 struct msu_log_t_ {
 	int old_mask;
@@ -33,10 +77,188 @@ struct msu_log_t_ {
 	msu_log_type_t log_type;
 	GLogLevelFlags flags;
 	GLogFunc old_handler;
+	msu_log_file_t *file;
 };
 
 static msu_log_t s_log_context;
 
+GLogLevelFlags msu_log_enabled_flags;
+
+static void prv_msu_log_file_write(msu_log_file_t *log_file,
+				   msu_log_entry_t *entry)
+{
+	GDateTime *date;
+	gchar *stamp;
+
+	date = g_date_time_new_from_unix_local(entry->time / G_USEC_PER_SEC);
+	stamp = g_date_time_format(date, "%F %T");
+
+	fprintf(log_file->file, "%s.%06d %s\n", stamp,
+		(int) (entry->time % G_USEC_PER_SEC), entry->message);
+
+	g_free(stamp);
+	g_date_time_unref(date);
+}
+
+static void prv_msu_log_file_wait(msu_log_file_t *log_file, guint tail)
+{
+	g_mutex_lock(&log_file->mutex);
+
+	g_atomic_int_set(&log_file->sleeping, TRUE);
+	while (g_atomic_int_get(&log_file->sleeping) &&
+	       !g_atomic_int_get(&log_file->quit) &&
+	       (guint) g_atomic_int_get(&log_file->head) == tail)
+		g_cond_wait(&log_file->wake, &log_file->mutex);
+	g_atomic_int_set(&log_file->sleeping, FALSE);
+
+	g_mutex_unlock(&log_file->mutex);
+}
+
+static void prv_msu_log_file_wake(msu_log_file_t *log_file)
+{
+	g_mutex_lock(&log_file->mutex);
+	g_atomic_int_set(&log_file->sleeping, FALSE);
+	g_cond_signal(&log_file->wake);
+	g_mutex_unlock(&log_file->mutex);
+}
+
+static gpointer prv_msu_log_file_writer(gpointer user_data)
+{
+	msu_log_file_t *log_file = user_data;
+	msu_log_entry_t *entry;
+	guint head;
+	guint tail;
+	gint dropped;
+	gboolean quit;
+
+	tail = (guint) g_atomic_int_get(&log_file->tail);
+
+	do {
+		/* Read quit before head so that everything queued before
+		   finalisation is written out. */
+
+		quit = g_atomic_int_get(&log_file->quit);
+		head = (guint) g_atomic_int_get(&log_file->head);
+
+		while (tail != head) {
+			entry = &log_file->ring[tail &
+						(MSU_LOG_FILE_RING_SIZE - 1)];
+			prv_msu_log_file_write(log_file, entry);
+			g_free(entry->message);
+			entry->message = NULL;
+			++tail;
+			g_atomic_int_set(&log_file->tail, (gint) tail);
+		}
+
+		dropped = g_atomic_int_and(&log_file->dropped, 0);
+		if (dropped)
+			fprintf(log_file->file, "[%d messages dropped]\n",
+				dropped);
+
+		(void) fflush(log_file->file);
+
+		if (!quit)
+			prv_msu_log_file_wait(log_file, tail);
+	} while (!quit);
+
+	return NULL;
+}
+
+static void prv_msu_log_file_push(msu_log_file_t *log_file, gchar *message)
+{
+	msu_log_entry_t *entry;
+	guint head;
+	guint tail;
+
+	head = (guint) g_atomic_int_get(&log_file->head);
+	tail = (guint) g_atomic_int_get(&log_file->tail);
+
+	if (head - tail >= MSU_LOG_FILE_RING_SIZE) {
+		g_atomic_int_inc(&log_file->dropped);
+		g_free(message);
+		goto on_exit;
+	}
+
+	entry = &log_file->ring[head & (MSU_LOG_FILE_RING_SIZE - 1)];
+	entry->time = g_get_real_time();
+	entry->message = message;
+
+	g_atomic_int_set(&log_file->head, (gint) (head + 1));
+
+	if (g_atomic_int_get(&log_file->sleeping))
+		prv_msu_log_file_wake(log_file);
+
+on_exit:
+
+	return;
+}
+
+static msu_log_file_t *prv_msu_log_file_new(void)
+{
+	msu_log_file_t *log_file = NULL;
+	const gchar *dir;
+	gchar *path;
+	FILE *file;
+
+	dir = g_get_user_cache_dir();
+	(void) g_mkdir_with_parents(dir, 0700);
+	path = g_build_filename(dir, MSU_LOG_FILE_NAME, NULL);
+
+	file = g_fopen(path, "a");
+	if (!file) {
+		syslog(LOG_WARNING, "Unable to open log file %s", path);
+		goto on_error;
+	}
+
+	log_file = g_new0(msu_log_file_t, 1);
+	log_file->file = file;
+	g_mutex_init(&log_file->mutex);
+	g_cond_init(&log_file->wake);
+	log_file->thread = g_thread_new("msu-log", prv_msu_log_file_writer,
+					log_file);
+
+on_error:
+
+	g_free(path);
+
+	return log_file;
+}
+
+static void prv_msu_log_file_delete(msu_log_file_t *log_file)
+{
+	guint i;
+
+	if (log_file) {
+		g_atomic_int_set(&log_file->quit, TRUE);
+		prv_msu_log_file_wake(log_file);
+		(void) g_thread_join(log_file->thread);
+
+		for (i = 0; i < MSU_LOG_FILE_RING_SIZE; ++i)
+			g_free(log_file->ring[i].message);
+
+		g_cond_clear(&log_file->wake);
+		g_mutex_clear(&log_file->mutex);
+		(void) fclose(log_file->file);
+		g_free(log_file);
+	}
+}
+
+static void prv_msu_log_set_type(msu_log_type_t log_type)
+{
+	if (log_type == MSU_LOG_TYPE_FILE) {
+		if (!s_log_context.file)
+			s_log_context.file = prv_msu_log_file_new();
+
+		if (!s_log_context.file)
+			log_type = MSU_LOG_TYPE_SYSLOG;
+	} else if (s_log_context.file) {
+		prv_msu_log_file_delete(s_log_context.file);
+		s_log_context.file = NULL;
+	}
+
+	s_log_context.log_type = log_type;
+}
+
 static void prv_msu_log_get_mf(int log_level, int *mask, GLogLevelFlags *flags)
 {
 	*mask = 0;
@@ -85,7 +307,8 @@ static void prv_msu_log_set_flags_from_param(void)
 
 	s_log_context.mask = mask;
 	s_log_context.flags = flags;
-	s_log_context.log_type = MSU_LOG_TYPE;
+	msu_log_enabled_flags = flags;
+	prv_msu_log_set_type(MSU_LOG_TYPE);
 }
 
 void msu_log_update_type_level(msu_log_type_t log_type, int log_level)
@@ -95,7 +318,7 @@ void msu_log_update_type_level(msu_log_type_t log_type, int log_level)
 	GLogLevelFlags flags;
 	GLogLevelFlags compile_flags;
 
-	s_log_context.log_type = log_type;
+	prv_msu_log_set_type(log_type);
 
 	prv_msu_log_get_mf(log_level, &mask, &flags);
 	prv_msu_log_get_mf(MSU_LOG_LEVEL, &compile_mask, &compile_flags);
@@ -109,6 +332,7 @@ void msu_log_update_type_level(msu_log_type_t log_type, int log_level)
 
 	s_log_context.mask = mask;
 	s_log_context.flags = flags;
+	msu_log_enabled_flags = flags;
 
 	MSU_LOG_INFO("Type [%d]-Level [0x%02X] - Mask [0x%02X]-Flags [0x%02X]",
 		     log_type, log_level, mask, flags);
@@ -172,7 +396,10 @@ void msu_log_finalize(void)
 	(void) setlogmask(s_log_context.old_mask);
 	closelog();
 
+	prv_msu_log_file_delete(s_log_context.file);
+
 	memset(&s_log_context, 0, sizeof(s_log_context));
+	msu_log_enabled_flags = 0;
 }
 
 void msu_log_trace(int priority, GLogLevelFlags flags, const char *format, ...)
@@ -191,6 +418,9 @@ void msu_log_trace(int priority, GLogLevelFlags flags, const char *format, ...)
 			g_logv(G_LOG_DOMAIN, flags, format, args);
 		break;
 	case MSU_LOG_TYPE_FILE:
+		if (s_log_context.flags & flags)
+			prv_msu_log_file_push(s_log_context.file,
+					      g_strdup_vprintf(format, args));
 		break;
 	default:
 		break;
@@ -23,6 +23,7 @@
 #ifndef MSU_LOG_H__
 #define MSU_LOG_H__
 
+#include <string.h>
 #include <syslog.h>
 
 #include <glib.h>
@@ -43,18 +44,33 @@ void msu_log_update_type_level(msu_log_type_t log_type, int log_level);
 void msu_log_trace(int priority, GLogLevelFlags flags, const char *format, ...)
 			__attribute__((format(printf, 3, 4)));
 
+/* Levels enabled at run time.  Tested by the logging macros before any
+ * of their arguments are evaluated or formatted.
+ */
+extern GLogLevelFlags msu_log_enabled_flags;
+
+static inline gboolean msu_log_enabled(GLogLevelFlags flags)
+{
+	return (msu_log_enabled_flags & flags) != 0;
+}
+
 /* Generic Logging macro
  */
 #ifdef MSU_DEBUG_ENABLED
 	#define MSU_LOG_HELPER(priority, flags, fmt, ...)    \
 		do { \
-			msu_log_trace(priority, flags, "%s : %s() --- " fmt, \
-				      __FILE__, __func__, ## __VA_ARGS__); \
+			if (msu_log_enabled(flags)) \
+				msu_log_trace(priority, flags, \
+					      "%s : %s() --- " fmt, \
+					      __FILE__, __func__, \
+					      ## __VA_ARGS__); \
 		} while (0)
 #else
 	#define MSU_LOG_HELPER(priority, flags, fmt, ...) \
 		do { \
-			msu_log_trace(priority, flags, fmt, ## __VA_ARGS__); \
+			if (msu_log_enabled(flags)) \
+				msu_log_trace(priority, flags, fmt, \
+					      ## __VA_ARGS__); \
 		} while (0)
 #endif
 
@@ -124,10 +140,38 @@ void msu_log_trace(int priority, GLogLevelFlags flags, const char *format, ...)
 #if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
 	#define MSU_LOG_DEBUG_NL() \
 		do { \
-			msu_log_trace(LOG_DEBUG, G_LOG_LEVEL_DEBUG, " "); \
+			if (msu_log_enabled(G_LOG_LEVEL_DEBUG)) \
+				msu_log_trace(LOG_DEBUG, G_LOG_LEVEL_DEBUG, \
+					      " "); \
 		} while (0)
 #else
 	#define MSU_LOG_DEBUG_NL()
 #endif
 
+
+/* Logging macro for large payloads such as DIDL documents.  Only the
+ * first MSU_LOG_DUMP_MAX bytes are logged, followed by the total size.
+ */
+#define MSU_LOG_DUMP_MAX 512
+
+#if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
+	#define MSU_LOG_DEBUG_DUMP(label, data) \
+		do { \
+			const gchar *msu_dump_ = (data); \
+			gsize msu_dump_len_; \
+			if (msu_log_enabled(G_LOG_LEVEL_DEBUG) && msu_dump_) { \
+				msu_dump_len_ = strlen(msu_dump_); \
+				MSU_LOG_DEBUG("%s (%"G_GSIZE_FORMAT" bytes): " \
+					      "%.*s%s", label, msu_dump_len_, \
+					      (int) MIN(msu_dump_len_, \
+							MSU_LOG_DUMP_MAX), \
+					      msu_dump_, \
+					      msu_dump_len_ > \
+					      MSU_LOG_DUMP_MAX ? "..." : ""); \
+			} \
+		} while (0)
+#else
+	#define MSU_LOG_DEBUG_DUMP(label, data)
+#endif
+
 #endif /* MSU_LOG_H__ */
@@ -27,18 +27,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <unistd.h>
 #include <sys/signalfd.h>
 
+#include "error.h"
 #include "interface.h"
 #include "log.h"
+#include "probes.h"
 #include "settings.h"
 #include "task.h"
+#include "trace.h"
 #include "upnp.h"
 
+#define MSU_PRIORITY_CLASS_INTERACTIVE "interactive"
+#define MSU_PRIORITY_CLASS_BULK "bulk"
+
+/* Amount of virtual time consumed by each task a client executes.  Tasks
+   are dispatched in order of virtual finish time, so interactive clients
+   receive eight times the share of the task queue given to bulk clients
+   when both have work pending. */
+
+#define MSU_TASK_COST_INTERACTIVE 1
+#define MSU_TASK_COST_BULK 8
+
+enum msu_priority_class_t_ {
+	MSU_PRIORITY_INTERACTIVE,
+	MSU_PRIORITY_BULK
+};
+typedef enum msu_priority_class_t_ msu_priority_class_t;
+
 typedef struct msu_client_t_ msu_client_t;
 struct msu_client_t_ {
 	guint id;
 	gchar *protocol_info;
+	msu_priority_class_t priority_class;
+	GQueue tasks;
+	guint64 last_finish;
+	guint64 head_finish;
+	GArray *views;
+};
+
+typedef struct msu_view_t_ msu_view_t;
+struct msu_view_t_ {
+	guint32 filter_mask;
+	const gchar *upnp_filter;
 };
 
 typedef struct msu_context_t_ msu_context_t;
@@ -47,13 +79,15 @@ struct msu_context_t_ {
 	guint msu_id;
 	guint sig_id;
 	guint idle_id;
+	guint rate_id;
 	guint owner_id;
 	GDBusNodeInfo *root_node_info;
 	GDBusNodeInfo *server_node_info;
 	GMainLoop *main_loop;
 	GDBusConnection *connection;
 	gboolean quitting;
-	GPtrArray *tasks;
+	guint pending_tasks;
+	guint64 virtual_time;
 	GHashTable *watchers;
 	GCancellable *cancellable;
 	msu_task_t *current_task;
@@ -78,6 +112,32 @@ static const gchar g_msu_root_introspection[] =
 	"      <arg type='s' name='"MSU_INTERFACE_PROTOCOL_INFO"'"
 	"           direction='in'/>"
 	"    </method>"
+	"    <method name='"MSU_INTERFACE_SET_PRIORITY_CLASS"'>"
+	"      <arg type='s' name='"MSU_INTERFACE_PRIORITY_CLASS"'"
+	"           direction='in'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_REGISTER_VIEW"'>"
+	"      <arg type='as' name='"MSU_INTERFACE_FILTER"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_VIEW"'"
+	"           direction='out'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_WATCH"'>"
+	"      <arg type='o' name='"MSU_INTERFACE_CONTAINER"'"
+	"           direction='in'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_UNWATCH"'>"
+	"      <arg type='o' name='"MSU_INTERFACE_CONTAINER"'"
+	"           direction='in'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_DUMP_TRACE"'>"
+	"      <arg type='s' name='"MSU_INTERFACE_PATH"'"
+	"           direction='out'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_GET_SETTINGS"'>"
+	"      <arg type='a{sv}' name='"MSU_INTERFACE_SETTINGS"'"
+	"           direction='out'/>"
+	"    </method>"
 	"    <signal name='"MSU_INTERFACE_FOUND_SERVER"'>"
 	"      <arg type='o' name='"MSU_INTERFACE_PATH"'/>"
 	"    </signal>"
@@ -138,6 +198,30 @@ static const gchar g_msu_server_introspection[] =
 	"      <arg type='aa{sv}' name='"MSU_INTERFACE_CHILDREN"'"
 	"           direction='out'/>"
 	"    </method>"
+	"    <method name='"MSU_INTERFACE_LIST_CHILDREN_PROGRESSIVE"'>"
+	"      <arg type='u' name='"MSU_INTERFACE_OFFSET"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_MAX"'"
+	"           direction='in'/>"
+	"      <arg type='as' name='"MSU_INTERFACE_FILTER"'"
+	"           direction='in'/>"
+	"      <arg type='s' name='"MSU_INTERFACE_SORT_BY"'"
+	"           direction='in'/>"
+	"      <arg type='aa{sv}' name='"MSU_INTERFACE_CHILDREN"'"
+	"           direction='out'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_LIST_CHILDREN_VIEW"'>"
+	"      <arg type='u' name='"MSU_INTERFACE_OFFSET"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_MAX"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_VIEW"'"
+	"           direction='in'/>"
+	"      <arg type='s' name='"MSU_INTERFACE_SORT_BY"'"
+	"           direction='in'/>"
+	"      <arg type='aa{sv}' name='"MSU_INTERFACE_CHILDREN"'"
+	"           direction='out'/>"
+	"    </method>"
 	"    <method name='"MSU_INTERFACE_LIST_CONTAINERS"'>"
 	"      <arg type='u' name='"MSU_INTERFACE_OFFSET"'"
 	"           direction='in'/>"
@@ -210,10 +294,59 @@ static const gchar g_msu_server_introspection[] =
 	"      <arg type='u' name='"MSU_INTERFACE_TOTAL_ITEMS"'"
 	"           direction='out'/>"
 	"    </method>"
+	"    <method name='"MSU_INTERFACE_SEARCH_OBJECTS_VIEW"'>"
+	"      <arg type='s' name='"MSU_INTERFACE_QUERY"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_OFFSET"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_MAX"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_VIEW"'"
+	"           direction='in'/>"
+	"      <arg type='s' name='"MSU_INTERFACE_SORT_BY"'"
+	"           direction='in'/>"
+	"      <arg type='aa{sv}' name='"MSU_INTERFACE_CHILDREN"'"
+	"           direction='out'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_TOTAL_ITEMS"'"
+	"           direction='out'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_LIST_TREE"'>"
+	"      <arg type='u' name='"MSU_INTERFACE_DEPTH"'"
+	"           direction='in'/>"
+	"      <arg type='as' name='"MSU_INTERFACE_FILTER"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_MAX"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_TOTAL_ITEMS"'"
+	"           direction='out'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_COUNT_CHILDREN"'>"
+	"      <arg type='u' name='"MSU_INTERFACE_COUNT"'"
+	"           direction='out'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_COUNT_SEARCH"'>"
+	"      <arg type='s' name='"MSU_INTERFACE_QUERY"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_COUNT"'"
+	"           direction='out'/>"
+	"    </method>"
 	"    <property type='u' name='"MSU_INTERFACE_PROP_CHILD_COUNT"'"
 	"       access='read'/>"
 	"    <property type='b' name='"MSU_INTERFACE_PROP_SEARCHABLE"'"
 	"       access='read'/>"
+	"    <signal name='"MSU_INTERFACE_CHILD_COUNTS_AVAILABLE"'>"
+	"      <arg type='a{ou}' name='"MSU_INTERFACE_CHILD_COUNTS"'/>"
+	"    </signal>"
+	"    <signal name='"MSU_INTERFACE_CHILDREN_CHANGED"'>"
+	"      <arg type='ao' name='"MSU_INTERFACE_ADDED"'/>"
+	"      <arg type='ao' name='"MSU_INTERFACE_REMOVED"'/>"
+	"      <arg type='ao' name='"MSU_INTERFACE_MODIFIED"'/>"
+	"    </signal>"
+	"    <signal name='"MSU_INTERFACE_TREE_OBJECTS"'>"
+	"      <arg type='aa{sv}' name='"MSU_INTERFACE_OBJECTS"'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_FOUND"'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_PENDING"'/>"
+	"    </signal>"
 	"  </interface>"
 	"  <interface name='"MSU_INTERFACE_MEDIA_ITEM"'>"
 	"    <method name='"MSU_INTERFACE_GET_COMPATIBLE_RESOURCE"'>"
@@ -224,6 +357,14 @@ static const gchar g_msu_server_introspection[] =
 	"      <arg type='a{sv}' name='"MSU_INTERFACE_PROPERTIES_VALUE"'"
 	"           direction='out'/>"
 	"    </method>"
+	"    <method name='"MSU_INTERFACE_GET_COMPATIBLE_RESOURCE_VIEW"'>"
+	"      <arg type='s' name='"MSU_INTERFACE_PROTOCOL_INFO"'"
+	"           direction='in'/>"
+	"      <arg type='u' name='"MSU_INTERFACE_VIEW"'"
+	"           direction='in'/>"
+	"      <arg type='a{sv}' name='"MSU_INTERFACE_PROPERTIES_VALUE"'"
+	"           direction='out'/>"
+	"    </method>"
 	"    <property type='as' name='"MSU_INTERFACE_PROP_URLS"'"
 	"       access='read'/>"
 	"    <property type='s' name='"MSU_INTERFACE_PROP_MIME_TYPE"'"
@@ -288,6 +429,13 @@ static const gchar g_msu_server_introspection[] =
 	"       access='read'/>"
 	"    <property type='s' name='"MSU_INTERFACE_PROP_ICON_URL"'"
 	"       access='read'/>"
+	"    <property type='a{sv}' name='"MSU_INTERFACE_PROP_STATISTICS"'"
+	"       access='read'/>"
+	"    <property type='a{sv}' name='"MSU_INTERFACE_PROP_INDEX_STATUS"'"
+	"       access='read'/>"
+	"    <property type='s'"
+	"       name='"MSU_INTERFACE_PROP_EVENT_SUBSCRIPTION"'"
+	"       access='read'/>"
 	"    <signal name='"MSU_INTERFACE_SYSTEM_UPDATE"'>"
 	"      <arg type='u' name='"MSU_INTERFACE_SYSTEM_UPDATE_ID"'/>"
 	"    </signal>"
@@ -299,17 +447,149 @@ static const gchar g_msu_server_introspection[] =
 
 static gboolean prv_process_task(gpointer user_data);
 
-static void prv_free_msu_task_cb(gpointer data, gpointer user_data)
+static void prv_update_head_finish(msu_context_t *context,
+				   msu_client_t *client)
 {
-	msu_task_delete(data);
+	guint64 start;
+
+	if (g_queue_is_empty(&client->tasks))
+		goto on_exit;
+
+	start = MAX(context->virtual_time, client->last_finish);
+
+	if (client->priority_class == MSU_PRIORITY_BULK)
+		client->head_finish = start + MSU_TASK_COST_BULK;
+	else
+		client->head_finish = start + MSU_TASK_COST_INTERACTIVE;
+
+on_exit:
+
+	return;
 }
 
-static void prv_process_sync_task(msu_context_t *context, msu_task_t *task)
+static msu_task_t *prv_next_task(msu_context_t *context, guint *wait)
 {
-	const gchar *client_name;
+	GHashTableIter iter;
+	gpointer value;
 	msu_client_t *client;
+	msu_client_t *next = NULL;
+	msu_task_t *task = NULL;
+	guint server_wait;
 
-	context->current_task = task;
+	*wait = 0;
+	g_hash_table_iter_init(&iter, context->watchers);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		client = value;
+
+		if (g_queue_is_empty(&client->tasks))
+			continue;
+
+		/* Bulk clients wait for the server's action rate allowance
+		   to refill.  Interactive clients are allowed to run ahead
+		   of it. */
+
+		if (client->priority_class == MSU_PRIORITY_BULK) {
+			task = g_queue_peek_head(&client->tasks);
+			server_wait = msu_upnp_get_rate_wait(context->upnp,
+							     task->path);
+			task = NULL;
+
+			if (server_wait) {
+				if (!*wait || server_wait < *wait)
+					*wait = server_wait;
+				continue;
+			}
+		}
+
+		if (!next || client->head_finish < next->head_finish)
+			next = client;
+	}
+
+	if (!next)
+		goto on_exit;
+
+	*wait = 0;
+	task = g_queue_pop_head(&next->tasks);
+	context->pending_tasks--;
+
+	context->virtual_time = next->head_finish;
+	next->last_finish = next->head_finish;
+	prv_update_head_finish(context, next);
+
+on_exit:
+
+	return task;
+}
+
+static gboolean prv_set_priority_class(msu_client_t *client,
+				       const gchar *priority_class)
+{
+	gboolean retval = TRUE;
+
+	if (!strcmp(priority_class, MSU_PRIORITY_CLASS_INTERACTIVE))
+		client->priority_class = MSU_PRIORITY_INTERACTIVE;
+	else if (!strcmp(priority_class, MSU_PRIORITY_CLASS_BULK))
+		client->priority_class = MSU_PRIORITY_BULK;
+	else
+		retval = FALSE;
+
+	return retval;
+}
+
+static guint prv_register_view(msu_context_t *context, msu_client_t *client,
+			       msu_task_t *task)
+{
+	msu_view_t view;
+	msu_view_t *existing;
+	guint i;
+
+	view.filter_mask = msu_upnp_compile_filter(
+		context->upnp, task->ut.register_view.filter,
+		&view.upnp_filter);
+
+	if (!client->views)
+		client->views = g_array_new(FALSE, FALSE, sizeof(msu_view_t));
+
+	/* Filters that select the same properties share a view, so a
+	   client that registers its filters repeatedly does not make the
+	   array grow. */
+
+	for (i = 0; i < client->views->len; ++i) {
+		existing = &g_array_index(client->views, msu_view_t, i);
+		if (existing->filter_mask == view.filter_mask)
+			goto on_exit;
+	}
+
+	g_array_append_val(client->views, view);
+
+on_exit:
+
+	MSU_LOG_DEBUG("View %u has mask 0x%x", i + 1, view.filter_mask);
+
+	return i + 1;
+}
+
+static gboolean prv_resolve_view(msu_client_t *client, msu_task_t *task)
+{
+	msu_view_t *view;
+
+	if (!client->views || !task->view.id ||
+	    task->view.id > client->views->len)
+		return FALSE;
+
+	view = &g_array_index(client->views, msu_view_t, task->view.id - 1);
+	task->view.filter_mask = view->filter_mask;
+	task->view.upnp_filter = view->upnp_filter;
+
+	return TRUE;
+}
+
+static void prv_process_sync_task(msu_context_t *context,
+				  msu_client_t *client, msu_task_t *task)
+{
+	GError *error = NULL;
+	const gchar *client_name;
 
 	switch (task->type) {
 	case MSU_TASK_GET_VERSION:
@@ -320,27 +600,61 @@ static void prv_process_sync_task(msu_context_t *context, msu_task_t *task)
 		msu_task_complete_and_delete(task);
 		break;
 	case MSU_TASK_SET_PROTOCOL_INFO:
-		client_name =
-			g_dbus_method_invocation_get_sender(task->invocation);
-		client = g_hash_table_lookup(context->watchers, client_name);
-		if (client) {
-			g_free(client->protocol_info);
-			if (task->ut.protocol_info.protocol_info[0]) {
-				client->protocol_info =
-					task->ut.protocol_info.protocol_info;
-				task->ut.protocol_info.protocol_info = NULL;
-			} else {
-				client->protocol_info = NULL;
-			}
+		g_free(client->protocol_info);
+		if (task->ut.protocol_info.protocol_info[0]) {
+			client->protocol_info =
+				task->ut.protocol_info.protocol_info;
+			task->ut.protocol_info.protocol_info = NULL;
+		} else {
+			client->protocol_info = NULL;
 		}
 		msu_task_complete_and_delete(task);
 		break;
+	case MSU_TASK_SET_PRIORITY_CLASS:
+		if (!prv_set_priority_class(
+			    client, task->ut.priority_class.priority_class)) {
+			error = g_error_new(MSU_ERROR,
+					    MSU_ERROR_OPERATION_FAILED,
+					    "Unknown priority class %s",
+					    task->ut.priority_class.
+					    priority_class);
+			msu_task_fail_and_delete(task, error);
+			g_error_free(error);
+		} else {
+			msu_task_complete_and_delete(task);
+		}
+		break;
+	case MSU_TASK_REGISTER_VIEW:
+		task->result = g_variant_ref_sink(g_variant_new_uint32(
+				prv_register_view(context, client, task)));
+		msu_task_complete_and_delete(task);
+		break;
+	case MSU_TASK_WATCH:
+		client_name = g_dbus_method_invocation_get_sender(
+			task->invocation);
+		if (!msu_upnp_watch(context->upnp, client_name,
+				    task->ut.watch.container, &error)) {
+			msu_task_fail_and_delete(task, error);
+			g_error_free(error);
+		} else {
+			msu_task_complete_and_delete(task);
+		}
+		break;
+	case MSU_TASK_UNWATCH:
+		client_name = g_dbus_method_invocation_get_sender(
+			task->invocation);
+		if (!msu_upnp_unwatch(context->upnp, client_name,
+				      task->ut.watch.container, &error)) {
+			msu_task_fail_and_delete(task, error);
+			g_error_free(error);
+		} else {
+			msu_task_complete_and_delete(task);
+		}
+		break;
 
 	default:
 		break;
 	}
-
-	context->current_task = NULL;
 }
 
 static void prv_async_task_complete(msu_task_t *task, GVariant *result,
@@ -350,6 +664,9 @@ static void prv_async_task_complete(msu_task_t *task, GVariant *result,
 
 	MSU_LOG_DEBUG("Enter");
 
+	MSU_PROBE3(task_complete, task->type, task->path,
+		   error ? error->code : 0);
+
 	g_object_unref(context->cancellable);
 	context->cancellable = NULL;
 	context->current_task = NULL;
@@ -364,7 +681,7 @@ static void prv_async_task_complete(msu_task_t *task, GVariant *result,
 
 	if (context->quitting)
 		g_main_loop_quit(context->main_loop);
-	else if (context->tasks->len > 0)
+	else if (context->pending_tasks > 0)
 		context->idle_id = g_idle_add(prv_process_task, context);
 
 	MSU_LOG_DEBUG("Exit");
@@ -372,19 +689,14 @@ static void prv_async_task_complete(msu_task_t *task, GVariant *result,
 
 static void prv_process_async_task(msu_context_t *context, msu_task_t *task)
 {
-	const gchar *client_name;
-	msu_client_t *client;
-	const gchar *protocol_info = NULL;
+	const gchar *protocol_info = task->client_protocol_info;
 
 	MSU_LOG_DEBUG("Enter");
 
+	MSU_TRACE_END(task->trace_id, "queue");
+
 	context->cancellable = g_cancellable_new();
 	context->current_task = task;
-	client_name =
-		g_dbus_method_invocation_get_sender(task->invocation);
-	client = g_hash_table_lookup(context->watchers, client_name);
-	if (client)
-		protocol_info = client->protocol_info;
 
 	switch (task->type) {
 	case MSU_TASK_GET_CHILDREN:
@@ -412,6 +724,15 @@ static void prv_process_async_task(msu_context_t *context, msu_task_t *task)
 				      context->cancellable,
 				      prv_async_task_complete, context);
 		break;
+	case MSU_TASK_LIST_TREE:
+		msu_upnp_list_tree(context->upnp, task, protocol_info,
+				   context->cancellable,
+				   prv_async_task_complete, context);
+		break;
+	case MSU_TASK_COUNT:
+		msu_upnp_count(context->upnp, task, context->cancellable,
+			       prv_async_task_complete, context);
+		break;
 	default:
 		break;
 	}
@@ -419,27 +740,42 @@ static void prv_process_async_task(msu_context_t *context, msu_task_t *task)
 	MSU_LOG_DEBUG("Exit");
 }
 
+static gboolean prv_rate_timeout_cb(gpointer user_data);
+
 static gboolean prv_process_task(gpointer user_data)
 {
 	msu_context_t *context = user_data;
 	msu_task_t *task;
-	gboolean retval = FALSE;
+	guint wait;
 
-	if (context->tasks->len > 0) {
-		task = g_ptr_array_index(context->tasks, 0);
-		if (task->synchronous) {
-			prv_process_sync_task(context, task);
-			retval = TRUE;
-		} else {
-			prv_process_async_task(context, task);
-			context->idle_id = 0;
-		}
-		g_ptr_array_remove_index(context->tasks, 0);
-	} else {
-		context->idle_id = 0;
+	/* Only tasks that need to talk to a server are queued.  Synchronous
+	   tasks are answered as soon as they arrive. */
+
+	context->idle_id = 0;
+	task = prv_next_task(context, &wait);
+
+	if (task) {
+		MSU_PROBE3(task_dispatch, task->type, task->path,
+			   context->pending_tasks);
+		prv_process_async_task(context, task);
+	} else if (wait && !context->rate_id) {
+		context->rate_id = g_timeout_add(wait, prv_rate_timeout_cb,
+						 context);
 	}
 
-	return retval;
+	return FALSE;
+}
+
+static gboolean prv_rate_timeout_cb(gpointer user_data)
+{
+	msu_context_t *context = user_data;
+
+	context->rate_id = 0;
+
+	if (!context->cancellable && !context->idle_id)
+		context->idle_id = g_idle_add(prv_process_task, context);
+
+	return FALSE;
 }
 
 static void prv_msu_method_call(GDBusConnection *conn,
@@ -521,14 +857,12 @@ static void prv_msu_context_free(msu_context_t *context)
 	if (context->watchers)
 		g_hash_table_unref(context->watchers);
 
-	if (context->tasks) {
-		g_ptr_array_foreach(context->tasks, prv_free_msu_task_cb, NULL);
-		g_ptr_array_unref(context->tasks);
-	}
-
 	if (context->idle_id)
 		(void) g_source_remove(context->idle_id);
 
+	if (context->rate_id)
+		(void) g_source_remove(context->rate_id);
+
 	if (context->sig_id)
 		(void) g_source_remove(context->sig_id);
 
@@ -571,8 +905,8 @@ static void prv_quit(msu_context_t *context)
 static void prv_remove_client(msu_context_t *context, const gchar *name)
 {
 	const gchar *client_name;
+	msu_client_t *client;
 	msu_task_t *task;
-	guint pos;
 
 	if (context->cancellable) {
 		client_name = g_dbus_method_invocation_get_sender(
@@ -585,25 +919,20 @@ static void prv_remove_client(msu_context_t *context, const gchar *name)
 		}
 	}
 
-	pos = 0;
-	while (pos < context->tasks->len) {
-		task = (msu_task_t *) g_ptr_array_index(context->tasks, pos);
+	client = g_hash_table_lookup(context->watchers, name);
 
-		client_name = g_dbus_method_invocation_get_sender(
-							task->invocation);
+	if (client) {
+		while ((task = g_queue_pop_head(&client->tasks))) {
+			MSU_LOG_DEBUG("Removing task type %d from queue",
+				      task->type);
 
-		if (strcmp(client_name, name)) {
-			pos++;
-			continue;
+			context->pending_tasks--;
+			msu_task_cancel_and_delete(task);
 		}
-
-		MSU_LOG_DEBUG("Removing task type %d from array", task->type);
-
-		(void) g_ptr_array_remove_index(context->tasks, pos);
-		msu_task_cancel_and_delete(task);
 	}
 
 	(void) g_hash_table_remove(context->watchers, name);
+	msu_upnp_unwatch_client(context->upnp, name);
 
 	if (g_hash_table_size(context->watchers) == 0)
 		if (!msu_settings_is_never_quit(context->settings))
@@ -618,27 +947,118 @@ static void prv_lost_client(GDBusConnection *connection, const gchar *name,
 	prv_remove_client(user_data, name);
 }
 
-static void prv_add_task(msu_context_t *context, msu_task_t *task)
+static msu_client_t *prv_get_client(msu_context_t *context,
+				    const gchar *client_name)
 {
-	const gchar *client_name;
 	msu_client_t *client;
 
-	client_name = g_dbus_method_invocation_get_sender(task->invocation);
+	client = g_hash_table_lookup(context->watchers, client_name);
 
-	if (!g_hash_table_lookup(context->watchers, client_name)) {
+	if (!client) {
 		client = g_new0(msu_client_t, 1);
 		client->id = g_bus_watch_name(G_BUS_TYPE_SESSION, client_name,
 					      G_BUS_NAME_WATCHER_FLAGS_NONE,
 					      NULL, prv_lost_client, context,
 					      NULL);
+		g_queue_init(&client->tasks);
 		g_hash_table_insert(context->watchers, g_strdup(client_name),
 				    client);
 	}
 
+	return client;
+}
+
+static void prv_run_task(msu_context_t *context, msu_task_t *task)
+{
+	const gchar *client_name;
+	msu_client_t *client;
+
+	task->trace_id = msu_trace_new_id();
+	MSU_TRACE_BEGIN(task->trace_id, "request");
+
+	client_name = g_dbus_method_invocation_get_sender(task->invocation);
+	client = prv_get_client(context, client_name);
+	prv_process_sync_task(context, client, task);
+}
+
+static void prv_add_task(msu_context_t *context, msu_task_t *task)
+{
+	const gchar *client_name;
+	msu_client_t *client;
+	guint limit;
+	GError *error;
+
+	task->trace_id = msu_trace_new_id();
+	MSU_TRACE_BEGIN(task->trace_id, "request");
+
+	client_name = g_dbus_method_invocation_get_sender(task->invocation);
+	client = prv_get_client(context, client_name);
+
+	limit = msu_settings_get_client_queue_limit(context->settings);
+
+	if (limit && g_queue_get_length(&client->tasks) >= limit) {
+		MSU_LOG_WARNING("Client %s has too many pending requests",
+				client_name);
+
+		error = g_error_new(MSU_ERROR, MSU_ERROR_BUSY,
+				    "Too many requests pending");
+		msu_task_fail_and_delete(task, error);
+		g_error_free(error);
+		goto on_exit;
+	}
+
+	if (task->view.set && !prv_resolve_view(client, task)) {
+		MSU_LOG_WARNING("Client %s has no view %u", client_name,
+				task->view.id);
+
+		error = g_error_new(MSU_ERROR, MSU_ERROR_BAD_QUERY,
+				    "Unknown view %u", task->view.id);
+		msu_task_fail_and_delete(task, error);
+		g_error_free(error);
+		goto on_exit;
+	}
+
 	if (!context->cancellable && !context->idle_id)
 		context->idle_id = g_idle_add(prv_process_task, context);
 
-	g_ptr_array_add(context->tasks, task);
+	/* The task is executed with the protocol info that was in force
+	   when it was issued, regardless of any SetProtocolInfo calls the
+	   client makes while it is queued. */
+
+	task->client_protocol_info = g_strdup(client->protocol_info);
+	g_queue_push_tail(&client->tasks, task);
+	context->pending_tasks++;
+	MSU_TRACE_BEGIN(task->trace_id, "queue");
+
+	if (g_queue_get_length(&client->tasks) == 1)
+		prv_update_head_finish(context, client);
+
+on_exit:
+
+	return;
+}
+
+static void prv_dump_trace(GDBusMethodInvocation *invocation)
+{
+	GError *error = NULL;
+	gchar *path;
+
+	path = msu_trace_dump(&error);
+	if (!path) {
+		g_dbus_method_invocation_return_error(
+			invocation, MSU_ERROR, MSU_ERROR_OPERATION_FAILED,
+			"Unable to write trace: %s", error->message);
+		g_error_free(error);
+		goto on_error;
+	}
+
+	g_dbus_method_invocation_return_value(invocation,
+					      g_variant_new("(s)", path));
+	g_free(path);
+
+on_error:
+
+	return;
 }
 
 static void prv_msu_method_call(GDBusConnection *conn,
@@ -658,13 +1078,33 @@ static void prv_msu_method_call(GDBusConnection *conn,
 		g_dbus_method_invocation_return_value(invocation, NULL);
 	} else if (!strcmp(method, MSU_INTERFACE_GET_VERSION)) {
 		task = msu_task_get_version_new(invocation);
-		prv_add_task(context, task);
+		prv_run_task(context, task);
 	} else if (!strcmp(method, MSU_INTERFACE_GET_SERVERS)) {
 		task = msu_task_get_servers_new(invocation);
-		prv_add_task(context, task);
+		prv_run_task(context, task);
 	} else if (!strcmp(method, MSU_INTERFACE_SET_PROTOCOL_INFO)) {
 		task = msu_task_set_protocol_info_new(invocation, parameters);
-		prv_add_task(context, task);
+		prv_run_task(context, task);
+	} else if (!strcmp(method, MSU_INTERFACE_SET_PRIORITY_CLASS)) {
+		task = msu_task_set_priority_class_new(invocation, parameters);
+		prv_run_task(context, task);
+	} else if (!strcmp(method, MSU_INTERFACE_REGISTER_VIEW)) {
+		task = msu_task_register_view_new(invocation, parameters);
+		prv_run_task(context, task);
+	} else if (!strcmp(method, MSU_INTERFACE_WATCH)) {
+		task = msu_task_watch_new(invocation, parameters);
+		prv_run_task(context, task);
+	} else if (!strcmp(method, MSU_INTERFACE_UNWATCH)) {
+		task = msu_task_unwatch_new(invocation, parameters);
+		prv_run_task(context, task);
+	} else if (!strcmp(method, MSU_INTERFACE_DUMP_TRACE)) {
+		prv_dump_trace(invocation);
+	} else if (!strcmp(method, MSU_INTERFACE_GET_SETTINGS)) {
+		g_dbus_method_invocation_return_value(
+			invocation,
+			g_variant_new("(@a{sv})",
+				      msu_settings_get_values(
+					      context->settings)));
 	}
 }
 
@@ -682,6 +1122,11 @@ static void prv_item_method_call(GDBusConnection *conn,
 		task = msu_task_get_resource_new(invocation, object,
 						 parameters);
 		prv_add_task(context, task);
+	} else if (!strcmp(method,
+			   MSU_INTERFACE_GET_COMPATIBLE_RESOURCE_VIEW)) {
+		task = msu_task_get_resource_view_new(invocation, object,
+						      parameters);
+		prv_add_task(context, task);
 	}
 }
 
@@ -704,6 +1149,13 @@ static void prv_con_method_call(GDBusConnection *conn,
 	else if (!strcmp(method, MSU_INTERFACE_LIST_CHILDREN_EX))
 		task = msu_task_get_children_ex_new(invocation, object,
 						    parameters, TRUE, TRUE);
+	else if (!strcmp(method, MSU_INTERFACE_LIST_CHILDREN_PROGRESSIVE))
+		task = msu_task_get_children_progressive_new(invocation,
+							     object,
+							     parameters);
+	else if (!strcmp(method, MSU_INTERFACE_LIST_CHILDREN_VIEW))
+		task = msu_task_get_children_view_new(invocation, object,
+						      parameters);
 	else if (!strcmp(method, MSU_INTERFACE_LIST_ITEMS))
 		task = msu_task_get_children_new(invocation, object,
 						 parameters, TRUE, FALSE);
@@ -722,9 +1174,29 @@ static void prv_con_method_call(GDBusConnection *conn,
 	else if (!strcmp(method, MSU_INTERFACE_SEARCH_OBJECTS_EX))
 		task = msu_task_search_ex_new(invocation, object,
 					      parameters);
+	else if (!strcmp(method, MSU_INTERFACE_SEARCH_OBJECTS_VIEW))
+		task = msu_task_search_view_new(invocation, object,
+						parameters);
+	else if (!strcmp(method, MSU_INTERFACE_LIST_TREE))
+		task = msu_task_list_tree_new(invocation, object, parameters);
+	else if (!strcmp(method, MSU_INTERFACE_COUNT_CHILDREN))
+		task = msu_task_count_children_new(invocation, object);
+	else if (!strcmp(method, MSU_INTERFACE_COUNT_SEARCH))
+		task = msu_task_count_search_new(invocation, object,
+						 parameters);
 	else
 		goto finished;
 
+	/* Counts that are already known from the cache or the index are
+	   returned immediately rather than queued. */
+
+	if (task->type == MSU_TASK_COUNT &&
+	    msu_upnp_get_local_count(context->upnp, task)) {
+		(void) prv_get_client(context, sender);
+		msu_task_complete_and_delete(task);
+		goto finished;
+	}
+
 	prv_add_task(context, task);
 
 finished:
@@ -743,6 +1215,7 @@ static void prv_props_method_call(GDBusConnection *conn,
 {
 	msu_context_t *context = user_data;
 	msu_task_t *task;
+	GError *error = NULL;
 
 	if (!strcmp(method, MSU_INTERFACE_GET_ALL))
 		task = msu_task_get_props_new(invocation, object, parameters);
@@ -751,7 +1224,22 @@ static void prv_props_method_call(GDBusConnection *conn,
 	else
 		goto finished;
 
-	prv_add_task(context, task);
+	/* Properties of the server itself are known locally and do not
+	   need to wait behind other clients' browse requests. */
+
+	if (!msu_upnp_get_local_props(context->upnp, task, &error)) {
+		prv_add_task(context, task);
+		goto finished;
+	}
+
+	(void) prv_get_client(context, sender);
+
+	if (error) {
+		msu_task_fail_and_delete(task, error);
+		g_error_free(error);
+	} else {
+		msu_task_complete_and_delete(task);
+	}
 
 finished:
 
@@ -813,6 +1301,7 @@ static void prv_bus_acquired(GDBusConnection *connection, const gchar *name,
 		context->upnp = msu_upnp_new(connection, info,
 					    prv_found_media_server,
 					    prv_lost_media_server,
+					    context->settings,
 					    user_data);
 	}
 }
@@ -831,11 +1320,27 @@ static gboolean prv_quit_handler(GIOChannel *source, GIOCondition condition,
 				 gpointer user_data)
 {
 	msu_context_t *context = user_data;
+	struct signalfd_siginfo info;
+	gchar *path;
+	gboolean retval = FALSE;
+
+	/* SIGUSR1 asks for the trace to be written out.  Any other
+	   signal we are watching for stops the daemon. */
+
+	if (read(g_io_channel_unix_get_fd(source), &info, sizeof(info)) ==
+	    sizeof(info) && info.ssi_signo == SIGUSR1) {
+		path = msu_trace_dump(NULL);
+		g_free(path);
+		retval = TRUE;
+		goto on_exit;
+	}
 
 	prv_quit(context);
 	context->sig_id = 0;
 
-	return FALSE;
+on_exit:
+
+	return retval;
 }
 
 static bool prv_init_signal_handler(sigset_t mask, msu_context_t *context)
@@ -876,10 +1381,16 @@ on_error:
 static void prv_unregister_client(gpointer user_data)
 {
 	msu_client_t *client = user_data;
+	msu_task_t *task;
 
 	if (client) {
+		while ((task = g_queue_pop_head(&client->tasks)))
+			msu_task_delete(task);
+
 		g_bus_unwatch_name(client->id);
 		g_free(client->protocol_info);
+		if (client->views)
+			g_array_unref(client->views);
 		g_free(client);
 	}
 }
@@ -896,6 +1407,7 @@ int main(int argc, char *argv[])
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGTERM);
 	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGUSR1);
 
 	if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
 		goto on_error;
@@ -923,8 +1435,6 @@ int main(int argc, char *argv[])
 					  prv_bus_acquired, NULL,
 					  prv_name_lost, &context, NULL);
 
-	context.tasks = g_ptr_array_new();
-
 	context.watchers = g_hash_table_new_full(g_str_hash, g_str_equal,
 						 g_free, prv_unregister_client);
 
@@ -941,6 +1451,7 @@ on_error:
 
 	prv_msu_context_free(&context);
 
+	msu_trace_finalize();
 	msu_log_finalize();
 
 	return retval;
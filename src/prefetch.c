@@ -0,0 +1,325 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#include <string.h>
+
+#include "log.h"
+#include "prefetch.h"
+
+#define MSU_PREFETCH_MAX_QUEUED 16
+
+struct msu_prefetch_t_ {
+	msu_cache_t *cache;
+	msu_limit_t *limit;
+	msu_prefetch_dispatch_t dispatch;
+	void *user_data;
+	gboolean enabled;
+	guint children;
+	guint max_actions;
+	GQueue queue;
+	GPtrArray *in_flight;
+	guint idle_id;
+	guint issued;
+	guint completed;
+	guint failed;
+	guint dropped;
+};
+
+static void prv_prefetch_job_delete(msu_prefetch_job_t *job)
+{
+	if (job) {
+		if (job->proxy)
+			g_object_unref(job->proxy);
+
+		g_free(job->key);
+		g_free(job->id);
+		g_free(job->upnp_filter);
+		g_free(job->sort_by);
+		g_free(job);
+	}
+}
+
+static void prv_prefetch_drop_queued(msu_prefetch_t *prefetch)
+{
+	msu_prefetch_job_t *job;
+
+	while ((job = g_queue_pop_head(&prefetch->queue))) {
+		prefetch->dropped++;
+		prv_prefetch_job_delete(job);
+	}
+
+	if (prefetch->idle_id) {
+		(void) g_source_remove(prefetch->idle_id);
+		prefetch->idle_id = 0;
+	}
+}
+
+static gboolean prv_prefetch_dispatch_cb(gpointer user_data)
+{
+	msu_prefetch_t *prefetch = user_data;
+	msu_prefetch_job_t *job;
+	guint wait;
+
+	/* Speculative requests only use the capacity that clients leave
+	   unused. */
+
+	while (prefetch->in_flight->len < prefetch->max_actions &&
+	       msu_limit_available(prefetch->limit)) {
+		job = g_queue_pop_head(&prefetch->queue);
+		if (!job)
+			break;
+
+		/* The page may have been fetched on behalf of a client
+		   since it was queued. */
+
+		if (msu_cache_contains(prefetch->cache, job->key)) {
+			prv_prefetch_job_delete(job);
+			continue;
+		}
+
+		MSU_LOG_DEBUG("Prefetching %s start %u count %u", job->id,
+			      job->start, job->count);
+
+		g_ptr_array_add(prefetch->in_flight, job);
+		prefetch->issued++;
+		prefetch->dispatch(job, prefetch->user_data);
+	}
+
+	prefetch->idle_id = 0;
+
+	/* Nothing completing will wake us up if the server's action rate
+	   is all that holds the queue back. */
+
+	wait = msu_limit_get_wait(prefetch->limit);
+	if (wait && prefetch->queue.length > 0)
+		prefetch->idle_id = g_timeout_add(wait,
+						  prv_prefetch_dispatch_cb,
+						  prefetch);
+
+	return FALSE;
+}
+
+static void prv_prefetch_schedule_dispatch(msu_prefetch_t *prefetch)
+{
+	if (!prefetch->idle_id && prefetch->queue.length > 0)
+		prefetch->idle_id = g_idle_add_full(G_PRIORITY_LOW,
+						    prv_prefetch_dispatch_cb,
+						    prefetch, NULL);
+}
+
+static gboolean prv_prefetch_is_pending(msu_prefetch_t *prefetch,
+					const gchar *key)
+{
+	GList *link;
+	msu_prefetch_job_t *job;
+	guint i;
+	gboolean retval = FALSE;
+
+	for (link = prefetch->queue.head; link && !retval; link = link->next) {
+		job = link->data;
+		retval = !strcmp(job->key, key);
+	}
+
+	for (i = 0; i < prefetch->in_flight->len && !retval; ++i) {
+		job = g_ptr_array_index(prefetch->in_flight, i);
+		retval = !strcmp(job->key, key);
+	}
+
+	return retval;
+}
+
+static void prv_prefetch_queue(msu_prefetch_t *prefetch, const gchar *id,
+			       const gchar *upnp_filter, const gchar *sort_by,
+			       guint start, guint count)
+{
+	msu_prefetch_job_t *job;
+	gchar *key;
+
+	key = msu_cache_make_key(id, upnp_filter, sort_by, start, count);
+
+	if (prefetch->queue.length >= MSU_PREFETCH_MAX_QUEUED ||
+	    msu_cache_contains(prefetch->cache, key) ||
+	    prv_prefetch_is_pending(prefetch, key)) {
+		g_free(key);
+		goto on_exit;
+	}
+
+	job = g_new0(msu_prefetch_job_t, 1);
+	job->prefetch = prefetch;
+	job->key = key;
+	job->id = g_strdup(id);
+	job->upnp_filter = g_strdup(upnp_filter);
+	job->sort_by = g_strdup(sort_by);
+	job->start = start;
+	job->count = count;
+	job->generation = msu_cache_get_generation(prefetch->cache);
+
+	g_queue_push_tail(&prefetch->queue, job);
+
+on_exit:
+
+	return;
+}
+
+void msu_prefetch_new(msu_cache_t *cache, msu_limit_t *limit,
+		      msu_prefetch_dispatch_t dispatch, void *user_data,
+		      msu_prefetch_t **prefetch)
+{
+	msu_prefetch_t *p = g_new0(msu_prefetch_t, 1);
+
+	p->cache = cache;
+	p->limit = limit;
+	p->dispatch = dispatch;
+	p->user_data = user_data;
+	p->in_flight = g_ptr_array_new();
+	g_queue_init(&p->queue);
+
+	*prefetch = p;
+}
+
+void msu_prefetch_delete(msu_prefetch_t *prefetch)
+{
+	msu_prefetch_job_t *job;
+	guint i;
+
+	if (prefetch) {
+		prv_prefetch_drop_queued(prefetch);
+
+		for (i = 0; i < prefetch->in_flight->len; ++i) {
+			job = g_ptr_array_index(prefetch->in_flight, i);
+			msu_limit_cancel_action(job->proxy, job->action);
+			prv_prefetch_job_delete(job);
+		}
+
+		g_ptr_array_unref(prefetch->in_flight);
+		g_free(prefetch);
+	}
+}
+
+void msu_prefetch_configure(msu_prefetch_t *prefetch, gboolean enabled,
+			    guint children, guint max_actions)
+{
+	prefetch->enabled = enabled && max_actions > 0;
+	prefetch->children = children;
+	prefetch->max_actions = max_actions;
+
+	if (!prefetch->enabled)
+		prv_prefetch_drop_queued(prefetch);
+}
+
+gboolean msu_prefetch_is_enabled(msu_prefetch_t *prefetch)
+{
+	return prefetch->enabled;
+}
+
+void msu_prefetch_demand(msu_prefetch_t *prefetch)
+{
+	/* A client is waiting on this server.  Speculative work that has
+	   not yet been sent is abandoned so that it does not compete with
+	   the real request.  It is rescheduled from the client's results. */
+
+	if (prefetch->queue.length > 0)
+		MSU_LOG_DEBUG("Dropping %u queued prefetches",
+			      prefetch->queue.length);
+
+	prv_prefetch_drop_queued(prefetch);
+}
+
+void msu_prefetch_browse_done(msu_prefetch_t *prefetch, const gchar *id,
+			      const gchar *upnp_filter, const gchar *sort_by,
+			      guint start, guint count, guint number_returned,
+			      guint total_matches, GPtrArray *child_ids)
+{
+	gboolean more;
+	guint i;
+
+	if (!prefetch->enabled || count == 0)
+		goto on_exit;
+
+	/* Some servers report a TotalMatches of 0 when they do not know
+	   the size of the container.  Assume there is more to come if they
+	   gave us a full page. */
+
+	if (total_matches)
+		more = start + number_returned < total_matches;
+	else
+		more = number_returned == count;
+
+	if (more && number_returned > 0)
+		prv_prefetch_queue(prefetch, id, upnp_filter, sort_by,
+				   start + number_returned, count);
+
+	if (child_ids)
+		for (i = 0; i < child_ids->len && i < prefetch->children; ++i)
+			prv_prefetch_queue(prefetch,
+					   g_ptr_array_index(child_ids, i),
+					   upnp_filter, sort_by, 0, count);
+
+	prv_prefetch_schedule_dispatch(prefetch);
+
+on_exit:
+
+	return;
+}
+
+void msu_prefetch_job_complete(msu_prefetch_job_t *job, const gchar *didl,
+			       guint number_returned, guint total_matches)
+{
+	msu_prefetch_t *prefetch = job->prefetch;
+
+	(void) g_ptr_array_remove_fast(prefetch->in_flight, job);
+
+	if (didl) {
+		prefetch->completed++;
+		msu_cache_insert(prefetch->cache, job->key, job->id, didl,
+				 number_returned, total_matches, TRUE,
+				 job->generation);
+	} else {
+		prefetch->failed++;
+	}
+
+	prv_prefetch_job_delete(job);
+	prv_prefetch_schedule_dispatch(prefetch);
+}
+
+void msu_prefetch_add_statistics(msu_prefetch_t *prefetch,
+				 GVariantBuilder *vb)
+{
+	guint hits = msu_cache_get_prefetch_hits(prefetch->cache);
+	gdouble hit_rate = 0.0;
+
+	if (prefetch->completed)
+		hit_rate = (gdouble) hits / prefetch->completed;
+
+	g_variant_builder_add(vb, "{sv}", "PrefetchIssued",
+			      g_variant_new_uint32(prefetch->issued));
+	g_variant_builder_add(vb, "{sv}", "PrefetchCompleted",
+			      g_variant_new_uint32(prefetch->completed));
+	g_variant_builder_add(vb, "{sv}", "PrefetchFailed",
+			      g_variant_new_uint32(prefetch->failed));
+	g_variant_builder_add(vb, "{sv}", "PrefetchDropped",
+			      g_variant_new_uint32(prefetch->dropped));
+	g_variant_builder_add(vb, "{sv}", "PrefetchHits",
+			      g_variant_new_uint32(hits));
+	g_variant_builder_add(vb, "{sv}", "PrefetchHitRate",
+			      g_variant_new_double(hit_rate));
+}
@@ -0,0 +1,70 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#ifndef MSU_PREFETCH_H__
+#define MSU_PREFETCH_H__
+
+#include <libgupnp/gupnp-control-point.h>
+
+#include "cache.h"
+#include "limit.h"
+
+typedef struct msu_prefetch_t_ msu_prefetch_t;
+
+typedef struct msu_prefetch_job_t_ msu_prefetch_job_t;
+struct msu_prefetch_job_t_ {
+	msu_prefetch_t *prefetch;
+	gchar *key;
+	gchar *id;
+	gchar *upnp_filter;
+	gchar *sort_by;
+	guint start;
+	guint count;
+	guint generation;
+	GUPnPServiceProxy *proxy;
+	GUPnPServiceProxyAction *action;
+};
+
+typedef void (*msu_prefetch_dispatch_t)(msu_prefetch_job_t *job,
+					void *user_data);
+
+void msu_prefetch_new(msu_cache_t *cache, msu_limit_t *limit,
+		      msu_prefetch_dispatch_t dispatch, void *user_data,
+		      msu_prefetch_t **prefetch);
+void msu_prefetch_delete(msu_prefetch_t *prefetch);
+
+void msu_prefetch_configure(msu_prefetch_t *prefetch, gboolean enabled,
+			    guint children, guint max_actions);
+gboolean msu_prefetch_is_enabled(msu_prefetch_t *prefetch);
+
+void msu_prefetch_demand(msu_prefetch_t *prefetch);
+void msu_prefetch_browse_done(msu_prefetch_t *prefetch, const gchar *id,
+			      const gchar *upnp_filter, const gchar *sort_by,
+			      guint start, guint count, guint number_returned,
+			      guint total_matches, GPtrArray *child_ids);
+void msu_prefetch_job_complete(msu_prefetch_job_t *job, const gchar *didl,
+			       guint number_returned, guint total_matches);
+
+void msu_prefetch_add_statistics(msu_prefetch_t *prefetch,
+				 GVariantBuilder *vb);
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#ifndef MSU_PROBES_H__
+#define MSU_PROBES_H__
+
+/* Static tracepoints for perf, SystemTap and bpftrace.  They are
+ * compiled in with --enable-probes and cost a single nop each when no
+ * tracer is attached.  Arguments are still evaluated, so they should be
+ * limited to values that are already to hand.  The provider name is
+ * media_service_upnp.  See test/probes for example scripts.
+ */
+
+#ifdef MSU_PROBES_ENABLED
+	#include <sys/sdt.h>
+
+	#define MSU_PROBE(name) \
+		DTRACE_PROBE(media_service_upnp, name)
+	#define MSU_PROBE1(name, a) \
+		DTRACE_PROBE1(media_service_upnp, name, a)
+	#define MSU_PROBE2(name, a, b) \
+		DTRACE_PROBE2(media_service_upnp, name, a, b)
+	#define MSU_PROBE3(name, a, b, c) \
+		DTRACE_PROBE3(media_service_upnp, name, a, b, c)
+#else
+	#define MSU_PROBE(name)
+	#define MSU_PROBE1(name, a)
+	#define MSU_PROBE2(name, a, b)
+	#define MSU_PROBE3(name, a, b, c)
+#endif
+
+#endif /* MSU_PROBES_H__ */
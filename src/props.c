@@ -20,6 +20,7 @@
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "interface.h"
@@ -27,6 +28,26 @@
 #include "path.h"
 #include "props.h"
 
+/*
+ * Values such as artists, albums, genres, MIME types and parent paths
+ * repeat across most of the objects in a listing.  They are kept in a
+ * bounded table of shared GVariants so that each result references a
+ * single copy rather than allocating its own.
+ */
+
+#define MSU_PROPS_INTERN_MAX 4096
+#define MSU_PROPS_INTERN_MAX_LEN 256
+
+typedef struct msu_props_intern_t_ msu_props_intern_t;
+struct msu_props_intern_t_ {
+	GHashTable *strings;
+	GHashTable *paths;
+	guint hits;
+	guint misses;
+};
+
+static msu_props_intern_t g_intern;
+
 static const gchar gUPnPContainer[] = "object.container";
 static const gchar gUPnPAudioItem[] = "object.item.audioItem";
 static const gchar gUPnPVideoItem[] = "object.item.videoItem";
@@ -53,239 +74,229 @@ static const gchar gMediaSpec2Video[] = "video";
 static const gchar gMediaSpec2ImagePhoto[] = "image.photo";
 static const gchar gMediaSpec2Image[] = "image";
 
-static msu_prop_map_t *prv_msu_prop_map_new(const gchar *prop_name,
-					    msu_upnp_prop_mask type,
-					    gboolean filter,
-					    gboolean searchable)
+#define MSU_PROPS_FILTER_CACHE_MAX 128
+
+/* Sorted by D-Bus property name so that it can be searched with bsearch.
+   Keep it sorted when adding entries. */
+
+static const msu_prop_map_t g_prop_maps[] = {
+	{ MSU_INTERFACE_PROP_ALBUM, "upnp:album",
+	  MSU_UPNP_MASK_PROP_ALBUM, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_ALBUM_ART_URL, "upnp:albumArtURI",
+	  MSU_UPNP_MASK_PROP_ALBUM_ART_URL, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_ARTIST, "upnp:artist",
+	  MSU_UPNP_MASK_PROP_ARTIST, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_BITRATE, "res@bitrate",
+	  MSU_UPNP_MASK_PROP_BITRATE, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_BITS_PER_SAMPLE, "res@bitsPerSample",
+	  MSU_UPNP_MASK_PROP_BITS_PER_SAMPLE, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_CHILD_COUNT, "@childCount",
+	  MSU_UPNP_MASK_PROP_CHILD_COUNT, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_COLOR_DEPTH, "res@colorDepth",
+	  MSU_UPNP_MASK_PROP_COLOR_DEPTH, TRUE, TRUE },
+
+	/* The update ID is taken from ContainerUpdateIDs events rather
+	   than from the DIDL-Lite, so there is nothing to ask for. */
+
+	{ MSU_INTERFACE_PROP_CONTAINER_UPDATE_ID, "@id",
+	  MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID, FALSE, FALSE },
+	{ MSU_INTERFACE_PROP_DLNA_PROFILE, "res@protocolInfo",
+	  MSU_UPNP_MASK_PROP_DLNA_PROFILE, TRUE, FALSE },
+	{ MSU_INTERFACE_PROP_DATE, "dc:date",
+	  MSU_UPNP_MASK_PROP_DATE, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_DISPLAY_NAME, "dc:title",
+	  MSU_UPNP_MASK_PROP_DISPLAY_NAME, FALSE, TRUE },
+	{ MSU_INTERFACE_PROP_DURATION, "res@duration",
+	  MSU_UPNP_MASK_PROP_DURATION, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_GENRE, "upnp:genre",
+	  MSU_UPNP_MASK_PROP_GENRE, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_HEIGHT, "res@resolution",
+	  MSU_UPNP_MASK_PROP_HEIGHT, TRUE, FALSE },
+	{ MSU_INTERFACE_PROP_MIME_TYPE, "res@protocolInfo",
+	  MSU_UPNP_MASK_PROP_MIME_TYPE, TRUE, FALSE },
+	{ MSU_INTERFACE_PROP_PARENT, "@parentID",
+	  MSU_UPNP_MASK_PROP_PARENT, FALSE, TRUE },
+	{ MSU_INTERFACE_PROP_PATH, "@id",
+	  MSU_UPNP_MASK_PROP_PATH, FALSE, TRUE },
+	{ MSU_INTERFACE_PROP_RESOURCES, "res",
+	  MSU_UPNP_MASK_PROP_RESOURCES, TRUE, FALSE },
+	{ MSU_INTERFACE_PROP_SAMPLE_RATE, "res@sampleFrequency",
+	  MSU_UPNP_MASK_PROP_SAMPLE_RATE, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_SEARCHABLE, "@searchable",
+	  MSU_UPNP_MASK_PROP_SEARCHABLE, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_SIZE, "res@size",
+	  MSU_UPNP_MASK_PROP_SIZE, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_TRACK_NUMBER, "upnp:originalTrackNumber",
+	  MSU_UPNP_MASK_PROP_TRACK_NUMBER, TRUE, TRUE },
+	{ MSU_INTERFACE_PROP_TYPE, "upnp:class",
+	  MSU_UPNP_MASK_PROP_TYPE, FALSE, TRUE },
+	{ MSU_INTERFACE_PROP_URL, "res",
+	  MSU_UPNP_MASK_PROP_URL, TRUE, FALSE },
+	{ MSU_INTERFACE_PROP_URLS, "res",
+	  MSU_UPNP_MASK_PROP_URLS, TRUE, FALSE },
+	{ MSU_INTERFACE_PROP_WIDTH, "res@resolution",
+	  MSU_UPNP_MASK_PROP_WIDTH, TRUE, FALSE }
+};
+
+static int prv_prop_map_cmp(const void *key, const void *entry)
 {
-	msu_prop_map_t *retval = g_new(msu_prop_map_t, 1);
-	retval->upnp_prop_name = prop_name;
-	retval->type = type;
-	retval->filter = filter;
-	retval->searchable = searchable;
-	return retval;
+	return strcmp(key, ((const msu_prop_map_t *) entry)->prop_name);
 }
 
-GHashTable *msu_prop_maps_new()
+const msu_prop_map_t *msu_props_lookup(const gchar *prop_name)
 {
-	msu_prop_map_t *prop_map;
-	GHashTable *filter_map =
-		g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
-
-	prop_map = prv_msu_prop_map_new("@parentID", MSU_UPNP_MASK_PROP_PARENT,
-					FALSE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_PARENT, prop_map);
-
-	prop_map = prv_msu_prop_map_new("upnp:class", MSU_UPNP_MASK_PROP_TYPE,
-					FALSE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_TYPE, prop_map);
-
-	prop_map = prv_msu_prop_map_new("@id", MSU_UPNP_MASK_PROP_PATH,
-					FALSE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_PATH, prop_map);
-
-	prop_map = prv_msu_prop_map_new("dc:title",
-					MSU_UPNP_MASK_PROP_DISPLAY_NAME,
-					FALSE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_DISPLAY_NAME,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("@childCount",
-					MSU_UPNP_MASK_PROP_CHILD_COUNT,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_CHILD_COUNT,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("@searchable",
-					MSU_UPNP_MASK_PROP_SEARCHABLE,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_SEARCHABLE, prop_map);
-
-	prop_map = prv_msu_prop_map_new("res", MSU_UPNP_MASK_PROP_URLS,
-					TRUE, FALSE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_URLS, prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@protocolInfo",
-					MSU_UPNP_MASK_PROP_MIME_TYPE,
-					TRUE, FALSE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_MIME_TYPE, prop_map);
-
-	prop_map = prv_msu_prop_map_new("upnp:artist",
-					MSU_UPNP_MASK_PROP_ARTIST, TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_ARTIST, prop_map);
-
-	prop_map = prv_msu_prop_map_new("upnp:album", MSU_UPNP_MASK_PROP_ALBUM,
-				       TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_ALBUM, prop_map);
-
-	prop_map = prv_msu_prop_map_new("dc:date", MSU_UPNP_MASK_PROP_DATE,
-				       TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_DATE, prop_map);
-
-	prop_map = prv_msu_prop_map_new("upnp:genre", MSU_UPNP_MASK_PROP_GENRE,
-				       TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_GENRE, prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@protocolInfo",
-				       MSU_UPNP_MASK_PROP_DLNA_PROFILE,
-				       TRUE, FALSE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_DLNA_PROFILE,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("upnp:originalTrackNumber",
-					MSU_UPNP_MASK_PROP_TRACK_NUMBER,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_TRACK_NUMBER,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@size", MSU_UPNP_MASK_PROP_SIZE,
-				       TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_SIZE, prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@duration",
-					MSU_UPNP_MASK_PROP_DURATION,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_DURATION, prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@bitrate",
-					MSU_UPNP_MASK_PROP_BITRATE,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_BITRATE, prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@sampleFrequency",
-					MSU_UPNP_MASK_PROP_SAMPLE_RATE,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_SAMPLE_RATE,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@bitsPerSample",
-					MSU_UPNP_MASK_PROP_BITS_PER_SAMPLE,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_BITS_PER_SAMPLE,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@resolution",
-					MSU_UPNP_MASK_PROP_WIDTH, TRUE, FALSE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_WIDTH, prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@resolution",
-					MSU_UPNP_MASK_PROP_HEIGHT, TRUE, FALSE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_HEIGHT, prop_map);
-
-	prop_map = prv_msu_prop_map_new("res@colorDepth",
-					MSU_UPNP_MASK_PROP_COLOR_DEPTH,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_COLOR_DEPTH,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("upnp:albumArtURI",
-					MSU_UPNP_MASK_PROP_ALBUM_ART_URL,
-					TRUE, TRUE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_ALBUM_ART_URL,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("res", MSU_UPNP_MASK_PROP_RESOURCES,
-					TRUE, FALSE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_RESOURCES,
-			    prop_map);
-
-	prop_map = prv_msu_prop_map_new("res", MSU_UPNP_MASK_PROP_URL,
-					TRUE, FALSE);
-	g_hash_table_insert(filter_map,
-			    (gpointer) MSU_INTERFACE_PROP_URL, prop_map);
-
-	return filter_map;
+	return bsearch(prop_name, g_prop_maps, G_N_ELEMENTS(g_prop_maps),
+		       sizeof(g_prop_maps[0]), prv_prop_map_cmp);
 }
 
-static guint32 prv_parse_filter_list(GHashTable *filter_map, GVariant *filter,
-				     gchar **upnp_filter)
+GHashTable *msu_props_filter_cache_new(void)
 {
-	GVariantIter viter;
-	const gchar *prop;
-	msu_prop_map_t *prop_map;
-	GHashTable *upnp_props;
-	GHashTableIter iter;
-	guint32 mask = 0;
-	gpointer key;
-	GString *str;
+	return g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+				     g_free);
+}
 
-	upnp_props = g_hash_table_new_full(g_str_hash, g_str_equal,
-					   NULL, NULL);
-	(void) g_variant_iter_init(&viter, filter);
+static gchar *prv_build_upnp_filter(guint32 mask)
+{
+	GString *str = g_string_new("");
+	const msu_prop_map_t *map;
+	guint i;
+	guint j;
 
-	while (g_variant_iter_next(&viter, "&s", &prop)) {
-		prop_map = g_hash_table_lookup(filter_map, prop);
-		if (!prop_map)
+	/* Several properties can map to the same UPnP property.  Each
+	   UPnP property is only listed once, at its first occurrence. */
+
+	for (i = 0; i < G_N_ELEMENTS(g_prop_maps); ++i) {
+		map = &g_prop_maps[i];
+		if (!(mask & map->type))
 			continue;
 
-		mask |= prop_map->type;
+		for (j = 0; j < i; ++j)
+			if ((mask & g_prop_maps[j].type) &&
+			    !strcmp(g_prop_maps[j].upnp_prop_name,
+				    map->upnp_prop_name))
+				break;
 
-		if (!prop_map->filter)
+		if (j < i)
 			continue;
 
-		g_hash_table_insert(upnp_props,
-				    (gpointer) prop_map->upnp_prop_name, NULL);
+		if (str->len > 0)
+			g_string_append_c(str, ',');
+		g_string_append(str, map->upnp_prop_name);
 	}
 
-	str = g_string_new("");
-	g_hash_table_iter_init(&iter, upnp_props);
-	if (g_hash_table_iter_next(&iter, &key, NULL)) {
-		g_string_append(str, (const gchar *) key);
-		while (g_hash_table_iter_next(&iter, &key, NULL)) {
-			g_string_append(str, ",");
-			g_string_append(str, (const gchar *) key);
-		}
+	return g_string_free(str, FALSE);
+}
+
+static const gchar *prv_get_upnp_filter(GHashTable *filter_cache,
+					guint32 mask)
+{
+	const gchar *retval;
+	gchar *filter;
+
+	if (!mask) {
+		retval = "";
+		goto on_exit;
 	}
-	*upnp_filter = g_string_free(str, FALSE);
-	g_hash_table_unref(upnp_props);
 
-	return mask;
+	retval = g_hash_table_lookup(filter_cache, GUINT_TO_POINTER(mask));
+	if (retval)
+		goto on_exit;
+
+	/* Clients tend to use a handful of filters.  If one sends an
+	   unusual number of different ones we ask the server for
+	   everything rather than grow the cache without bound.  The
+	   filter mask still limits what is returned to the client. */
+
+	if (g_hash_table_size(filter_cache) >= MSU_PROPS_FILTER_CACHE_MAX) {
+		retval = "*";
+		goto on_exit;
+	}
+
+	filter = prv_build_upnp_filter(mask);
+	g_hash_table_insert(filter_cache, GUINT_TO_POINTER(mask), filter);
+	retval = filter;
+
+on_exit:
+
+	return retval;
 }
 
-guint32 msu_props_parse_filter(GHashTable *filter_map, GVariant *filter,
-			       gchar **upnp_filter)
+static gboolean prv_interface_mask(const gchar *interface_name,
+				   guint32 *mask)
+{
+	gboolean retval = TRUE;
+
+	if (!strcmp(interface_name, MSU_INTERFACE_MEDIA_OBJECT))
+		*mask = MSU_PROPS_MASK_OBJECT;
+	else if (!strcmp(interface_name, MSU_INTERFACE_MEDIA_CONTAINER))
+		*mask = MSU_PROPS_MASK_OBJECT | MSU_PROPS_MASK_CONTAINER;
+	else if (!strcmp(interface_name, MSU_INTERFACE_MEDIA_ITEM))
+		*mask = MSU_PROPS_MASK_OBJECT | MSU_PROPS_MASK_ITEM;
+	else if (!strcmp(interface_name, ""))
+		*mask = 0xffffffff;
+	else
+		retval = FALSE;
+
+	return retval;
+}
+
+const gchar *msu_props_get_interface_filter(GHashTable *filter_cache,
+					    const gchar *interface_name)
 {
-	gchar *str;
-	gboolean parse_filter = TRUE;
 	guint32 mask;
+	guint32 upnp_mask = 0;
+	guint i;
+
+	if (!prv_interface_mask(interface_name, &mask))
+		return "*";
+
+	/* Properties that are not filterable, such as the title and the
+	   class, are always returned by the server so they need not be
+	   asked for.  Listing the rest explicitly, even when all of them
+	   are needed, keeps out metadata that we never expose. */
+
+	for (i = 0; i < G_N_ELEMENTS(g_prop_maps); ++i)
+		if ((mask & g_prop_maps[i].type) && g_prop_maps[i].filter)
+			upnp_mask |= g_prop_maps[i].type;
+
+	return prv_get_upnp_filter(filter_cache, upnp_mask);
+}
+
+guint32 msu_props_parse_filter(GHashTable *filter_cache, GVariant *filter,
+			       const gchar **upnp_filter)
+{
+	GVariantIter viter;
+	const gchar *prop;
+	const msu_prop_map_t *prop_map;
+	guint32 mask = 0;
+	guint32 upnp_mask = 0;
 
 	if (g_variant_n_children(filter) == 1) {
-		g_variant_get_child(filter, 0, "&s", &str);
-		if (!strcmp(str, "*"))
-			parse_filter = FALSE;
+		g_variant_get_child(filter, 0, "&s", &prop);
+		if (!strcmp(prop, "*")) {
+			mask = 0xffffffff;
+			*upnp_filter = "*";
+			goto on_exit;
+		}
 	}
 
-	if (parse_filter) {
-		mask = prv_parse_filter_list(filter_map, filter, upnp_filter);
-	} else {
-		mask = 0xffffffff;
-		*upnp_filter = g_strdup("*");
+	(void) g_variant_iter_init(&viter, filter);
+
+	while (g_variant_iter_next(&viter, "&s", &prop)) {
+		prop_map = msu_props_lookup(prop);
+		if (!prop_map)
+			continue;
+
+		mask |= prop_map->type;
+
+		if (prop_map->filter)
+			upnp_mask |= prop_map->type;
 	}
 
+	*upnp_filter = prv_get_upnp_filter(filter_cache, upnp_mask);
+
+on_exit:
+
 	return mask;
 }
 
@@ -300,6 +311,94 @@ static void prv_add_string_prop(GVariantBuilder *vb, const gchar *key,
 	}
 }
 
+static GVariant *prv_intern(GHashTable **table, const gchar *value,
+			    GVariant *(*new_value)(const gchar *value))
+{
+	GVariant *retval;
+
+	if (strlen(value) > MSU_PROPS_INTERN_MAX_LEN)
+		return new_value(value);
+
+	if (!*table)
+		*table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					       (GDestroyNotify)
+					       g_variant_unref);
+
+	retval = g_hash_table_lookup(*table, value);
+	if (retval) {
+		g_intern.hits++;
+		goto on_exit;
+	}
+
+	/* Values still referenced by results being built survive the
+	   table being emptied, as each result holds its own reference. */
+
+	if (g_hash_table_size(*table) >= MSU_PROPS_INTERN_MAX)
+		g_hash_table_remove_all(*table);
+
+	retval = g_variant_ref_sink(new_value(value));
+	g_hash_table_insert(*table, g_strdup(value), retval);
+	g_intern.misses++;
+
+on_exit:
+
+	return retval;
+}
+
+static void prv_add_interned_string_prop(GVariantBuilder *vb,
+					 const gchar *key,
+					 const gchar *value)
+{
+	if (value) {
+		MSU_LOG_DEBUG("Prop %s = %s", key, value);
+
+		g_variant_builder_add(vb, "{sv}", key,
+				      prv_intern(&g_intern.strings, value,
+						 g_variant_new_string));
+	}
+}
+
+static void prv_add_interned_path_prop(GVariantBuilder *vb, const gchar *key,
+				       const gchar *value)
+{
+	if (value) {
+		MSU_LOG_DEBUG("Prop %s = %s", key, value);
+
+		g_variant_builder_add(vb, "{sv}", key,
+				      prv_intern(&g_intern.paths, value,
+						 g_variant_new_object_path));
+	}
+}
+
+void msu_props_intern_clear(void)
+{
+	if (g_intern.strings)
+		g_hash_table_unref(g_intern.strings);
+
+	if (g_intern.paths)
+		g_hash_table_unref(g_intern.paths);
+
+	memset(&g_intern, 0, sizeof(g_intern));
+}
+
+void msu_props_add_intern_statistics(GVariantBuilder *vb)
+{
+	guint size = 0;
+
+	if (g_intern.strings)
+		size += g_hash_table_size(g_intern.strings);
+
+	if (g_intern.paths)
+		size += g_hash_table_size(g_intern.paths);
+
+	g_variant_builder_add(vb, "{sv}", "InternedValues",
+			      g_variant_new_uint32(size));
+	g_variant_builder_add(vb, "{sv}", "InternHits",
+			      g_variant_new_uint32(g_intern.hits));
+	g_variant_builder_add(vb, "{sv}", "InternMisses",
+			      g_variant_new_uint32(g_intern.misses));
+}
+
 static void prv_add_strv_prop(GVariantBuilder *vb, const gchar *key,
 			      const gchar **value, unsigned int len)
 {
@@ -340,6 +439,13 @@ void msu_props_add_child_count(GVariantBuilder *item_vb, gint value)
 	prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_CHILD_COUNT, value);
 }
 
+void msu_props_add_container_update_id(GVariantBuilder *item_vb,
+				       guint value)
+{
+	prv_add_uint_prop(item_vb, MSU_INTERFACE_PROP_CONTAINER_UPDATE_ID,
+			  value);
+}
+
 static void prv_add_bool_prop(GVariantBuilder *vb, const gchar *key,
 			      gboolean value)
 {
@@ -599,14 +705,16 @@ static void prv_parse_resources(GVariantBuilder *item_vb,
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_DLNA_PROFILE) {
 		str_val = gupnp_protocol_info_get_dlna_profile(protocol_info);
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_DLNA_PROFILE,
-				    str_val);
+		prv_add_interned_string_prop(item_vb,
+					     MSU_INTERFACE_PROP_DLNA_PROFILE,
+					     str_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_MIME_TYPE) {
 		str_val = gupnp_protocol_info_get_mime_type(protocol_info);
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_MIME_TYPE,
-				    str_val);
+		prv_add_interned_string_prop(item_vb,
+					     MSU_INTERFACE_PROP_MIME_TYPE,
+					     str_val);
 	}
 }
 
@@ -698,12 +806,12 @@ gboolean msu_props_add_object(GVariantBuilder *item_vb,
 		prv_add_path_prop(item_vb, MSU_INTERFACE_PROP_PATH, path);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_PARENT)
-		prv_add_path_prop(item_vb, MSU_INTERFACE_PROP_PARENT,
-				  parent_path);
+		prv_add_interned_path_prop(item_vb, MSU_INTERFACE_PROP_PARENT,
+					   parent_path);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_TYPE)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_TYPE,
-				    media_spec_type);
+		prv_add_interned_string_prop(item_vb, MSU_INTERFACE_PROP_TYPE,
+					     media_spec_type);
 
 	retval = TRUE;
 
@@ -806,20 +914,24 @@ void msu_props_add_item(GVariantBuilder *item_vb,
 	const char *str_val;
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_ARTIST)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_ARTIST,
-				    gupnp_didl_lite_object_get_artist(object));
+		prv_add_interned_string_prop(
+			item_vb, MSU_INTERFACE_PROP_ARTIST,
+			gupnp_didl_lite_object_get_artist(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_ALBUM)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_ALBUM,
-				    gupnp_didl_lite_object_get_album(object));
+		prv_add_interned_string_prop(
+			item_vb, MSU_INTERFACE_PROP_ALBUM,
+			gupnp_didl_lite_object_get_album(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_DATE)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_DATE,
-				    gupnp_didl_lite_object_get_date(object));
+		prv_add_interned_string_prop(
+			item_vb, MSU_INTERFACE_PROP_DATE,
+			gupnp_didl_lite_object_get_date(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_GENRE)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_GENRE,
-				    gupnp_didl_lite_object_get_genre(object));
+		prv_add_interned_string_prop(
+			item_vb, MSU_INTERFACE_PROP_GENRE,
+			gupnp_didl_lite_object_get_genre(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_TRACK_NUMBER) {
 		track_number = gupnp_didl_lite_object_get_track_number(object);
@@ -50,21 +50,38 @@ enum msu_upnp_prop_mask_ {
 	MSU_UPNP_MASK_PROP_COLOR_DEPTH = 1 << 21,
 	MSU_UPNP_MASK_PROP_ALBUM_ART_URL = 1 << 22,
 	MSU_UPNP_MASK_PROP_RESOURCES = 1 << 23,
-	MSU_UPNP_MASK_PROP_URL = 1 << 24
+	MSU_UPNP_MASK_PROP_URL = 1 << 24,
+	MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID = 1 << 25
 };
 typedef enum msu_upnp_prop_mask_ msu_upnp_prop_mask;
 
+#define MSU_PROPS_MASK_OBJECT (MSU_UPNP_MASK_PROP_PARENT | \
+			       MSU_UPNP_MASK_PROP_TYPE | \
+			       MSU_UPNP_MASK_PROP_PATH | \
+			       MSU_UPNP_MASK_PROP_DISPLAY_NAME)
+
+#define MSU_PROPS_MASK_CONTAINER (MSU_UPNP_MASK_PROP_CHILD_COUNT | \
+				  MSU_UPNP_MASK_PROP_SEARCHABLE | \
+				  MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID)
+
+#define MSU_PROPS_MASK_ITEM (~(MSU_PROPS_MASK_OBJECT | \
+			       MSU_PROPS_MASK_CONTAINER))
+
 typedef struct msu_prop_map_t_ msu_prop_map_t;
 struct msu_prop_map_t_ {
+	const gchar *prop_name;
 	const gchar *upnp_prop_name;
 	msu_upnp_prop_mask type;
 	gboolean filter;
 	gboolean searchable;
 };
 
-GHashTable *msu_prop_maps_new(void);
-guint32 msu_props_parse_filter(GHashTable *filter_map, GVariant *filter,
-			       gchar **upnp_filter);
+const msu_prop_map_t *msu_props_lookup(const gchar *prop_name);
+GHashTable *msu_props_filter_cache_new(void);
+guint32 msu_props_parse_filter(GHashTable *filter_cache, GVariant *filter,
+			       const gchar **upnp_filter);
+const gchar *msu_props_get_interface_filter(GHashTable *filter_cache,
+					    const gchar *interface_name);
 void msu_props_add_device(GUPnPDeviceInfo *proxy, GVariantBuilder *vb);
 GVariant *msu_props_get_device_prop(GUPnPDeviceInfo *proxy, const gchar *prop);
 
@@ -82,6 +99,10 @@ void msu_props_add_container(GVariantBuilder *item_vb,
 			     gboolean *have_child_count);
 
 void msu_props_add_child_count(GVariantBuilder *item_vb, gint value);
+void msu_props_add_intern_statistics(GVariantBuilder *vb);
+void msu_props_intern_clear(void);
+void msu_props_add_container_update_id(GVariantBuilder *item_vb,
+				       guint value);
 GVariant *msu_props_get_container_prop(const gchar *prop,
 				       GUPnPDIDLLiteObject *object);
 
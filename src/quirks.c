@@ -0,0 +1,261 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#include <string.h>
+
+#include "log.h"
+#include "quirks.h"
+
+#define MSU_QUIRKS_FILE_NAME "media-service-upnp-servers"
+
+/* Records are written out some time after they change so that a burst
+   of lessons learned from one browse costs a single write. */
+
+#define MSU_QUIRKS_SAVE_DELAY 10
+
+#define MSU_QUIRKS_KEY_PAGE_CAP "page-cap"
+#define MSU_QUIRKS_KEY_CHILD_COUNT "child-count"
+#define MSU_QUIRKS_KEY_SORT_CAPS "sort-caps"
+#define MSU_QUIRKS_KEY_SEARCH_CAPS "search-caps"
+
+struct msu_quirks_t_ {
+	GKeyFile *keyfile;
+	gchar *path;
+	guint save_id;
+};
+
+static void prv_quirks_save(msu_quirks_t *quirks)
+{
+	gchar *data;
+	gsize length;
+	GError *error = NULL;
+
+	data = g_key_file_to_data(quirks->keyfile, &length, NULL);
+
+	if (!g_file_set_contents(quirks->path, data, length, &error)) {
+		MSU_LOG_WARNING("Unable to save %s: %s", quirks->path,
+				error->message);
+		g_error_free(error);
+	}
+
+	g_free(data);
+}
+
+static gboolean prv_quirks_save_cb(gpointer user_data)
+{
+	msu_quirks_t *quirks = user_data;
+
+	quirks->save_id = 0;
+	prv_quirks_save(quirks);
+
+	return FALSE;
+}
+
+void msu_quirks_new(msu_quirks_t **quirks)
+{
+	msu_quirks_t *q = g_new0(msu_quirks_t, 1);
+	const gchar *dir;
+
+	dir = g_get_user_cache_dir();
+	(void) g_mkdir_with_parents(dir, 0700);
+	q->path = g_build_filename(dir, MSU_QUIRKS_FILE_NAME, NULL);
+
+	/* A missing or damaged file only means that servers have to be
+	   learned again. */
+
+	q->keyfile = g_key_file_new();
+	if (!g_key_file_load_from_file(q->keyfile, q->path, G_KEY_FILE_NONE,
+				       NULL))
+		MSU_LOG_DEBUG("No server records in %s", q->path);
+
+	*quirks = q;
+}
+
+void msu_quirks_delete(msu_quirks_t *quirks)
+{
+	if (quirks) {
+		if (quirks->save_id) {
+			(void) g_source_remove(quirks->save_id);
+			prv_quirks_save(quirks);
+		}
+
+		g_key_file_free(quirks->keyfile);
+		g_free(quirks->path);
+		g_free(quirks);
+	}
+}
+
+static gchar *prv_quirks_udn_group(GUPnPDeviceInfo *info)
+{
+	const char *udn = gupnp_device_info_get_udn(info);
+
+	return udn ? g_strdup_printf("udn %s", udn) : NULL;
+}
+
+static gchar *prv_quirks_model_group(GUPnPDeviceInfo *info)
+{
+	gchar *name;
+	gchar *number;
+	gchar *group = NULL;
+
+	/* Servers of the same make and firmware behave alike, so what was
+	   learned from one applies to a new one from the start. */
+
+	name = gupnp_device_info_get_model_name(info);
+	if (!name)
+		goto on_exit;
+
+	number = gupnp_device_info_get_model_number(info);
+	group = g_strdup_printf("model %s %s", name, number ? number : "");
+	g_free(number);
+
+	(void) g_strdelimit(group, "[]\r\n", '_');
+
+on_exit:
+
+	g_free(name);
+
+	return group;
+}
+
+static void prv_quirks_read_group(GKeyFile *keyfile, const gchar *group,
+				  msu_quirks_record_t *record,
+				  gboolean server)
+{
+	GError *error = NULL;
+	gint int_val;
+	gboolean b_val;
+	gchar *str;
+
+	if (!group || !g_key_file_has_group(keyfile, group))
+		return;
+
+	if (server) {
+		int_val = g_key_file_get_integer(keyfile, group,
+						 MSU_QUIRKS_KEY_PAGE_CAP,
+						 &error);
+		if (!error && int_val > 0)
+			record->page_cap = int_val;
+		g_clear_error(&error);
+	}
+
+	b_val = g_key_file_get_boolean(keyfile, group,
+				       MSU_QUIRKS_KEY_CHILD_COUNT, &error);
+	if (!error)
+		record->child_count = b_val ? MSU_QUIRKS_SUPPORTED :
+			MSU_QUIRKS_UNSUPPORTED;
+	g_clear_error(&error);
+
+	str = g_key_file_get_string(keyfile, group, MSU_QUIRKS_KEY_SORT_CAPS,
+				    NULL);
+	if (str) {
+		g_free(record->sort_caps);
+		record->sort_caps = str;
+	}
+
+	str = g_key_file_get_string(keyfile, group,
+				    MSU_QUIRKS_KEY_SEARCH_CAPS, NULL);
+	if (str) {
+		g_free(record->search_caps);
+		record->search_caps = str;
+	}
+}
+
+void msu_quirks_lookup(msu_quirks_t *quirks, GUPnPDeviceInfo *info,
+		       msu_quirks_record_t *record)
+{
+	gchar *group;
+
+	memset(record, 0, sizeof(*record));
+
+	/* The record of the server itself takes precedence over that of
+	   its model. */
+
+	group = prv_quirks_model_group(info);
+	prv_quirks_read_group(quirks->keyfile, group, record, FALSE);
+	g_free(group);
+
+	group = prv_quirks_udn_group(info);
+	prv_quirks_read_group(quirks->keyfile, group, record, TRUE);
+	g_free(group);
+
+	MSU_LOG_DEBUG("Server %s: page cap %u, child count %d",
+		      gupnp_device_info_get_udn(info), record->page_cap,
+		      record->child_count);
+}
+
+static void prv_quirks_write_group(GKeyFile *keyfile, const gchar *group,
+				   const msu_quirks_record_t *record,
+				   gboolean server)
+{
+	if (!group)
+		return;
+
+	/* How many objects a server returns at once can depend on how it
+	   has been set up, so a cap is only ever recorded for the server
+	   it was seen on. */
+
+	if (server && record->page_cap)
+		g_key_file_set_integer(keyfile, group, MSU_QUIRKS_KEY_PAGE_CAP,
+				       record->page_cap);
+
+	if (record->child_count != MSU_QUIRKS_UNKNOWN)
+		g_key_file_set_boolean(keyfile, group,
+				       MSU_QUIRKS_KEY_CHILD_COUNT,
+				       record->child_count ==
+				       MSU_QUIRKS_SUPPORTED);
+
+	if (record->sort_caps)
+		g_key_file_set_string(keyfile, group, MSU_QUIRKS_KEY_SORT_CAPS,
+				      record->sort_caps);
+
+	if (record->search_caps)
+		g_key_file_set_string(keyfile, group,
+				      MSU_QUIRKS_KEY_SEARCH_CAPS,
+				      record->search_caps);
+}
+
+void msu_quirks_update(msu_quirks_t *quirks, GUPnPDeviceInfo *info,
+		       const msu_quirks_record_t *record)
+{
+	gchar *group;
+
+	group = prv_quirks_udn_group(info);
+	prv_quirks_write_group(quirks->keyfile, group, record, TRUE);
+	g_free(group);
+
+	group = prv_quirks_model_group(info);
+	prv_quirks_write_group(quirks->keyfile, group, record, FALSE);
+	g_free(group);
+
+	if (!quirks->save_id)
+		quirks->save_id = g_timeout_add_seconds(MSU_QUIRKS_SAVE_DELAY,
+							prv_quirks_save_cb,
+							quirks);
+}
+
+void msu_quirks_record_clear(msu_quirks_record_t *record)
+{
+	g_free(record->sort_caps);
+	g_free(record->search_caps);
+	memset(record, 0, sizeof(*record));
+}
@@ -0,0 +1,54 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#ifndef MSU_QUIRKS_H__
+#define MSU_QUIRKS_H__
+
+#include <libgupnp/gupnp-control-point.h>
+
+typedef struct msu_quirks_t_ msu_quirks_t;
+
+enum msu_quirks_support_t_ {
+	MSU_QUIRKS_UNKNOWN,
+	MSU_QUIRKS_SUPPORTED,
+	MSU_QUIRKS_UNSUPPORTED
+};
+typedef enum msu_quirks_support_t_ msu_quirks_support_t;
+
+typedef struct msu_quirks_record_t_ msu_quirks_record_t;
+struct msu_quirks_record_t_ {
+	guint page_cap;
+	msu_quirks_support_t child_count;
+	gchar *sort_caps;
+	gchar *search_caps;
+};
+
+void msu_quirks_new(msu_quirks_t **quirks);
+void msu_quirks_delete(msu_quirks_t *quirks);
+
+void msu_quirks_lookup(msu_quirks_t *quirks, GUPnPDeviceInfo *info,
+		       msu_quirks_record_t *record);
+void msu_quirks_update(msu_quirks_t *quirks, GUPnPDeviceInfo *info,
+		       const msu_quirks_record_t *record);
+void msu_quirks_record_clear(msu_quirks_record_t *record);
+
+#endif
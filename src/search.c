@@ -27,8 +27,7 @@
 #include "props.h"
 #include "search.h"
 
-gchar *msu_search_translate_search_string(GHashTable *filter_map,
-					  const gchar *search_string)
+gchar *msu_search_translate_search_string(const gchar *search_string)
 {
 	GRegex *reg;
 	gchar *retval = NULL;
@@ -37,7 +36,7 @@ gchar *msu_search_translate_search_string(GHashTable *filter_map,
 	gchar *op = NULL;
 	gchar *value = NULL;
 	const gchar *translated_value;
-	msu_prop_map_t *prop_map;
+	const msu_prop_map_t *prop_map;
 	GString *str;
 	gint start_pos;
 	gint end_pos;
@@ -92,7 +91,7 @@ gchar *msu_search_translate_search_string(GHashTable *filter_map,
 			g_free(id);
 		}
 
-		prop_map = g_hash_table_lookup(filter_map, prop);
+		prop_map = msu_props_lookup(prop);
 		if (!prop_map)
 			goto on_error;
 
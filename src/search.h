@@ -25,7 +25,6 @@
 
 #include <glib.h>
 
-gchar *msu_search_translate_search_string(GHashTable *filter_map,
-					  const gchar *search_string);
+gchar *msu_search_translate_search_string(const gchar *search_string);
 
 #endif
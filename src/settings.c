@@ -23,12 +23,15 @@
 #include <string.h>
 
 #include "settings.h"
+#include "trace.h"
 
 struct msu_settings_context_t_ {
 	GKeyFile *keyfile;
 	GFileMonitor *monitor;
 	gulong handler_id;
 	guint ev_id;
+	msu_settings_changed_t changed_cb;
+	void *changed_data;
 
 	/* Global section */
 	gboolean never_quit;
@@ -36,6 +39,29 @@ struct msu_settings_context_t_ {
 	/* Log section */
 	msu_log_type_t log_type;
 	int log_level;
+	gboolean trace;
+
+	/* Performance section */
+	gboolean prefetch;
+	guint prefetch_children;
+	guint prefetch_max_actions;
+	guint cache_size;
+	guint cache_ttl;
+	guint client_queue_limit;
+	gboolean index;
+	guint index_interval;
+	guint index_page_size;
+	guint browse_page_size;
+	guint browse_max_actions;
+	guint event_idle_timeout;
+	guint event_retry_limit;
+	guint event_lost_cache_ttl;
+	guint lost_server_grace;
+	guint server_actions_min;
+	guint server_actions_max;
+	guint hedge_percent;
+	guint rate;
+	guint rate_burst;
 };
 
 #define MSU_SETTINGS_KEYFILE_NAME	"media-service-upnp.conf"
@@ -46,10 +72,60 @@ struct msu_settings_context_t_ {
 #define MSU_SETTINGS_GROUP_LOG		"log"
 #define MSU_SETTINGS_KEY_LOG_TYPE	"log-type"
 #define MSU_SETTINGS_KEY_LOG_LEVEL	"log-level"
+#define MSU_SETTINGS_KEY_TRACE		"trace"
+
+#define MSU_SETTINGS_GROUP_PERFORMANCE		"performance"
+#define MSU_SETTINGS_KEY_PREFETCH		"prefetch"
+#define MSU_SETTINGS_KEY_PREFETCH_CHILDREN	"prefetch-children"
+#define MSU_SETTINGS_KEY_PREFETCH_MAX_ACTIONS	"prefetch-max-actions"
+#define MSU_SETTINGS_KEY_CACHE_SIZE		"cache-size"
+#define MSU_SETTINGS_KEY_CACHE_TTL		"cache-ttl"
+#define MSU_SETTINGS_KEY_CLIENT_QUEUE_LIMIT	"client-queue-limit"
+#define MSU_SETTINGS_KEY_INDEX			"index"
+#define MSU_SETTINGS_KEY_INDEX_INTERVAL		"index-interval"
+#define MSU_SETTINGS_KEY_INDEX_PAGE_SIZE	"index-page-size"
+#define MSU_SETTINGS_KEY_BROWSE_PAGE_SIZE	"browse-page-size"
+#define MSU_SETTINGS_KEY_BROWSE_MAX_ACTIONS	"browse-max-actions"
+#define MSU_SETTINGS_KEY_EVENT_IDLE_TIMEOUT	"event-idle-timeout"
+#define MSU_SETTINGS_KEY_EVENT_RETRY_LIMIT	"event-retry-limit"
+#define MSU_SETTINGS_KEY_EVENT_LOST_CACHE_TTL	"event-lost-cache-ttl"
+#define MSU_SETTINGS_KEY_LOST_SERVER_GRACE	"lost-server-grace"
+#define MSU_SETTINGS_KEY_SERVER_ACTIONS_MIN	"server-actions-min"
+#define MSU_SETTINGS_KEY_SERVER_ACTIONS_MAX	"server-actions-max"
+#define MSU_SETTINGS_KEY_HEDGE_PERCENT		"hedge-percent"
+#define MSU_SETTINGS_KEY_RATE			"rate"
+#define MSU_SETTINGS_KEY_RATE_BURST		"rate-burst"
+
+/* Per server overrides live in groups named after the server's UDN, e.g.
+   [server uuid:4d696e69-444c-164e-9d41-001a4b3b2b2f] */
+
+#define MSU_SETTINGS_GROUP_SERVER		"server "
 
 #define MSU_SETTINGS_DEFAULT_NEVER_QUIT	MSU_NEVER_QUIT
 #define MSU_SETTINGS_DEFAULT_LOG_TYPE	MSU_LOG_TYPE
 #define MSU_SETTINGS_DEFAULT_LOG_LEVEL	MSU_LOG_LEVEL
+#define MSU_SETTINGS_DEFAULT_TRACE	FALSE
+
+#define MSU_SETTINGS_DEFAULT_PREFETCH			FALSE
+#define MSU_SETTINGS_DEFAULT_PREFETCH_CHILDREN		2
+#define MSU_SETTINGS_DEFAULT_PREFETCH_MAX_ACTIONS	1
+#define MSU_SETTINGS_DEFAULT_CACHE_SIZE			128
+#define MSU_SETTINGS_DEFAULT_CACHE_TTL			30
+#define MSU_SETTINGS_DEFAULT_CLIENT_QUEUE_LIMIT		256
+#define MSU_SETTINGS_DEFAULT_INDEX			FALSE
+#define MSU_SETTINGS_DEFAULT_INDEX_INTERVAL		500
+#define MSU_SETTINGS_DEFAULT_INDEX_PAGE_SIZE		64
+#define MSU_SETTINGS_DEFAULT_BROWSE_PAGE_SIZE		256
+#define MSU_SETTINGS_DEFAULT_BROWSE_MAX_ACTIONS		2
+#define MSU_SETTINGS_DEFAULT_EVENT_IDLE_TIMEOUT		300
+#define MSU_SETTINGS_DEFAULT_EVENT_RETRY_LIMIT		6
+#define MSU_SETTINGS_DEFAULT_EVENT_LOST_CACHE_TTL	5
+#define MSU_SETTINGS_DEFAULT_LOST_SERVER_GRACE		60
+#define MSU_SETTINGS_DEFAULT_SERVER_ACTIONS_MIN		1
+#define MSU_SETTINGS_DEFAULT_SERVER_ACTIONS_MAX		8
+#define MSU_SETTINGS_DEFAULT_HEDGE_PERCENT		0
+#define MSU_SETTINGS_DEFAULT_RATE			0
+#define MSU_SETTINGS_DEFAULT_RATE_BURST			10
 
 #define MSU_SETTINGS_LOG_KEYS(sys, loc, settings) \
 do { \
@@ -62,9 +138,111 @@ do { \
 	MSU_LOG_DEBUG("[Logging settings]"); \
 	MSU_LOG_DEBUG("Log Type : %d", (settings)->log_type); \
 	MSU_LOG_DEBUG("Log Level: 0x%02X", (settings)->log_level); \
+	MSU_LOG_DEBUG("Trace: %s", (settings)->trace ? "T" : "F"); \
+	MSU_LOG_DEBUG_NL(); \
+	MSU_LOG_DEBUG("[Performance settings]"); \
+	MSU_LOG_DEBUG("Prefetch: %s", (settings)->prefetch ? "T" : "F"); \
+	MSU_LOG_DEBUG("Prefetch Children: %u", (settings)->prefetch_children); \
+	MSU_LOG_DEBUG("Prefetch Max Actions: %u", \
+		      (settings)->prefetch_max_actions); \
+	MSU_LOG_DEBUG("Cache Size: %u", (settings)->cache_size); \
+	MSU_LOG_DEBUG("Cache TTL: %u", (settings)->cache_ttl); \
+	MSU_LOG_DEBUG("Client Queue Limit: %u", \
+		      (settings)->client_queue_limit); \
+	MSU_LOG_DEBUG("Index: %s", (settings)->index ? "T" : "F"); \
+	MSU_LOG_DEBUG("Index Interval: %u", (settings)->index_interval); \
+	MSU_LOG_DEBUG("Index Page Size: %u", (settings)->index_page_size); \
+	MSU_LOG_DEBUG("Browse Page Size: %u", (settings)->browse_page_size); \
+	MSU_LOG_DEBUG("Browse Max Actions: %u", \
+		      (settings)->browse_max_actions); \
+	MSU_LOG_DEBUG("Event Idle Timeout: %u", \
+		      (settings)->event_idle_timeout); \
+	MSU_LOG_DEBUG("Event Retry Limit: %u", \
+		      (settings)->event_retry_limit); \
+	MSU_LOG_DEBUG("Event Lost Cache TTL: %u", \
+		      (settings)->event_lost_cache_ttl); \
+	MSU_LOG_DEBUG("Lost Server Grace: %u", \
+		      (settings)->lost_server_grace); \
+	MSU_LOG_DEBUG("Server Actions Min: %u", \
+		      (settings)->server_actions_min); \
+	MSU_LOG_DEBUG("Server Actions Max: %u", \
+		      (settings)->server_actions_max); \
+	MSU_LOG_DEBUG("Hedge Percent: %u", (settings)->hedge_percent); \
+	MSU_LOG_DEBUG("Rate: %u", (settings)->rate); \
+	MSU_LOG_DEBUG("Rate Burst: %u", (settings)->rate_burst); \
 	MSU_LOG_DEBUG_NL(); \
 } while (0)
 
+/* The numeric performance settings, with the range of values each may
+   take.  Values read from the file that fall outside it are replaced
+   by the default. */
+
+typedef struct msu_settings_uint_t_ msu_settings_uint_t;
+struct msu_settings_uint_t_ {
+	const gchar *key;
+	gsize offset;
+	guint def;
+	guint min;
+	guint max;
+};
+
+#define MSU_SETTINGS_UINT(key, field, def, min, max) \
+	{ key, G_STRUCT_OFFSET(msu_settings_context_t, field), def, min, max }
+
+static const msu_settings_uint_t g_msu_settings_uints[] = {
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_PREFETCH_CHILDREN,
+			  prefetch_children,
+			  MSU_SETTINGS_DEFAULT_PREFETCH_CHILDREN, 0, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_PREFETCH_MAX_ACTIONS,
+			  prefetch_max_actions,
+			  MSU_SETTINGS_DEFAULT_PREFETCH_MAX_ACTIONS, 0,
+			  G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_CACHE_SIZE, cache_size,
+			  MSU_SETTINGS_DEFAULT_CACHE_SIZE, 0, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_CACHE_TTL, cache_ttl,
+			  MSU_SETTINGS_DEFAULT_CACHE_TTL, 0, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_CLIENT_QUEUE_LIMIT,
+			  client_queue_limit,
+			  MSU_SETTINGS_DEFAULT_CLIENT_QUEUE_LIMIT, 1, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_INDEX_INTERVAL, index_interval,
+			  MSU_SETTINGS_DEFAULT_INDEX_INTERVAL, 1, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_INDEX_PAGE_SIZE, index_page_size,
+			  MSU_SETTINGS_DEFAULT_INDEX_PAGE_SIZE, 1, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_BROWSE_PAGE_SIZE, browse_page_size,
+			  MSU_SETTINGS_DEFAULT_BROWSE_PAGE_SIZE, 1, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_BROWSE_MAX_ACTIONS,
+			  browse_max_actions,
+			  MSU_SETTINGS_DEFAULT_BROWSE_MAX_ACTIONS, 1, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_EVENT_IDLE_TIMEOUT,
+			  event_idle_timeout,
+			  MSU_SETTINGS_DEFAULT_EVENT_IDLE_TIMEOUT, 0, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_EVENT_RETRY_LIMIT,
+			  event_retry_limit,
+			  MSU_SETTINGS_DEFAULT_EVENT_RETRY_LIMIT, 0, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_EVENT_LOST_CACHE_TTL,
+			  event_lost_cache_ttl,
+			  MSU_SETTINGS_DEFAULT_EVENT_LOST_CACHE_TTL, 0,
+			  G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_LOST_SERVER_GRACE,
+			  lost_server_grace,
+			  MSU_SETTINGS_DEFAULT_LOST_SERVER_GRACE, 0, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_SERVER_ACTIONS_MIN,
+			  server_actions_min,
+			  MSU_SETTINGS_DEFAULT_SERVER_ACTIONS_MIN, 1, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_SERVER_ACTIONS_MAX,
+			  server_actions_max,
+			  MSU_SETTINGS_DEFAULT_SERVER_ACTIONS_MAX, 1, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_HEDGE_PERCENT, hedge_percent,
+			  MSU_SETTINGS_DEFAULT_HEDGE_PERCENT, 0, 100),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_RATE, rate,
+			  MSU_SETTINGS_DEFAULT_RATE, 0, G_MAXINT),
+	MSU_SETTINGS_UINT(MSU_SETTINGS_KEY_RATE_BURST, rate_burst,
+			  MSU_SETTINGS_DEFAULT_RATE_BURST, 1, G_MAXINT)
+};
+
+#define MSU_SETTINGS_UINT_FIELD(settings, entry) \
+	G_STRUCT_MEMBER(guint, settings, (entry)->offset)
+
 
 static void prv_msu_settings_get_keyfile_path(gchar **sys_path,
 					      gchar **loc_path)
@@ -172,6 +350,9 @@ static msu_log_type_t prv_msu_settings_to_log_type(int type)
 	case 1:
 		log_type = MSU_LOG_TYPE_GLIB;
 		break;
+	case 2:
+		log_type = MSU_LOG_TYPE_FILE;
+		break;
 	default:
 		break;
 	}
@@ -179,6 +360,22 @@ static msu_log_type_t prv_msu_settings_to_log_type(int type)
 	return log_type;
 }
 
+static void prv_msu_settings_read_uint(GKeyFile *keyfile, const gchar *group,
+				       const gchar *key, guint *value)
+{
+	GError *error = NULL;
+	gint int_val;
+
+	int_val = g_key_file_get_integer(keyfile, group, key, &error);
+
+	if (error == NULL) {
+		if (int_val >= 0)
+			*value = int_val;
+	} else {
+		g_error_free(error);
+	}
+}
+
 static void prv_msu_settings_read_keys(msu_settings_context_t *settings)
 {
 	GError *error = NULL;
@@ -187,6 +384,7 @@ static void prv_msu_settings_read_keys(msu_settings_context_t *settings)
 	gint int_val;
 	gint *int_star;
 	gsize length;
+	guint i;
 
 	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_GENERAL,
 						MSU_SETTINGS_KEY_NEVER_QUIT,
@@ -225,14 +423,123 @@ static void prv_msu_settings_read_keys(msu_settings_context_t *settings)
 		g_error_free(error);
 		error = NULL;
 	}
+
+	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_LOG,
+				       MSU_SETTINGS_KEY_TRACE, &error);
+
+	if (error == NULL)
+		settings->trace = b_val;
+	else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_PERFORMANCE,
+				       MSU_SETTINGS_KEY_PREFETCH, &error);
+
+	if (error == NULL)
+		settings->prefetch = b_val;
+	else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_PERFORMANCE,
+				       MSU_SETTINGS_KEY_INDEX, &error);
+
+	if (error == NULL)
+		settings->index = b_val;
+	else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(g_msu_settings_uints); ++i)
+		prv_msu_settings_read_uint(
+			keyfile, MSU_SETTINGS_GROUP_PERFORMANCE,
+			g_msu_settings_uints[i].key,
+			&MSU_SETTINGS_UINT_FIELD(settings,
+						 &g_msu_settings_uints[i]));
 }
 
 static void prv_msu_settings_init_default(msu_settings_context_t *settings)
 {
+	guint i;
+
 	settings->never_quit = MSU_SETTINGS_DEFAULT_NEVER_QUIT;
 
 	settings->log_type = MSU_SETTINGS_DEFAULT_LOG_TYPE;
 	settings->log_level = MSU_SETTINGS_DEFAULT_LOG_LEVEL;
+	settings->trace = MSU_SETTINGS_DEFAULT_TRACE;
+
+	settings->prefetch = MSU_SETTINGS_DEFAULT_PREFETCH;
+	settings->index = MSU_SETTINGS_DEFAULT_INDEX;
+
+	for (i = 0; i < G_N_ELEMENTS(g_msu_settings_uints); ++i)
+		MSU_SETTINGS_UINT_FIELD(settings, &g_msu_settings_uints[i]) =
+			g_msu_settings_uints[i].def;
+}
+
+static void prv_msu_settings_validate(msu_settings_context_t *settings)
+{
+	const msu_settings_uint_t *entry;
+	guint *value;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(g_msu_settings_uints); ++i) {
+		entry = &g_msu_settings_uints[i];
+		value = &MSU_SETTINGS_UINT_FIELD(settings, entry);
+
+		if (*value < entry->min || *value > entry->max) {
+			MSU_LOG_WARNING("%s=%u is out of range, using %u",
+					entry->key, *value, entry->def);
+			*value = entry->def;
+		}
+	}
+
+	if (settings->server_actions_max < settings->server_actions_min) {
+		MSU_LOG_WARNING("%s is below %s, using %u",
+				MSU_SETTINGS_KEY_SERVER_ACTIONS_MAX,
+				MSU_SETTINGS_KEY_SERVER_ACTIONS_MIN,
+				settings->server_actions_min);
+		settings->server_actions_max = settings->server_actions_min;
+	}
+}
+
+static void prv_msu_settings_log_bool(const gchar *key, gboolean old_val,
+				      gboolean new_val)
+{
+	if (old_val != new_val)
+		MSU_LOG_INFO("%s: %s -> %s", key, old_val ? "T" : "F",
+			     new_val ? "T" : "F");
+}
+
+static void prv_msu_settings_log_changes(msu_settings_context_t *old,
+					 msu_settings_context_t *settings)
+{
+	const msu_settings_uint_t *entry;
+	guint old_val;
+	guint new_val;
+	guint i;
+
+	prv_msu_settings_log_bool(MSU_SETTINGS_KEY_NEVER_QUIT,
+				  old->never_quit, settings->never_quit);
+	prv_msu_settings_log_bool(MSU_SETTINGS_KEY_TRACE, old->trace,
+				  settings->trace);
+	prv_msu_settings_log_bool(MSU_SETTINGS_KEY_PREFETCH, old->prefetch,
+				  settings->prefetch);
+	prv_msu_settings_log_bool(MSU_SETTINGS_KEY_INDEX, old->index,
+				  settings->index);
+
+	for (i = 0; i < G_N_ELEMENTS(g_msu_settings_uints); ++i) {
+		entry = &g_msu_settings_uints[i];
+		old_val = MSU_SETTINGS_UINT_FIELD(old, entry);
+		new_val = MSU_SETTINGS_UINT_FIELD(settings, entry);
+
+		if (old_val != new_val)
+			MSU_LOG_INFO("%s: %u -> %u", entry->key, old_val,
+				     new_val);
+	}
 }
 
 static void prv_msu_settings_keyfile_init(msu_settings_context_t *settings,
@@ -246,8 +553,10 @@ static void prv_msu_settings_keyfile_init(msu_settings_context_t *settings,
 
 	if (settings->keyfile != NULL) {
 		prv_msu_settings_read_keys(settings);
+		prv_msu_settings_validate(settings);
 		msu_log_update_type_level(settings->log_type,
 					  settings->log_level);
+		msu_trace_enable(settings->trace);
 	}
 }
 
@@ -263,9 +572,12 @@ static void prv_msu_settings_reload(msu_settings_context_t *settings)
 {
 	gchar *sys_path = NULL;
 	gchar *loc_path = NULL;
+	msu_settings_context_t old;
 
 	MSU_LOG_INFO("Reload local configuration file");
 
+	old = *settings;
+
 	prv_msu_settings_keyfile_finalize(settings);
 	prv_msu_settings_init_default(settings);
 	prv_msu_settings_get_keyfile_path(&sys_path, &loc_path);
@@ -274,9 +586,16 @@ static void prv_msu_settings_reload(msu_settings_context_t *settings)
 		prv_msu_settings_keyfile_init(settings, sys_path, loc_path);
 
 	MSU_SETTINGS_LOG_KEYS(sys_path, loc_path, settings);
+	prv_msu_settings_log_changes(&old, settings);
 
 	g_free(sys_path);
 	g_free(loc_path);
+
+	/* Whoever uses the settings applies the new values to the objects
+	   that already exist.  Requests in progress are left to finish. */
+
+	if (settings->changed_cb)
+		settings->changed_cb(settings, settings->changed_data);
 }
 
 static gboolean prv_msu_settings_monitor_timout_cb(gpointer user_data)
@@ -345,6 +664,152 @@ gboolean msu_settings_is_never_quit(msu_settings_context_t *settings)
 	return settings->never_quit;
 }
 
+gboolean msu_settings_is_prefetch(msu_settings_context_t *settings)
+{
+	return settings->prefetch;
+}
+
+guint msu_settings_get_prefetch_children(msu_settings_context_t *settings)
+{
+	return settings->prefetch_children;
+}
+
+guint msu_settings_get_prefetch_max_actions(msu_settings_context_t *settings)
+{
+	return settings->prefetch_max_actions;
+}
+
+guint msu_settings_get_cache_size(msu_settings_context_t *settings)
+{
+	return settings->cache_size;
+}
+
+guint msu_settings_get_cache_ttl(msu_settings_context_t *settings)
+{
+	return settings->cache_ttl;
+}
+
+guint msu_settings_get_client_queue_limit(msu_settings_context_t *settings)
+{
+	return settings->client_queue_limit;
+}
+
+gboolean msu_settings_is_index(msu_settings_context_t *settings)
+{
+	return settings->index;
+}
+
+guint msu_settings_get_index_interval(msu_settings_context_t *settings)
+{
+	return settings->index_interval;
+}
+
+guint msu_settings_get_index_page_size(msu_settings_context_t *settings)
+{
+	return settings->index_page_size;
+}
+
+guint msu_settings_get_browse_page_size(msu_settings_context_t *settings)
+{
+	return settings->browse_page_size;
+}
+
+guint msu_settings_get_browse_max_actions(msu_settings_context_t *settings)
+{
+	return settings->browse_max_actions;
+}
+
+guint msu_settings_get_event_idle_timeout(msu_settings_context_t *settings)
+{
+	return settings->event_idle_timeout;
+}
+
+guint msu_settings_get_event_retry_limit(msu_settings_context_t *settings)
+{
+	return settings->event_retry_limit;
+}
+
+guint msu_settings_get_event_lost_cache_ttl(msu_settings_context_t *settings)
+{
+	return settings->event_lost_cache_ttl;
+}
+
+guint msu_settings_get_lost_server_grace(msu_settings_context_t *settings)
+{
+	return settings->lost_server_grace;
+}
+
+guint msu_settings_get_server_actions_min(msu_settings_context_t *settings)
+{
+	return settings->server_actions_min;
+}
+
+guint msu_settings_get_server_actions_max(msu_settings_context_t *settings)
+{
+	return settings->server_actions_max;
+}
+
+guint msu_settings_get_hedge_percent(msu_settings_context_t *settings)
+{
+	return settings->hedge_percent;
+}
+
+void msu_settings_get_server_rate(msu_settings_context_t *settings,
+				  const gchar *udn, guint *rate, guint *burst)
+{
+	gchar *group;
+
+	*rate = settings->rate;
+	*burst = settings->rate_burst;
+
+	if (!settings->keyfile || !udn)
+		return;
+
+	group = g_strconcat(MSU_SETTINGS_GROUP_SERVER, udn, NULL);
+
+	prv_msu_settings_read_uint(settings->keyfile, group,
+				   MSU_SETTINGS_KEY_RATE, rate);
+	prv_msu_settings_read_uint(settings->keyfile, group,
+				   MSU_SETTINGS_KEY_RATE_BURST, burst);
+
+	g_free(group);
+}
+
+GVariant *msu_settings_get_values(msu_settings_context_t *settings)
+{
+	GVariantBuilder vb;
+	const msu_settings_uint_t *entry;
+	guint i;
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("a{sv}"));
+
+	g_variant_builder_add(&vb, "{sv}", MSU_SETTINGS_KEY_NEVER_QUIT,
+			      g_variant_new_boolean(settings->never_quit));
+	g_variant_builder_add(&vb, "{sv}", MSU_SETTINGS_KEY_TRACE,
+			      g_variant_new_boolean(settings->trace));
+	g_variant_builder_add(&vb, "{sv}", MSU_SETTINGS_KEY_PREFETCH,
+			      g_variant_new_boolean(settings->prefetch));
+	g_variant_builder_add(&vb, "{sv}", MSU_SETTINGS_KEY_INDEX,
+			      g_variant_new_boolean(settings->index));
+
+	for (i = 0; i < G_N_ELEMENTS(g_msu_settings_uints); ++i) {
+		entry = &g_msu_settings_uints[i];
+		g_variant_builder_add(&vb, "{sv}", entry->key,
+				      g_variant_new_uint32(
+					      MSU_SETTINGS_UINT_FIELD(settings,
+								      entry)));
+	}
+
+	return g_variant_builder_end(&vb);
+}
+
+void msu_settings_set_changed_cb(msu_settings_context_t *settings,
+				 msu_settings_changed_t cb, void *user_data)
+{
+	settings->changed_cb = cb;
+	settings->changed_data = user_data;
+}
+
 void msu_settings_new(msu_settings_context_t **settings)
 {
 	gchar *sys_path = NULL;
@@ -30,9 +30,38 @@
 
 typedef struct msu_settings_context_t_ msu_settings_context_t;
 
+typedef void (*msu_settings_changed_t)(msu_settings_context_t *settings,
+				       void *user_data);
+
 void msu_settings_new(msu_settings_context_t **settings);
 void msu_settings_delete(msu_settings_context_t *settings);
 
 gboolean msu_settings_is_never_quit(msu_settings_context_t *settings);
 
+gboolean msu_settings_is_prefetch(msu_settings_context_t *settings);
+guint msu_settings_get_prefetch_children(msu_settings_context_t *settings);
+guint msu_settings_get_prefetch_max_actions(msu_settings_context_t *settings);
+guint msu_settings_get_cache_size(msu_settings_context_t *settings);
+guint msu_settings_get_cache_ttl(msu_settings_context_t *settings);
+guint msu_settings_get_client_queue_limit(msu_settings_context_t *settings);
+gboolean msu_settings_is_index(msu_settings_context_t *settings);
+guint msu_settings_get_index_interval(msu_settings_context_t *settings);
+guint msu_settings_get_index_page_size(msu_settings_context_t *settings);
+guint msu_settings_get_browse_page_size(msu_settings_context_t *settings);
+guint msu_settings_get_browse_max_actions(msu_settings_context_t *settings);
+guint msu_settings_get_event_idle_timeout(msu_settings_context_t *settings);
+guint msu_settings_get_event_retry_limit(msu_settings_context_t *settings);
+guint msu_settings_get_event_lost_cache_ttl(msu_settings_context_t *settings);
+guint msu_settings_get_lost_server_grace(msu_settings_context_t *settings);
+guint msu_settings_get_server_actions_min(msu_settings_context_t *settings);
+guint msu_settings_get_server_actions_max(msu_settings_context_t *settings);
+guint msu_settings_get_hedge_percent(msu_settings_context_t *settings);
+void msu_settings_get_server_rate(msu_settings_context_t *settings,
+				  const gchar *udn, guint *rate, guint *burst);
+
+GVariant *msu_settings_get_values(msu_settings_context_t *settings);
+
+void msu_settings_set_changed_cb(msu_settings_context_t *settings,
+				 msu_settings_changed_t cb, void *user_data);
+
 #endif /* MSU_SETTINGS_H__ */
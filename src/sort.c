@@ -25,15 +25,14 @@
 #include "props.h"
 #include "sort.h"
 
-gchar *msu_sort_translate_sort_string(GHashTable *filter_map,
-				      const gchar *sort_string)
+gchar *msu_sort_translate_sort_string(const gchar *sort_string)
 {
 	GRegex *reg;
 	gchar *retval = NULL;
 	GMatchInfo *match_info = NULL;
 	gchar *prop = NULL;
 	gchar *op = NULL;
-	msu_prop_map_t *prop_map;
+	const msu_prop_map_t *prop_map;
 	GString *str;
 
 	if (!g_regex_match_simple(
@@ -54,7 +53,7 @@ gchar *msu_sort_translate_sort_string(GHashTable *filter_map,
 		if (!prop)
 			goto on_error;
 
-		prop_map = g_hash_table_lookup(filter_map, prop);
+		prop_map = msu_props_lookup(prop);
 		if (!prop_map)
 			goto on_error;
 
@@ -25,7 +25,6 @@
 
 #include <glib.h>
 
-gchar *msu_sort_translate_sort_string(GHashTable *filter_map,
-				      const gchar *sort_string);
+gchar *msu_sort_translate_sort_string(const gchar *sort_string);
 
 #endif
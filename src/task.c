@@ -22,6 +22,7 @@
 
 #include "error.h"
 #include "task.h"
+#include "trace.h"
 
 msu_task_t *msu_task_get_version_new(GDBusMethodInvocation *invocation)
 {
@@ -107,6 +108,41 @@ msu_task_t *msu_task_get_children_ex_new(GDBusMethodInvocation *invocation,
 	return task;
 }
 
+msu_task_t *msu_task_get_children_progressive_new(
+					GDBusMethodInvocation *invocation,
+					const gchar *path,
+					GVariant *parameters)
+{
+	msu_task_t *task;
+
+	task = msu_task_get_children_ex_new(invocation, path, parameters,
+					    TRUE, TRUE);
+	task->ut.get_children.progressive = TRUE;
+
+	return task;
+}
+
+msu_task_t *msu_task_get_children_view_new(GDBusMethodInvocation *invocation,
+					   const gchar *path,
+					   GVariant *parameters)
+{
+	msu_task_t *task;
+
+	task = prv_m2spec_task_new(MSU_TASK_GET_CHILDREN, invocation, path,
+				   "(@aa{sv})");
+
+	task->ut.get_children.containers = TRUE;
+	task->ut.get_children.items = TRUE;
+	task->view.set = TRUE;
+
+	g_variant_get(parameters, "(uuus)", &task->ut.get_children.start,
+					    &task->ut.get_children.count,
+					    &task->view.id,
+					    &task->ut.get_children.sort_by);
+
+	return task;
+}
+
 msu_task_t *msu_task_get_prop_new(GDBusMethodInvocation *invocation,
 				  const gchar *path, GVariant *parameters)
 {
@@ -171,6 +207,57 @@ msu_task_t *msu_task_search_ex_new(GDBusMethodInvocation *invocation,
 	return task;
 }
 
+msu_task_t *msu_task_count_children_new(GDBusMethodInvocation *invocation,
+					const gchar *path)
+{
+	return prv_m2spec_task_new(MSU_TASK_COUNT, invocation, path, "(@u)");
+}
+
+msu_task_t *msu_task_count_search_new(GDBusMethodInvocation *invocation,
+				      const gchar *path, GVariant *parameters)
+{
+	msu_task_t *task;
+
+	task = prv_m2spec_task_new(MSU_TASK_COUNT, invocation, path, "(@u)");
+
+	g_variant_get(parameters, "(s)", &task->ut.count.query);
+
+	return task;
+}
+
+msu_task_t *msu_task_search_view_new(GDBusMethodInvocation *invocation,
+				     const gchar *path, GVariant *parameters)
+{
+	msu_task_t *task;
+
+	task = prv_m2spec_task_new(MSU_TASK_SEARCH, invocation, path,
+				   "(@aa{sv}u)");
+
+	task->view.set = TRUE;
+
+	g_variant_get(parameters, "(suuus)", &task->ut.search.query,
+		      &task->ut.search.start, &task->ut.search.count,
+		      &task->view.id, &task->ut.search.sort_by);
+
+	task->multiple_retvals = TRUE;
+
+	return task;
+}
+
+msu_task_t *msu_task_list_tree_new(GDBusMethodInvocation *invocation,
+				   const gchar *path, GVariant *parameters)
+{
+	msu_task_t *task;
+
+	task = prv_m2spec_task_new(MSU_TASK_LIST_TREE, invocation, path,
+				   "(@u)");
+
+	g_variant_get(parameters, "(u@asu)", &task->ut.list_tree.depth,
+		      &task->ut.list_tree.filter, &task->ut.list_tree.max);
+
+	return task;
+}
+
 msu_task_t *msu_task_get_resource_new(GDBusMethodInvocation *invocation,
 				      const gchar *path, GVariant *parameters)
 {
@@ -185,6 +272,23 @@ msu_task_t *msu_task_get_resource_new(GDBusMethodInvocation *invocation,
 	return task;
 }
 
+msu_task_t *msu_task_get_resource_view_new(GDBusMethodInvocation *invocation,
+					   const gchar *path,
+					   GVariant *parameters)
+{
+	msu_task_t *task;
+
+	task = prv_m2spec_task_new(MSU_TASK_GET_RESOURCE, invocation, path,
+				   "(@a{sv})");
+
+	task->view.set = TRUE;
+
+	g_variant_get(parameters, "(su)", &task->ut.resource.protocol_info,
+					  &task->view.id);
+
+	return task;
+}
+
 msu_task_t *msu_task_set_protocol_info_new(GDBusMethodInvocation *invocation,
 					   GVariant *parameters)
 {
@@ -198,8 +302,65 @@ msu_task_t *msu_task_set_protocol_info_new(GDBusMethodInvocation *invocation,
 	return task;
 }
 
+msu_task_t *msu_task_set_priority_class_new(GDBusMethodInvocation *invocation,
+					    GVariant *parameters)
+{
+	msu_task_t *task = g_new0(msu_task_t, 1);
+
+	task->type = MSU_TASK_SET_PRIORITY_CLASS;
+	task->invocation = invocation;
+	task->synchronous = TRUE;
+	g_variant_get(parameters, "(s)",
+		      &task->ut.priority_class.priority_class);
+	g_strstrip(task->ut.priority_class.priority_class);
+
+	return task;
+}
+
+msu_task_t *msu_task_register_view_new(GDBusMethodInvocation *invocation,
+					GVariant *parameters)
+{
+	msu_task_t *task = g_new0(msu_task_t, 1);
+
+	task->type = MSU_TASK_REGISTER_VIEW;
+	task->invocation = invocation;
+	task->result_format = "(@u)";
+	task->synchronous = TRUE;
+	g_variant_get(parameters, "(@as)", &task->ut.register_view.filter);
+
+	return task;
+}
+
+static msu_task_t *prv_watch_task_new(msu_task_type_t type,
+				      GDBusMethodInvocation *invocation,
+				      GVariant *parameters)
+{
+	msu_task_t *task = g_new0(msu_task_t, 1);
+
+	task->type = type;
+	task->invocation = invocation;
+	task->synchronous = TRUE;
+	g_variant_get(parameters, "(o)", &task->ut.watch.container);
+
+	return task;
+}
+
+msu_task_t *msu_task_watch_new(GDBusMethodInvocation *invocation,
+			       GVariant *parameters)
+{
+	return prv_watch_task_new(MSU_TASK_WATCH, invocation, parameters);
+}
+
+msu_task_t *msu_task_unwatch_new(GDBusMethodInvocation *invocation,
+				 GVariant *parameters)
+{
+	return prv_watch_task_new(MSU_TASK_UNWATCH, invocation, parameters);
+}
+
 static void prv_msu_task_delete(msu_task_t *task)
 {
+	MSU_TRACE_END(task->trace_id, "request");
+
 	switch (task->type) {
 	case MSU_TASK_GET_CHILDREN:
 		if (task->ut.get_children.filter)
@@ -228,11 +389,30 @@ static void prv_msu_task_delete(msu_task_t *task)
 		if (task->ut.protocol_info.protocol_info)
 			g_free(task->ut.protocol_info.protocol_info);
 		break;
+	case MSU_TASK_SET_PRIORITY_CLASS:
+		g_free(task->ut.priority_class.priority_class);
+		break;
+	case MSU_TASK_WATCH:
+	case MSU_TASK_UNWATCH:
+		g_free(task->ut.watch.container);
+		break;
+	case MSU_TASK_COUNT:
+		g_free(task->ut.count.query);
+		break;
+	case MSU_TASK_LIST_TREE:
+		if (task->ut.list_tree.filter)
+			g_variant_unref(task->ut.list_tree.filter);
+		break;
+	case MSU_TASK_REGISTER_VIEW:
+		if (task->ut.register_view.filter)
+			g_variant_unref(task->ut.register_view.filter);
+		break;
 	default:
 		break;
 	}
 
 	g_free(task->path);
+	g_free(task->client_protocol_info);
 	if (task->result)
 		g_variant_unref(task->result);
 
@@ -254,8 +434,10 @@ void msu_task_complete_and_delete(msu_task_t *task)
 				variant = g_variant_new(task->result_format,
 							task->result);
 		}
+		MSU_TRACE_BEGIN(task->trace_id, "reply");
 		g_dbus_method_invocation_return_value(task->invocation,
 						      variant);
+		MSU_TRACE_END(task->trace_id, "reply");
 	}
 	prv_msu_task_delete(task);
 
@@ -269,8 +451,11 @@ void msu_task_fail_and_delete(msu_task_t *task, GError *error)
 	if (!task)
 		goto finished;
 
-	if (task->invocation)
+	if (task->invocation) {
+		MSU_TRACE_BEGIN(task->trace_id, "reply");
 		g_dbus_method_invocation_return_gerror(task->invocation, error);
+		MSU_TRACE_END(task->trace_id, "reply");
+	}
 
 	prv_msu_task_delete(task);
 
@@ -34,7 +34,13 @@ enum msu_task_type_t_ {
 	MSU_TASK_GET_PROP,
 	MSU_TASK_SEARCH,
 	MSU_TASK_GET_RESOURCE,
-	MSU_TASK_SET_PROTOCOL_INFO
+	MSU_TASK_SET_PROTOCOL_INFO,
+	MSU_TASK_SET_PRIORITY_CLASS,
+	MSU_TASK_WATCH,
+	MSU_TASK_UNWATCH,
+	MSU_TASK_COUNT,
+	MSU_TASK_LIST_TREE,
+	MSU_TASK_REGISTER_VIEW
 };
 typedef enum msu_task_type_t_ msu_task_type_t;
 
@@ -48,6 +54,7 @@ struct msu_task_get_children_t_ {
 	guint count;
 	GVariant *filter;
 	gchar *sort_by;
+	gboolean progressive;
 };
 
 typedef struct msu_task_get_props_t_ msu_task_get_props_t;
@@ -81,6 +88,41 @@ struct msu_task_set_protocol_info_t_ {
 	gchar *protocol_info;
 };
 
+typedef struct msu_task_set_priority_class_t_ msu_task_set_priority_class_t;
+struct msu_task_set_priority_class_t_ {
+	gchar *priority_class;
+};
+
+typedef struct msu_task_watch_t_ msu_task_watch_t;
+struct msu_task_watch_t_ {
+	gchar *container;
+};
+
+typedef struct msu_task_count_t_ msu_task_count_t;
+struct msu_task_count_t_ {
+	gchar *query;
+};
+
+typedef struct msu_task_list_tree_t_ msu_task_list_tree_t;
+struct msu_task_list_tree_t_ {
+	guint depth;
+	GVariant *filter;
+	guint max;
+};
+
+typedef struct msu_task_register_view_t_ msu_task_register_view_t;
+struct msu_task_register_view_t_ {
+	GVariant *filter;
+};
+
+typedef struct msu_task_view_t_ msu_task_view_t;
+struct msu_task_view_t_ {
+	gboolean set;
+	guint id;
+	guint32 filter_mask;
+	const gchar *upnp_filter;
+};
+
 typedef struct msu_task_t_ msu_task_t;
 struct msu_task_t_ {
 	msu_task_type_t type;
@@ -90,6 +132,9 @@ struct msu_task_t_ {
 	GDBusMethodInvocation *invocation;
 	gboolean synchronous;
 	gboolean multiple_retvals;
+	gchar *client_protocol_info;
+	msu_task_view_t view;
+	guint trace_id;
 	union {
 		msu_task_get_children_t get_children;
 		msu_task_get_props_t get_props;
@@ -97,6 +142,11 @@ struct msu_task_t_ {
 		msu_task_search_t search;
 		msu_task_get_resource_t resource;
 		msu_task_set_protocol_info_t protocol_info;
+		msu_task_set_priority_class_t priority_class;
+		msu_task_watch_t watch;
+		msu_task_count_t count;
+		msu_task_list_tree_t list_tree;
+		msu_task_register_view_t register_view;
 	} ut;
 };
 
@@ -109,6 +159,13 @@ msu_task_t *msu_task_get_children_ex_new(GDBusMethodInvocation *invocation,
 					 const gchar *path,
 					 GVariant *parameters, gboolean items,
 					 gboolean containers);
+msu_task_t *msu_task_get_children_progressive_new(
+					GDBusMethodInvocation *invocation,
+					const gchar *path,
+					GVariant *parameters);
+msu_task_t *msu_task_get_children_view_new(GDBusMethodInvocation *invocation,
+					   const gchar *path,
+					   GVariant *parameters);
 msu_task_t *msu_task_get_prop_new(GDBusMethodInvocation *invocation,
 				  const gchar *path, GVariant *parameters);
 msu_task_t *msu_task_get_props_new(GDBusMethodInvocation *invocation,
@@ -117,10 +174,29 @@ msu_task_t *msu_task_search_new(GDBusMethodInvocation *invocation,
 				const gchar *path, GVariant *parameters);
 msu_task_t *msu_task_search_ex_new(GDBusMethodInvocation *invocation,
 				   const gchar *path, GVariant *parameters);
+msu_task_t *msu_task_count_children_new(GDBusMethodInvocation *invocation,
+					const gchar *path);
+msu_task_t *msu_task_count_search_new(GDBusMethodInvocation *invocation,
+				      const gchar *path, GVariant *parameters);
+msu_task_t *msu_task_search_view_new(GDBusMethodInvocation *invocation,
+				     const gchar *path, GVariant *parameters);
+msu_task_t *msu_task_list_tree_new(GDBusMethodInvocation *invocation,
+				   const gchar *path, GVariant *parameters);
 msu_task_t *msu_task_get_resource_new(GDBusMethodInvocation *invocation,
 				      const gchar *path, GVariant *parameters);
+msu_task_t *msu_task_get_resource_view_new(GDBusMethodInvocation *invocation,
+					   const gchar *path,
+					   GVariant *parameters);
 msu_task_t *msu_task_set_protocol_info_new(GDBusMethodInvocation *invocation,
 					   GVariant *parameters);
+msu_task_t *msu_task_set_priority_class_new(GDBusMethodInvocation *invocation,
+					    GVariant *parameters);
+msu_task_t *msu_task_register_view_new(GDBusMethodInvocation *invocation,
+					GVariant *parameters);
+msu_task_t *msu_task_watch_new(GDBusMethodInvocation *invocation,
+			       GVariant *parameters);
+msu_task_t *msu_task_unwatch_new(GDBusMethodInvocation *invocation,
+				 GVariant *parameters);
 void msu_task_complete_and_delete(msu_task_t *task);
 void msu_task_fail_and_delete(msu_task_t *task, GError *error);
 void msu_task_cancel_and_delete(msu_task_t *task);
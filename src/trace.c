@@ -0,0 +1,218 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "log.h"
+#include "trace.h"
+
+#define MSU_TRACE_FILE_NAME "media-service-upnp-trace.json"
+
+/* Number of events kept per thread.  Older events are overwritten. */
+#define MSU_TRACE_RING_SIZE 16384
+
+typedef struct msu_trace_event_t_ msu_trace_event_t;
+struct msu_trace_event_t_ {
+	gint64 time;
+	const gchar *name;
+	guint id;
+	gchar phase;
+};
+
+/*
+ * Each thread that records an event gets its own ring.  The mutex is
+ * only ever contended while the rings are being dumped.
+ */
+
+typedef struct msu_trace_ring_t_ msu_trace_ring_t;
+struct msu_trace_ring_t_ {
+	GMutex mutex;
+	guint tid;
+	guint next;
+	guint count;
+	msu_trace_event_t events[MSU_TRACE_RING_SIZE];
+};
+
+gboolean msu_trace_enabled;
+
+static GPrivate g_trace_ring;
+static GMutex g_trace_mutex;
+static GPtrArray *g_trace_rings;
+static gint g_trace_next_id;
+
+static msu_trace_ring_t *prv_trace_ring_new(void)
+{
+	msu_trace_ring_t *ring;
+
+	ring = g_new0(msu_trace_ring_t, 1);
+	g_mutex_init(&ring->mutex);
+
+	g_mutex_lock(&g_trace_mutex);
+	if (!g_trace_rings)
+		g_trace_rings = g_ptr_array_new();
+	ring->tid = g_trace_rings->len + 1;
+	g_ptr_array_add(g_trace_rings, ring);
+	g_mutex_unlock(&g_trace_mutex);
+
+	g_private_set(&g_trace_ring, ring);
+
+	return ring;
+}
+
+static void prv_trace_ring_delete(gpointer data)
+{
+	msu_trace_ring_t *ring = data;
+
+	g_mutex_clear(&ring->mutex);
+	g_free(ring);
+}
+
+void msu_trace_enable(gboolean enable)
+{
+	if (enable != msu_trace_enabled)
+		MSU_LOG_INFO("Tracing %s", enable ? "enabled" : "disabled");
+
+	msu_trace_enabled = enable;
+}
+
+void msu_trace_finalize(void)
+{
+	msu_trace_enabled = FALSE;
+	g_private_set(&g_trace_ring, NULL);
+
+	g_mutex_lock(&g_trace_mutex);
+	if (g_trace_rings) {
+		g_ptr_array_foreach(g_trace_rings, (GFunc)
+				    prv_trace_ring_delete, NULL);
+		g_ptr_array_unref(g_trace_rings);
+		g_trace_rings = NULL;
+	}
+	g_mutex_unlock(&g_trace_mutex);
+}
+
+guint msu_trace_new_id(void)
+{
+	guint id = 0;
+
+	if (msu_trace_enabled) {
+		id = (guint) g_atomic_int_add(&g_trace_next_id, 1) + 1;
+
+		/* 0 means untraced */
+
+		if (!id)
+			id = (guint) g_atomic_int_add(&g_trace_next_id, 1) + 1;
+	}
+
+	return id;
+}
+
+void msu_trace_event(guint id, const gchar *name, gchar phase)
+{
+	msu_trace_ring_t *ring;
+	msu_trace_event_t *event;
+
+	ring = g_private_get(&g_trace_ring);
+	if (!ring)
+		ring = prv_trace_ring_new();
+
+	g_mutex_lock(&ring->mutex);
+
+	event = &ring->events[ring->next];
+	event->time = g_get_monotonic_time();
+	event->name = name;
+	event->id = id;
+	event->phase = phase;
+
+	ring->next = (ring->next + 1) % MSU_TRACE_RING_SIZE;
+	if (ring->count < MSU_TRACE_RING_SIZE)
+		ring->count++;
+
+	g_mutex_unlock(&ring->mutex);
+}
+
+static void prv_trace_dump_ring(msu_trace_ring_t *ring, GString *json,
+				gboolean *first)
+{
+	msu_trace_event_t *event;
+	guint i;
+	guint start;
+	pid_t pid = getpid();
+
+	g_mutex_lock(&ring->mutex);
+
+	start = (ring->next + MSU_TRACE_RING_SIZE - ring->count) %
+		MSU_TRACE_RING_SIZE;
+
+	for (i = 0; i < ring->count; ++i) {
+		event = &ring->events[(start + i) % MSU_TRACE_RING_SIZE];
+
+		g_string_append_printf(json,
+				       "%s\n{\"name\":\"%s\",\"cat\":\"msu\","
+				       "\"ph\":\"%c\",\"id\":%u,"
+				       "\"ts\":%"G_GINT64_FORMAT","
+				       "\"pid\":%d,\"tid\":%u}",
+				       *first ? "" : ",", event->name,
+				       event->phase, event->id, event->time,
+				       (int) pid, ring->tid);
+		*first = FALSE;
+	}
+
+	g_mutex_unlock(&ring->mutex);
+}
+
+gchar *msu_trace_dump(GError **error)
+{
+	GString *json;
+	const gchar *dir;
+	gchar *path;
+	gboolean first = TRUE;
+	guint i;
+
+	json = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	g_mutex_lock(&g_trace_mutex);
+	for (i = 0; g_trace_rings && i < g_trace_rings->len; ++i)
+		prv_trace_dump_ring(g_ptr_array_index(g_trace_rings, i), json,
+				    &first);
+	g_mutex_unlock(&g_trace_mutex);
+
+	g_string_append(json, "\n]}\n");
+
+	dir = g_get_user_cache_dir();
+	(void) g_mkdir_with_parents(dir, 0700);
+	path = g_build_filename(dir, MSU_TRACE_FILE_NAME, NULL);
+
+	if (!g_file_set_contents(path, json->str, json->len, error)) {
+		g_free(path);
+		path = NULL;
+		goto on_error;
+	}
+
+	MSU_LOG_INFO("Trace written to %s", path);
+
+on_error:
+
+	g_string_free(json, TRUE);
+
+	return path;
+}
@@ -0,0 +1,66 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#ifndef MSU_TRACE_H__
+#define MSU_TRACE_H__
+
+#include <glib.h>
+
+/* Request tracing.  Each task is given a trace ID when it arrives and
+ * the stages it passes through are recorded as begin and end events.
+ * The events can be written out in the Chrome trace event format and
+ * loaded into chrome://tracing or Perfetto.
+ *
+ * The macros do nothing, and do not evaluate their arguments, while
+ * tracing is disabled or if the ID is 0.  Stage names must be string
+ * literals as only the pointer is recorded.
+ */
+
+extern gboolean msu_trace_enabled;
+
+#define MSU_TRACE_BEGIN(id, name) \
+	do { \
+		if (msu_trace_enabled && (id)) \
+			msu_trace_event((id), (name), 'b'); \
+	} while (0)
+
+#define MSU_TRACE_END(id, name) \
+	do { \
+		if (msu_trace_enabled && (id)) \
+			msu_trace_event((id), (name), 'e'); \
+	} while (0)
+
+#define MSU_TRACE_INSTANT(id, name) \
+	do { \
+		if (msu_trace_enabled && (id)) \
+			msu_trace_event((id), (name), 'n'); \
+	} while (0)
+
+void msu_trace_enable(gboolean enable);
+void msu_trace_finalize(void);
+
+guint msu_trace_new_id(void);
+void msu_trace_event(guint id, const gchar *name, gchar phase);
+
+gchar *msu_trace_dump(GError **error);
+
+#endif
@@ -35,16 +35,24 @@
 #include "sort.h"
 #include "upnp.h"
 
+typedef struct msu_upnp_lost_t_ msu_upnp_lost_t;
+struct msu_upnp_lost_t_ {
+	msu_upnp_t *upnp;
+	gchar *udn;
+};
+
 struct msu_upnp_t_ {
 	GDBusConnection *connection;
 	msu_interface_info_t *interface_info;
-	GHashTable *filter_map;
+	GHashTable *filter_cache;
 	msu_upnp_callback_t found_server;
 	msu_upnp_callback_t lost_server;
 	GUPnPContextManager *context_manager;
 	void *user_data;
 	GHashTable *server_udn_map;
 	guint counter;
+	msu_settings_context_t *settings;
+	msu_quirks_t *quirks;
 };
 
 static gchar **prv_subtree_enumerate(GDBusConnection *connection,
@@ -167,6 +175,98 @@ static const GDBusInterfaceVTable *prv_subtree_dispatch(
 	return retval;
 }
 
+static gboolean prv_subscribe_to_contents_change(gpointer user_data)
+{
+	msu_device_t *device = user_data;
+
+	device->timeout_id = 0;
+	msu_device_subscribe_to_contents_change(device);
+
+	return FALSE;
+}
+
+static void prv_lost_delete(gpointer data)
+{
+	msu_upnp_lost_t *lost = data;
+
+	g_free(lost->udn);
+	g_free(lost);
+}
+
+static gboolean prv_server_lost_cb(gpointer user_data)
+{
+	msu_upnp_lost_t *lost = user_data;
+	msu_upnp_t *upnp = lost->upnp;
+	msu_device_t *device;
+
+	device = g_hash_table_lookup(upnp->server_udn_map, lost->udn);
+	device->lost_timeout_id = 0;
+
+	MSU_LOG_DEBUG("Server %s did not come back. Delete device",
+		      device->path);
+
+	upnp->lost_server(device->path, upnp->user_data);
+	g_hash_table_remove(upnp->server_udn_map, lost->udn);
+
+	return FALSE;
+}
+
+static void prv_suspect_server(msu_upnp_t *upnp, msu_device_t *device,
+			       const gchar *udn, guint grace)
+{
+	msu_upnp_lost_t *lost;
+
+	MSU_LOG_DEBUG("Last Context lost. Keep device for %u seconds", grace);
+
+	lost = g_new(msu_upnp_lost_t, 1);
+	lost->upnp = upnp;
+	lost->udn = g_strdup(udn);
+
+	device->lost_timeout_id = g_timeout_add_seconds_full(
+		G_PRIORITY_DEFAULT, grace, prv_server_lost_cb, lost,
+		prv_lost_delete);
+}
+
+static void prv_server_back(msu_device_t *device, const gchar *ip_address,
+			    GUPnPDeviceProxy *proxy)
+{
+	msu_device_context_t *context;
+	gboolean subscribed;
+
+	(void) g_source_remove(device->lost_timeout_id);
+	device->lost_timeout_id = 0;
+
+	/* The context of a suspect server is kept alive, so if the server
+	   is still at the same address we carry on using it, along with
+	   its event subscription. */
+
+	context = g_ptr_array_index(device->contexts, 0);
+	if (!strcmp(context->ip_address, ip_address) &&
+	    !g_strcmp0(gupnp_device_info_get_location(
+			       (GUPnPDeviceInfo *) context->device_proxy),
+		       gupnp_device_info_get_location(
+			       (GUPnPDeviceInfo *) proxy))) {
+		MSU_LOG_DEBUG("Server %s back", device->path);
+		goto on_exit;
+	}
+
+	MSU_LOG_DEBUG("Server %s back at a new location", device->path);
+
+	subscribed = context->subscription != MSU_DEVICE_SUBSCRIPTION_IDLE;
+
+	msu_device_append_new_context(device, ip_address, proxy);
+	(void) g_ptr_array_remove_index(device->contexts, 0);
+
+	if (subscribed && !device->timeout_id)
+		device->timeout_id = g_timeout_add_seconds(1,
+					prv_subscribe_to_contents_change,
+					device);
+
+on_exit:
+
+	return;
+}
+
 static void prv_server_available_cb(GUPnPControlPoint *cp,
 				    GUPnPDeviceProxy *proxy,
 				    gpointer user_data)
@@ -197,12 +297,15 @@ static void prv_server_available_cb(GUPnPControlPoint *cp,
 
 		if (msu_device_new(upnp->connection, proxy,
 				   ip_address, &gSubtreeVtable, upnp,
+				   upnp->settings, upnp->quirks,
 				   upnp->counter, &device)) {
 			upnp->counter++;
 			g_hash_table_insert(upnp->server_udn_map, g_strdup(udn),
 					    device);
 			upnp->found_server(device->path, upnp->user_data);
 		}
+	} else if (device->lost_timeout_id) {
+		prv_server_back(device, ip_address, proxy);
 	} else {
 		MSU_LOG_DEBUG("Device Found");
 
@@ -227,16 +330,6 @@ on_error:
 	return;
 }
 
-static gboolean prv_subscribe_to_contents_change(gpointer user_data)
-{
-	msu_device_t *device = user_data;
-
-	device->timeout_id = 0;
-	msu_device_subscribe_to_contents_change(device);
-
-	return FALSE;
-}
-
 static void prv_server_unavailable_cb(GUPnPControlPoint *cp,
 				      GUPnPDeviceProxy *proxy,
 				      gpointer user_data)
@@ -248,6 +341,7 @@ static void prv_server_unavailable_cb(GUPnPControlPoint *cp,
 	unsigned int i;
 	msu_device_context_t *context;
 	gboolean subscribed;
+	guint grace;
 
 	MSU_LOG_DEBUG("Enter");
 
@@ -274,7 +368,16 @@ static void prv_server_unavailable_cb(GUPnPControlPoint *cp,
 	}
 
 	if (i < device->contexts->len) {
-		subscribed = context->subscribed;
+		grace = msu_settings_get_lost_server_grace(upnp->settings);
+
+		if (device->contexts->len == 1 && grace) {
+			if (!device->lost_timeout_id)
+				prv_suspect_server(upnp, device, udn, grace);
+			goto on_error;
+		}
+
+		subscribed = context->subscription !=
+			MSU_DEVICE_SUBSCRIPTION_IDLE;
 
 		(void) g_ptr_array_remove_index(device->contexts, i);
 		if (device->contexts->len == 0) {
@@ -321,15 +424,29 @@ static void prv_on_context_available(GUPnPContextManager *context_manager,
 	g_object_unref(cp);
 }
 
+static void prv_settings_changed_cb(msu_settings_context_t *settings,
+				    void *user_data)
+{
+	msu_upnp_t *upnp = user_data;
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, upnp->server_udn_map);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		msu_device_configure(value, settings);
+}
+
 msu_upnp_t *msu_upnp_new(GDBusConnection *connection,
 			 msu_interface_info_t *interface_info,
 			 msu_upnp_callback_t found_server,
 			 msu_upnp_callback_t lost_server,
+			 msu_settings_context_t *settings,
 			 void *user_data)
 {
 	msu_upnp_t *upnp = g_new0(msu_upnp_t, 1);
 
 	upnp->connection = connection;
+	upnp->settings = settings;
 	upnp->interface_info = interface_info;
 	upnp->user_data = user_data;
 	upnp->found_server = found_server;
@@ -338,22 +455,28 @@ msu_upnp_t *msu_upnp_new(GDBusConnection *connection,
 	upnp->server_udn_map = g_hash_table_new_full(g_str_hash, g_str_equal,
 						     g_free,
 						     msu_device_delete);
-	upnp->filter_map = msu_prop_maps_new();
+	upnp->filter_cache = msu_props_filter_cache_new();
+	msu_quirks_new(&upnp->quirks);
 	upnp->context_manager = gupnp_context_manager_create(0);
 
 	g_signal_connect(upnp->context_manager, "context-available",
 			 G_CALLBACK(prv_on_context_available),
 			 upnp);
 
+	msu_settings_set_changed_cb(settings, prv_settings_changed_cb, upnp);
+
 	return upnp;
 }
 
 void msu_upnp_delete(msu_upnp_t *upnp)
 {
 	if (upnp) {
+		msu_settings_set_changed_cb(upnp->settings, NULL, NULL);
 		g_object_unref(upnp->context_manager);
-		g_hash_table_unref(upnp->filter_map);
+		g_hash_table_unref(upnp->filter_cache);
 		g_hash_table_unref(upnp->server_udn_map);
+		msu_quirks_delete(upnp->quirks);
+		msu_props_intern_clear();
 		g_free(upnp->interface_info);
 		g_free(upnp);
 	}
@@ -385,6 +508,26 @@ GVariant *msu_upnp_get_server_ids(msu_upnp_t *upnp)
 	return retval;
 }
 
+guint32 msu_upnp_compile_filter(msu_upnp_t *upnp, GVariant *filter,
+				const gchar **upnp_filter)
+{
+	return msu_props_parse_filter(upnp->filter_cache, filter, upnp_filter);
+}
+
+static guint32 prv_parse_filter(msu_upnp_t *upnp, msu_task_t *task,
+				GVariant *filter, const gchar **upnp_filter)
+{
+	/* Tasks issued against a registered view carry a filter that was
+	   compiled when the view was registered. */
+
+	if (task->view.set) {
+		*upnp_filter = task->view.upnp_filter;
+		return task->view.filter_mask;
+	}
+
+	return msu_props_parse_filter(upnp->filter_cache, filter, upnp_filter);
+}
+
 void msu_upnp_get_children(msu_upnp_t *upnp, msu_task_t *task,
 			   const gchar *protocol_info,
 			   GCancellable *cancellable,
@@ -394,7 +537,7 @@ void msu_upnp_get_children(msu_upnp_t *upnp, msu_task_t *task,
 	msu_async_cb_data_t *cb_data;
 	msu_async_bas_t *cb_task_data;
 	msu_device_t *device;
-	gchar *upnp_filter = NULL;
+	const gchar *upnp_filter = NULL;
 	gchar *sort_by = NULL;
 
 	MSU_LOG_DEBUG("Enter");
@@ -427,14 +570,13 @@ void msu_upnp_get_children(msu_upnp_t *upnp, msu_task_t *task,
 	}
 
 	cb_task_data->filter_mask =
-		msu_props_parse_filter(upnp->filter_map,
-					task->ut.get_children.filter,
-					&upnp_filter);
+		prv_parse_filter(upnp, task, task->ut.get_children.filter,
+				 &upnp_filter);
 
 	MSU_LOG_DEBUG("Filter Mask 0x%x", cb_task_data->filter_mask);
 
-	sort_by = msu_sort_translate_sort_string(upnp->filter_map,
-						 task->ut.get_children.sort_by);
+	sort_by = msu_sort_translate_sort_string(
+		task->ut.get_children.sort_by);
 	if (!sort_by) {
 		MSU_LOG_WARNING("Invalid Sort Criteria");
 
@@ -447,18 +589,26 @@ void msu_upnp_get_children(msu_upnp_t *upnp, msu_task_t *task,
 
 	cb_task_data->protocol_info = protocol_info;
 
+	/* The device takes ownership of cb_data from here on.  The request
+	   may be served from the page cache, in which case no UPnP action is
+	   ever started. */
+
 	msu_device_get_children(device, task, cb_data,
 				upnp_filter, sort_by, cancellable);
 
+	MSU_LOG_DEBUG("Exit with SUCCESS");
+
+	goto no_complete;
+
 on_error:
 
-	if (!cb_data->action)
-		(void) g_idle_add(msu_async_complete_task, cb_data);
+	(void) g_idle_add(msu_async_complete_task, cb_data);
 
-	g_free(sort_by);
-	g_free(upnp_filter);
+	MSU_LOG_DEBUG("Exit with FAIL");
 
-	MSU_LOG_DEBUG("Exit with %s", !cb_data->action ? "FAIL" : "SUCCESS");
+no_complete:
+
+	g_free(sort_by);
 }
 
 void msu_upnp_get_all_props(msu_upnp_t *upnp, msu_task_t *task,
@@ -505,6 +655,8 @@ void msu_upnp_get_all_props(msu_upnp_t *upnp, msu_task_t *task,
 	}
 
 	cb_task_data->protocol_info = protocol_info;
+	cb_task_data->upnp_filter = msu_props_get_interface_filter(
+		upnp->filter_cache, task->ut.get_props.interface_name);
 
 	msu_device_get_all_props(device, task, cb_data, root_object,
 				 cancellable);
@@ -530,7 +682,7 @@ void msu_upnp_get_prop(msu_upnp_t *upnp, msu_task_t *task,
 	msu_async_cb_data_t *cb_data;
 	msu_async_get_prop_t *cb_task_data;
 	msu_device_t *device;
-	msu_prop_map_t *prop_map;
+	const msu_prop_map_t *prop_map;
 	msu_task_get_prop_t *task_data;
 
 	MSU_LOG_DEBUG("Enter");
@@ -569,7 +721,7 @@ void msu_upnp_get_prop(msu_upnp_t *upnp, msu_task_t *task,
 	}
 
 	cb_task_data->protocol_info = protocol_info;
-	prop_map = g_hash_table_lookup(upnp->filter_map, task_data->prop_name);
+	prop_map = msu_props_lookup(task_data->prop_name);
 
 	msu_device_get_prop(device, task, cb_data, prop_map,
 			    root_object, cancellable);
@@ -585,13 +737,53 @@ on_error:
 	MSU_LOG_DEBUG("Exit with FAIL");
 }
 
+gboolean msu_upnp_get_local_props(msu_upnp_t *upnp, msu_task_t *task,
+				  GError **error)
+{
+	gchar *root_path = NULL;
+	gchar *id = NULL;
+	msu_device_t *device;
+	gboolean root_object;
+	gboolean retval = FALSE;
+
+	MSU_LOG_DEBUG("Enter");
+
+	/* Requests that cannot be answered without contacting the server,
+	   including those that fail, are left to the task queue. */
+
+	if (!msu_path_get_path_and_id(task->path, &root_path, &id, NULL))
+		goto on_exit;
+
+	device = msu_device_from_path(root_path, upnp->server_udn_map);
+	if (!device)
+		goto on_exit;
+
+	root_object = id[0] == '0' && id[1] == 0;
+
+	if (task->type == MSU_TASK_GET_PROP)
+		retval = msu_device_get_local_prop(device, task, root_object,
+						   error);
+	else if (task->type == MSU_TASK_GET_ALL_PROPS)
+		retval = msu_device_get_local_props(device, task, root_object,
+						    error);
+
+on_exit:
+
+	g_free(root_path);
+	g_free(id);
+
+	MSU_LOG_DEBUG("Exit with %s", retval ? "LOCAL" : "QUEUED");
+
+	return retval;
+}
+
 void msu_upnp_search(msu_upnp_t *upnp, msu_task_t *task,
 		     const gchar *protocol_info,
 		     GCancellable *cancellable,
 		     msu_upnp_task_complete_t cb,
 		     void *user_data)
 {
-	gchar *upnp_filter = NULL;
+	const gchar *upnp_filter = NULL;
 	gchar *upnp_query = NULL;
 	gchar *sort_by = NULL;
 	msu_async_cb_data_t *cb_data;
@@ -629,13 +821,13 @@ void msu_upnp_search(msu_upnp_t *upnp, msu_task_t *task,
 	}
 
 	cb_task_data->filter_mask =
-		msu_props_parse_filter(upnp->filter_map,
-				       task->ut.search.filter, &upnp_filter);
+		prv_parse_filter(upnp, task, task->ut.search.filter,
+				 &upnp_filter);
 
 	MSU_LOG_DEBUG("Filter Mask 0x%x", cb_task_data->filter_mask);
 
-	upnp_query = msu_search_translate_search_string(upnp->filter_map,
-							task->ut.search.query);
+	upnp_query = msu_search_translate_search_string(
+		task->ut.search.query);
 	if (!upnp_query) {
 		MSU_LOG_WARNING("Query string is not valid:%s",
 			      task->ut.search.query);
@@ -647,8 +839,7 @@ void msu_upnp_search(msu_upnp_t *upnp, msu_task_t *task,
 
 	MSU_LOG_DEBUG("UPnP Query %s", upnp_query);
 
-	sort_by = msu_sort_translate_sort_string(upnp->filter_map,
-						 task->ut.search.sort_by);
+	sort_by = msu_sort_translate_sort_string(task->ut.search.sort_by);
 	if (!sort_by) {
 		MSU_LOG_WARNING("Invalid Sort Criteria");
 
@@ -670,11 +861,181 @@ on_error:
 
 	g_free(sort_by);
 	g_free(upnp_query);
-	g_free(upnp_filter);
 
 	MSU_LOG_DEBUG("Exit with %s", !cb_data->action ? "FAIL" : "SUCCESS");
 }
 
+void msu_upnp_list_tree(msu_upnp_t *upnp, msu_task_t *task,
+			const gchar *protocol_info,
+			GCancellable *cancellable,
+			msu_upnp_task_complete_t cb,
+			void *user_data)
+{
+	msu_async_cb_data_t *cb_data;
+	msu_async_tree_t *cb_task_data;
+	msu_device_t *device;
+	const gchar *upnp_filter = NULL;
+
+	MSU_LOG_DEBUG("Enter");
+
+	MSU_LOG_DEBUG("Path: %s", task->path);
+	MSU_LOG_DEBUG("Depth: %u", task->ut.list_tree.depth);
+	MSU_LOG_DEBUG("Max: %u", task->ut.list_tree.max);
+
+	cb_data = msu_async_cb_data_new(task, cb, user_data);
+	cb_task_data = &cb_data->ut.tree;
+
+	if (!msu_path_get_path_and_id(task->path, &cb_task_data->root_path,
+				      &cb_data->id, &cb_data->error)) {
+		MSU_LOG_WARNING("Bad path %s", task->path);
+
+		goto on_error;
+	}
+
+	device = msu_device_from_path(cb_task_data->root_path,
+				      upnp->server_udn_map);
+	if (!device) {
+		MSU_LOG_WARNING("Cannot locate device for %s",
+			      cb_task_data->root_path);
+
+		cb_data->error =
+			g_error_new(MSU_ERROR, MSU_ERROR_OBJECT_NOT_FOUND,
+				    "Cannot locate device corresponding to"
+				    " the specified path");
+		goto on_error;
+	}
+
+	cb_task_data->filter_mask =
+		msu_props_parse_filter(upnp->filter_cache,
+				       task->ut.list_tree.filter,
+				       &upnp_filter);
+	cb_task_data->upnp_filter = g_strdup(upnp_filter);
+	cb_task_data->protocol_info = protocol_info;
+
+	MSU_LOG_DEBUG("Filter Mask 0x%x", cb_task_data->filter_mask);
+
+	/* The device owns cb_data from here on and completes the task once
+	   the whole subtree has been listed. */
+
+	msu_device_list_tree(device, task, cb_data, cancellable);
+
+	MSU_LOG_DEBUG("Exit with SUCCESS");
+
+	return;
+
+on_error:
+
+	(void) g_idle_add(msu_async_complete_task, cb_data);
+
+	MSU_LOG_DEBUG("Exit with FAIL");
+}
+
+gboolean msu_upnp_get_local_count(msu_upnp_t *upnp, msu_task_t *task)
+{
+	gchar *root_path = NULL;
+	gchar *id = NULL;
+	gchar *upnp_query = NULL;
+	msu_device_t *device;
+	gboolean retval = FALSE;
+
+	MSU_LOG_DEBUG("Enter");
+
+	/* As with local properties, anything that cannot be answered from
+	   the cache or the index, including errors, is left to the task
+	   queue. */
+
+	if (!msu_path_get_path_and_id(task->path, &root_path, &id, NULL))
+		goto on_exit;
+
+	device = msu_device_from_path(root_path, upnp->server_udn_map);
+	if (!device)
+		goto on_exit;
+
+	if (task->ut.count.query) {
+		upnp_query = msu_search_translate_search_string(
+			task->ut.count.query);
+		if (!upnp_query)
+			goto on_exit;
+	}
+
+	retval = msu_device_get_local_count(device, task, id, upnp_query);
+
+on_exit:
+
+	g_free(upnp_query);
+	g_free(root_path);
+	g_free(id);
+
+	MSU_LOG_DEBUG("Exit with %s", retval ? "LOCAL" : "QUEUED");
+
+	return retval;
+}
+
+void msu_upnp_count(msu_upnp_t *upnp, msu_task_t *task,
+		    GCancellable *cancellable,
+		    msu_upnp_task_complete_t cb,
+		    void *user_data)
+{
+	msu_async_cb_data_t *cb_data;
+	gchar *root_path = NULL;
+	gchar *upnp_query = NULL;
+	msu_device_t *device;
+
+	MSU_LOG_DEBUG("Enter");
+
+	MSU_LOG_DEBUG("Path: %s", task->path);
+	MSU_LOG_DEBUG("Query: %s", task->ut.count.query ?
+		      task->ut.count.query : "(children)");
+
+	cb_data = msu_async_cb_data_new(task, cb, user_data);
+
+	if (!msu_path_get_path_and_id(task->path, &root_path, &cb_data->id,
+				      &cb_data->error)) {
+		MSU_LOG_WARNING("Bad path %s", task->path);
+
+		goto on_error;
+	}
+
+	device = msu_device_from_path(root_path, upnp->server_udn_map);
+	if (!device) {
+		MSU_LOG_WARNING("Cannot locate device for %s", root_path);
+
+		cb_data->error =
+			g_error_new(MSU_ERROR, MSU_ERROR_OBJECT_NOT_FOUND,
+				    "Cannot locate device corresponding to"
+				    " the specified path");
+		goto on_error;
+	}
+
+	if (task->ut.count.query) {
+		upnp_query = msu_search_translate_search_string(
+			task->ut.count.query);
+		if (!upnp_query) {
+			MSU_LOG_WARNING("Query string is not valid:%s",
+					task->ut.count.query);
+
+			cb_data->error = g_error_new(MSU_ERROR,
+						     MSU_ERROR_BAD_QUERY,
+						     "Query string is not valid.");
+			goto on_error;
+		}
+
+		MSU_LOG_DEBUG("UPnP Query %s", upnp_query);
+	}
+
+	msu_device_count(device, task, cb_data, upnp_query, cancellable);
+
+on_error:
+
+	if (!cb_data->action)
+		(void) g_idle_add(msu_async_complete_task, cb_data);
+
+	g_free(upnp_query);
+	g_free(root_path);
+
+	MSU_LOG_DEBUG("Exit");
+}
+
 void msu_upnp_get_resource(msu_upnp_t *upnp, msu_task_t *task,
 			   GCancellable *cancellable,
 			   msu_upnp_task_complete_t cb,
@@ -683,7 +1044,7 @@ void msu_upnp_get_resource(msu_upnp_t *upnp, msu_task_t *task,
 	msu_async_cb_data_t *cb_data;
 	msu_async_get_all_t *cb_task_data;
 	msu_device_t *device;
-	gchar *upnp_filter = NULL;
+	const gchar *upnp_filter = NULL;
 	gchar *root_path = NULL;
 
 	MSU_LOG_DEBUG("Enter");
@@ -714,8 +1075,8 @@ void msu_upnp_get_resource(msu_upnp_t *upnp, msu_task_t *task,
 	}
 
 	cb_task_data->filter_mask =
-		msu_props_parse_filter(upnp->filter_map,
-				       task->ut.resource.filter, &upnp_filter);
+		prv_parse_filter(upnp, task, task->ut.resource.filter,
+				 &upnp_filter);
 
 	MSU_LOG_DEBUG("Filter Mask 0x%x", cb_task_data->filter_mask);
 
@@ -727,8 +1088,116 @@ on_error:
 	if (!cb_data->action)
 		(void) g_idle_add(msu_async_complete_task, cb_data);
 
-	g_free(upnp_filter);
 	g_free(root_path);
 
 	MSU_LOG_DEBUG("Exit with %s", !cb_data->action ? "FAIL" : "SUCCESS");
 }
+
+static msu_device_t *prv_watch_device(msu_upnp_t *upnp, const gchar *path,
+				      gchar **id, GError **error)
+{
+	gchar *root_path = NULL;
+	msu_device_t *device = NULL;
+
+	if (!msu_path_get_path_and_id(path, &root_path, id, error)) {
+		MSU_LOG_WARNING("Bad path %s", path);
+
+		goto on_exit;
+	}
+
+	device = msu_device_from_path(root_path, upnp->server_udn_map);
+	if (!device) {
+		MSU_LOG_WARNING("Cannot locate device for %s", root_path);
+
+		*error = g_error_new(MSU_ERROR, MSU_ERROR_OBJECT_NOT_FOUND,
+				     "Cannot locate device corresponding to"
+				     " the specified path");
+		g_free(*id);
+		*id = NULL;
+	}
+
+on_exit:
+
+	g_free(root_path);
+
+	return device;
+}
+
+gboolean msu_upnp_watch(msu_upnp_t *upnp, const gchar *client,
+			const gchar *path, GError **error)
+{
+	msu_device_t *device;
+	gchar *id = NULL;
+
+	MSU_LOG_DEBUG("Enter");
+
+	device = prv_watch_device(upnp, path, &id, error);
+	if (device)
+		msu_device_watch(device, path, id, client);
+
+	g_free(id);
+
+	MSU_LOG_DEBUG("Exit");
+
+	return device != NULL;
+}
+
+gboolean msu_upnp_unwatch(msu_upnp_t *upnp, const gchar *client,
+			  const gchar *path, GError **error)
+{
+	msu_device_t *device;
+	gchar *id = NULL;
+	gboolean retval = FALSE;
+
+	MSU_LOG_DEBUG("Enter");
+
+	device = prv_watch_device(upnp, path, &id, error);
+	if (!device)
+		goto on_exit;
+
+	retval = msu_device_unwatch(device, id, client);
+	if (!retval)
+		*error = g_error_new(MSU_ERROR, MSU_ERROR_OBJECT_NOT_FOUND,
+				     "The specified container is not being"
+				     " watched");
+
+on_exit:
+
+	g_free(id);
+
+	MSU_LOG_DEBUG("Exit");
+
+	return retval;
+}
+
+guint msu_upnp_get_rate_wait(msu_upnp_t *upnp, const gchar *path)
+{
+	gchar *root_path = NULL;
+	gchar *id = NULL;
+	msu_device_t *device;
+	guint wait = 0;
+
+	if (!msu_path_get_path_and_id(path, &root_path, &id, NULL))
+		goto on_exit;
+
+	device = msu_device_from_path(root_path, upnp->server_udn_map);
+	if (device)
+		wait = msu_device_get_rate_wait(device);
+
+on_exit:
+
+	g_free(id);
+	g_free(root_path);
+
+	return wait;
+}
+
+void msu_upnp_unwatch_client(msu_upnp_t *upnp, const gchar *client)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, upnp->server_udn_map);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		msu_device_unwatch_client(value, client);
+}
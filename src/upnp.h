@@ -23,6 +23,7 @@
 #ifndef MSU_UPNP_H__
 #define MSU_UPNP_H__
 
+#include "settings.h"
 #include "task.h"
 
 typedef struct msu_upnp_t_ msu_upnp_t;
@@ -50,9 +51,12 @@ msu_upnp_t *msu_upnp_new(GDBusConnection *connection,
 			 msu_interface_info_t *interface_info,
 			 msu_upnp_callback_t found_server,
 			 msu_upnp_callback_t lost_server,
+			 msu_settings_context_t *settings,
 			 void *user_data);
 void msu_upnp_delete(msu_upnp_t *upnp);
 GVariant *msu_upnp_get_server_ids(msu_upnp_t *upnp);
+guint32 msu_upnp_compile_filter(msu_upnp_t *upnp, GVariant *filter,
+				const gchar **upnp_filter);
 void msu_upnp_get_children(msu_upnp_t *upnp, msu_task_t *task,
 			   const gchar *protocol_info,
 			   GCancellable *cancellable,
@@ -68,15 +72,32 @@ void msu_upnp_get_prop(msu_upnp_t *upnp, msu_task_t *task,
 		       GCancellable *cancellable,
 		       msu_upnp_task_complete_t cb,
 		       void *user_data);
+gboolean msu_upnp_get_local_props(msu_upnp_t *upnp, msu_task_t *task,
+				  GError **error);
 void msu_upnp_search(msu_upnp_t *upnp, msu_task_t *task,
 		     const gchar *protocol_info,
 		     GCancellable *cancellable,
 		     msu_upnp_task_complete_t cb,
 		     void *user_data);
+void msu_upnp_list_tree(msu_upnp_t *upnp, msu_task_t *task,
+			const gchar *protocol_info,
+			GCancellable *cancellable,
+			msu_upnp_task_complete_t cb,
+			void *user_data);
+gboolean msu_upnp_get_local_count(msu_upnp_t *upnp, msu_task_t *task);
+void msu_upnp_count(msu_upnp_t *upnp, msu_task_t *task,
+		    GCancellable *cancellable,
+		    msu_upnp_task_complete_t cb,
+		    void *user_data);
 void msu_upnp_get_resource(msu_upnp_t *upnp, msu_task_t *task,
 			   GCancellable *cancellable,
 			   msu_upnp_task_complete_t cb,
 			   void *user_data);
-
+gboolean msu_upnp_watch(msu_upnp_t *upnp, const gchar *client,
+			const gchar *path, GError **error);
+gboolean msu_upnp_unwatch(msu_upnp_t *upnp, const gchar *client,
+			  const gchar *path, GError **error);
+void msu_upnp_unwatch_client(msu_upnp_t *upnp, const gchar *client);
+guint msu_upnp_get_rate_wait(msu_upnp_t *upnp, const gchar *path);
 
 #endif
@@ -0,0 +1,500 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#include <string.h>
+#include <libxml/tree.h>
+#include <libgupnp/gupnp-error.h>
+#include <libgupnp-av/gupnp-av.h>
+
+#include "interface.h"
+#include "limit.h"
+#include "log.h"
+#include "path.h"
+#include "watch.h"
+
+#define MSU_WATCH_DEFAULT_PAGE_SIZE 256
+#define MSU_WATCH_RETRY_DELAY 250
+
+/*
+ * A snapshot maps the ID of each child of a watched container to a
+ * checksum of the child's DIDL-Lite element.  Comparing two snapshots
+ * tells us which children were added, removed or modified.
+ */
+
+typedef struct msu_watch_container_t_ msu_watch_container_t;
+struct msu_watch_container_t_ {
+	msu_watch_t *watch;
+	gchar *id;
+	gchar *path;
+	gchar *root_path;
+	GHashTable *clients;
+	GHashTable *snapshot;
+	GHashTable *next;
+	msu_watch_request_t *request;
+	gboolean restart;
+	gboolean queued;
+};
+
+struct msu_watch_t_ {
+	GDBusConnection *connection;
+	msu_limit_t *limit;
+	guint page_size;
+	msu_watch_dispatch_t dispatch;
+	void *user_data;
+	GHashTable *containers;
+	GQueue queue;
+	guint timeout_id;
+};
+
+static void prv_watch_request_delete(msu_watch_request_t *request)
+{
+	if (request) {
+		if (request->proxy)
+			g_object_unref(request->proxy);
+
+		g_free(request->id);
+		g_free(request);
+	}
+}
+
+static void prv_watch_container_delete(gpointer container)
+{
+	msu_watch_container_t *c = container;
+
+	if (c) {
+		if (c->queued) {
+			g_queue_remove(&c->watch->queue, c);
+			prv_watch_request_delete(c->request);
+		} else if (c->request) {
+			msu_limit_cancel_action(c->request->proxy,
+						c->request->action);
+			prv_watch_request_delete(c->request);
+		}
+
+		if (c->next)
+			g_hash_table_unref(c->next);
+
+		if (c->snapshot)
+			g_hash_table_unref(c->snapshot);
+
+		g_hash_table_unref(c->clients);
+		g_free(c->id);
+		g_free(c->path);
+		g_free(c->root_path);
+		g_free(c);
+	}
+}
+
+static gboolean prv_watch_timeout_cb(gpointer user_data)
+{
+	msu_watch_t *watch = user_data;
+	msu_watch_container_t *container;
+	guint wait;
+
+	watch->timeout_id = 0;
+
+	/* Watches are background work.  Their listings wait for the server
+	   to have room for another action rather than competing with
+	   clients, so that a change to many watched containers at once
+	   does not turn into a burst of browses. */
+
+	while (watch->queue.length > 0 && msu_limit_available(watch->limit)) {
+		container = g_queue_pop_head(&watch->queue);
+		container->queued = FALSE;
+		watch->dispatch(container->request, watch->user_data);
+	}
+
+	if (watch->queue.length > 0) {
+		wait = msu_limit_get_wait(watch->limit);
+		watch->timeout_id = g_timeout_add(MAX(wait,
+						      MSU_WATCH_RETRY_DELAY),
+						  prv_watch_timeout_cb, watch);
+	}
+
+	return FALSE;
+}
+
+static void prv_watch_dispatch(msu_watch_container_t *container, guint start)
+{
+	msu_watch_t *watch = container->watch;
+	msu_watch_request_t *request;
+
+	request = g_new0(msu_watch_request_t, 1);
+	request->watch = watch;
+	request->id = g_strdup(container->id);
+	request->start = start;
+	request->count = watch->page_size;
+
+	container->request = request;
+	container->queued = TRUE;
+	g_queue_push_tail(&watch->queue, container);
+
+	if (!watch->timeout_id)
+		(void) prv_watch_timeout_cb(watch);
+}
+
+static void prv_watch_refresh(msu_watch_container_t *container)
+{
+	MSU_LOG_DEBUG("Refreshing watched container %s", container->id);
+
+	/* A listing that has not been sent yet simply starts over. */
+
+	if (container->queued) {
+		container->request->start = 0;
+		g_hash_table_remove_all(container->next);
+		goto on_exit;
+	}
+
+	if (container->request) {
+		container->restart = TRUE;
+		goto on_exit;
+	}
+
+	if (container->next)
+		g_hash_table_unref(container->next);
+
+	container->next = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, g_free);
+	container->restart = FALSE;
+	prv_watch_dispatch(container, 0);
+
+on_exit:
+
+	return;
+}
+
+static void prv_watch_found_object(GUPnPDIDLLiteParser *parser,
+				   GUPnPDIDLLiteObject *object,
+				   gpointer user_data)
+{
+	msu_watch_container_t *container = user_data;
+	xmlNode *node;
+	xmlBuffer *buffer;
+	const gchar *id;
+	gchar *checksum;
+
+	id = gupnp_didl_lite_object_get_id(object);
+	node = gupnp_didl_lite_object_get_xml_node(object);
+
+	if (!id || !node)
+		goto on_exit;
+
+	buffer = xmlBufferCreate();
+	(void) xmlNodeDump(buffer, node->doc, node, 0, 0);
+	checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+					       xmlBufferContent(buffer),
+					       xmlBufferLength(buffer));
+	xmlBufferFree(buffer);
+
+	g_hash_table_insert(container->next, g_strdup(id), checksum);
+
+on_exit:
+
+	return;
+}
+
+static guint prv_watch_add_paths(msu_watch_container_t *container,
+				 GHashTable *from, GHashTable *to,
+				 gboolean modified, GVariantBuilder *vb)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	const gchar *other;
+	gchar *path;
+	guint count = 0;
+
+	/* Adds the children in from that are missing from to or, if
+	   modified is TRUE, whose checksums differ. */
+
+	g_hash_table_iter_init(&iter, from);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		other = g_hash_table_lookup(to, key);
+
+		if (modified ? (!other || !strcmp(other, value)) : !!other)
+			continue;
+
+		path = msu_path_from_id(container->root_path, key);
+		g_variant_builder_add(vb, "o", path);
+		g_free(path);
+		count++;
+	}
+
+	return count;
+}
+
+static void prv_watch_emit_diff(msu_watch_container_t *container)
+{
+	msu_watch_t *watch = container->watch;
+	GVariantBuilder added;
+	GVariantBuilder removed;
+	GVariantBuilder modified;
+	GVariant *diff;
+	GHashTableIter iter;
+	gpointer client;
+	guint changes;
+
+	g_variant_builder_init(&added, G_VARIANT_TYPE("ao"));
+	g_variant_builder_init(&removed, G_VARIANT_TYPE("ao"));
+	g_variant_builder_init(&modified, G_VARIANT_TYPE("ao"));
+
+	changes = prv_watch_add_paths(container, container->next,
+				      container->snapshot, FALSE, &added);
+	changes += prv_watch_add_paths(container, container->snapshot,
+				       container->next, FALSE, &removed);
+	changes += prv_watch_add_paths(container, container->next,
+				       container->snapshot, TRUE, &modified);
+
+	if (!changes) {
+		MSU_LOG_DEBUG("No change in watched container %s",
+			      container->id);
+
+		g_variant_builder_clear(&added);
+		g_variant_builder_clear(&removed);
+		g_variant_builder_clear(&modified);
+		goto on_exit;
+	}
+
+	diff = g_variant_ref_sink(g_variant_new("(@ao@ao@ao)",
+					g_variant_builder_end(&added),
+					g_variant_builder_end(&removed),
+					g_variant_builder_end(&modified)));
+
+	g_hash_table_iter_init(&iter, container->clients);
+	while (g_hash_table_iter_next(&iter, &client, NULL))
+		(void) g_dbus_connection_emit_signal(
+			watch->connection,
+			client,
+			container->path,
+			MSU_INTERFACE_MEDIA_CONTAINER,
+			MSU_INTERFACE_CHILDREN_CHANGED,
+			diff,
+			NULL);
+
+	g_variant_unref(diff);
+
+on_exit:
+
+	return;
+}
+
+static void prv_watch_finish(msu_watch_container_t *container)
+{
+	if (container->snapshot) {
+		prv_watch_emit_diff(container);
+		g_hash_table_unref(container->snapshot);
+	}
+
+	MSU_LOG_DEBUG("Watched container %s has %u children", container->id,
+		      g_hash_table_size(container->next));
+
+	container->snapshot = container->next;
+	container->next = NULL;
+}
+
+void msu_watch_new(GDBusConnection *connection, msu_limit_t *limit,
+		   guint page_size, msu_watch_dispatch_t dispatch,
+		   void *user_data, msu_watch_t **watch)
+{
+	msu_watch_t *w = g_new0(msu_watch_t, 1);
+
+	w->connection = connection;
+	w->limit = limit;
+	w->page_size = page_size ? page_size : MSU_WATCH_DEFAULT_PAGE_SIZE;
+	w->dispatch = dispatch;
+	w->user_data = user_data;
+	w->containers = g_hash_table_new_full(g_str_hash, g_str_equal,
+					      NULL,
+					      prv_watch_container_delete);
+	g_queue_init(&w->queue);
+
+	*watch = w;
+}
+
+void msu_watch_delete(msu_watch_t *watch)
+{
+	if (watch) {
+		if (watch->timeout_id)
+			(void) g_source_remove(watch->timeout_id);
+
+		g_hash_table_unref(watch->containers);
+		g_free(watch);
+	}
+}
+
+void msu_watch_add(msu_watch_t *watch, const gchar *root_path,
+		   const gchar *path, const gchar *id, const gchar *client)
+{
+	msu_watch_container_t *container;
+
+	container = g_hash_table_lookup(watch->containers, id);
+
+	if (!container) {
+		container = g_new0(msu_watch_container_t, 1);
+		container->watch = watch;
+		container->id = g_strdup(id);
+		container->path = g_strdup(path);
+		container->root_path = g_strdup(root_path);
+		container->clients = g_hash_table_new_full(g_str_hash,
+							   g_str_equal,
+							   g_free, NULL);
+		g_hash_table_insert(watch->containers, container->id,
+				    container);
+
+		/* The first listing only provides the snapshot against
+		   which later changes are compared. */
+
+		prv_watch_refresh(container);
+	}
+
+	g_hash_table_insert(container->clients, g_strdup(client),
+			    GINT_TO_POINTER(TRUE));
+}
+
+gboolean msu_watch_remove(msu_watch_t *watch, const gchar *id,
+			  const gchar *client)
+{
+	msu_watch_container_t *container;
+	gboolean retval = FALSE;
+
+	container = g_hash_table_lookup(watch->containers, id);
+	if (!container)
+		goto on_exit;
+
+	retval = g_hash_table_remove(container->clients, client);
+
+	if (!g_hash_table_size(container->clients))
+		(void) g_hash_table_remove(watch->containers, id);
+
+on_exit:
+
+	return retval;
+}
+
+void msu_watch_remove_client(msu_watch_t *watch, const gchar *client)
+{
+	GHashTableIter iter;
+	msu_watch_container_t *container;
+
+	g_hash_table_iter_init(&iter, watch->containers);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &container)) {
+		(void) g_hash_table_remove(container->clients, client);
+		if (!g_hash_table_size(container->clients))
+			g_hash_table_iter_remove(&iter);
+	}
+}
+
+void msu_watch_invalidate_id(msu_watch_t *watch, const gchar *id)
+{
+	msu_watch_container_t *container;
+
+	container = g_hash_table_lookup(watch->containers, id);
+	if (container)
+		prv_watch_refresh(container);
+}
+
+gboolean msu_watch_is_active(msu_watch_t *watch)
+{
+	return g_hash_table_size(watch->containers) > 0;
+}
+
+void msu_watch_invalidate_all(msu_watch_t *watch)
+{
+	GHashTableIter iter;
+	msu_watch_container_t *container;
+
+	g_hash_table_iter_init(&iter, watch->containers);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &container))
+		prv_watch_refresh(container);
+}
+
+void msu_watch_request_complete(msu_watch_request_t *request,
+				const gchar *didl, guint number_returned,
+				guint total_matches)
+{
+	msu_watch_t *watch = request->watch;
+	msu_watch_container_t *container;
+	GUPnPDIDLLiteParser *parser = NULL;
+	GError *upnp_error = NULL;
+	gboolean done;
+
+	container = g_hash_table_lookup(watch->containers, request->id);
+	container->request = NULL;
+
+	/* The container changed again while we were listing it.  Start
+	   over so that a single diff covers both changes. */
+
+	if (container->restart) {
+		prv_watch_refresh(container);
+		goto on_exit;
+	}
+
+	if (!didl) {
+		MSU_LOG_WARNING("Unable to list watched container %s",
+				container->id);
+		goto on_error;
+	}
+
+	parser = gupnp_didl_lite_parser_new();
+	g_signal_connect(parser, "object-available" ,
+			 G_CALLBACK(prv_watch_found_object), container);
+
+	if (!gupnp_didl_lite_parser_parse_didl(parser, didl, &upnp_error)
+	    && upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
+		MSU_LOG_WARNING("Unable to parse watched container %s: %s",
+				container->id, upnp_error->message);
+		goto on_error;
+	}
+
+	if (number_returned == 0)
+		done = TRUE;
+	else if (total_matches)
+		done = request->start + number_returned >= total_matches;
+	else
+		done = number_returned < request->count;
+
+	if (done)
+		prv_watch_finish(container);
+	else
+		prv_watch_dispatch(container,
+				   request->start + number_returned);
+
+	goto on_exit;
+
+on_error:
+
+	/* The previous snapshot is kept.  The next change to the
+	   container is compared against it. */
+
+	g_hash_table_unref(container->next);
+	container->next = NULL;
+
+on_exit:
+
+	if (upnp_error)
+		g_error_free(upnp_error);
+
+	if (parser)
+		g_object_unref(parser);
+
+	prv_watch_request_delete(request);
+}
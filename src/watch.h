@@ -0,0 +1,64 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Mark Ryan <mark.d.ryan@intel.com>
+ *
+ */
+
+#ifndef MSU_WATCH_H__
+#define MSU_WATCH_H__
+
+#include <gio/gio.h>
+#include <libgupnp/gupnp-control-point.h>
+
+#include "limit.h"
+
+typedef struct msu_watch_t_ msu_watch_t;
+
+typedef struct msu_watch_request_t_ msu_watch_request_t;
+struct msu_watch_request_t_ {
+	msu_watch_t *watch;
+	gchar *id;
+	guint start;
+	guint count;
+	GUPnPServiceProxy *proxy;
+	GUPnPServiceProxyAction *action;
+};
+
+typedef void (*msu_watch_dispatch_t)(msu_watch_request_t *request,
+				     void *user_data);
+
+void msu_watch_new(GDBusConnection *connection, msu_limit_t *limit,
+		   guint page_size, msu_watch_dispatch_t dispatch,
+		   void *user_data, msu_watch_t **watch);
+void msu_watch_delete(msu_watch_t *watch);
+
+void msu_watch_add(msu_watch_t *watch, const gchar *root_path,
+		   const gchar *path, const gchar *id, const gchar *client);
+gboolean msu_watch_remove(msu_watch_t *watch, const gchar *id,
+			  const gchar *client);
+void msu_watch_remove_client(msu_watch_t *watch, const gchar *client);
+
+gboolean msu_watch_is_active(msu_watch_t *watch);
+void msu_watch_invalidate_id(msu_watch_t *watch, const gchar *id);
+void msu_watch_invalidate_all(msu_watch_t *watch);
+void msu_watch_request_complete(msu_watch_request_t *request,
+				const gchar *didl, guint number_returned,
+				guint total_matches);
+
+#endif